@@ -0,0 +1,418 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define DT_DRV_COMPAT sensirion_scd4x
+
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/i2c_emul.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+
+#include "scd4x_commands.h"
+#include "sensor_trace.h"
+#include "emul_scd4x.h"
+
+LOG_MODULE_REGISTER(emul_scd4x, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
+
+/* Longest response is the serial number or a measurement: 3 words */
+#define SCD4X_EMUL_MAX_RESPONSE_WORDS 3
+
+enum scd4x_emul_mode {
+	SCD4X_EMUL_MODE_IDLE,
+	SCD4X_EMUL_MODE_PERIODIC,
+	SCD4X_EMUL_MODE_LOW_POWER_PERIODIC,
+	SCD4X_EMUL_MODE_SINGLE_SHOT,
+	SCD4X_EMUL_MODE_SLEEP,
+};
+
+struct scd4x_emul_data {
+	struct k_spinlock lock;
+	enum scd4x_emul_mode mode;
+	/* Uptime at which the current measurement schedule started */
+	int64_t schedule_start_ms;
+	uint32_t interval_ms;
+	/* Number of measurements completed and consumed within the schedule */
+	uint32_t measurements_consumed;
+	uint32_t read_count;
+	/* Raw signal values as transmitted by the sensor */
+	uint16_t co2_ppm;
+	int16_t co2_correction;
+	uint16_t temperature_ticks;
+	uint16_t humidity_ticks;
+	uint16_t temperature_offset;
+	uint16_t altitude;
+	uint16_t asc_enabled;
+	uint16_t response[SCD4X_EMUL_MAX_RESPONSE_WORDS];
+	size_t response_words;
+	/* Trace replay: measurements come from the trace, paced by its timestamps */
+	const uint8_t *trace;
+	size_t trace_len;
+	size_t trace_pos;
+	int64_t trace_start_ms;
+	/* Replay time of the next frame, relative to trace_start_ms */
+	int64_t trace_next_ms;
+	/* Recorded uptime of the next frame */
+	uint32_t trace_uptime_ms;
+	bool trace_synced;
+	bool trace_pending;
+	struct sensor_trace_frame trace_frame;
+};
+
+static uint8_t scd4x_emul_crc(const uint8_t *word)
+{
+	return crc8(word, 2, SCD4X_CRC8_POLYNOMIAL, SCD4X_CRC8_INIT, false);
+}
+
+static uint32_t scd4x_emul_measurements_done(struct scd4x_emul_data *data)
+{
+	int64_t elapsed = k_uptime_get() - data->schedule_start_ms;
+
+	switch (data->mode) {
+	case SCD4X_EMUL_MODE_PERIODIC:
+	case SCD4X_EMUL_MODE_LOW_POWER_PERIODIC:
+		return (uint32_t)(elapsed / data->interval_ms);
+	case SCD4X_EMUL_MODE_SINGLE_SHOT:
+		return elapsed >= SCD4X_SINGLE_SHOT_DURATION_MSEC ? 1 : 0;
+	default:
+		return data->measurements_consumed;
+	}
+}
+
+/* Loads the next frame of the trace, trace_pending is false at its end */
+static void scd4x_emul_trace_advance(struct scd4x_emul_data *data)
+{
+	data->trace_pending = false;
+
+	while (data->trace_pos + SENSOR_TRACE_RECORD_SIZE <= data->trace_len) {
+		const uint8_t *record = &data->trace[data->trace_pos];
+		uint16_t tag = sys_get_le16(record);
+
+		data->trace_pos += SENSOR_TRACE_RECORD_SIZE;
+
+		if (tag == SENSOR_TRACE_TAG_END) {
+			break;
+		}
+
+		if (tag == SENSOR_TRACE_TAG_SYNC) {
+			uint32_t uptime_ms = sys_get_le32(&record[2]);
+
+			/* Gaps are replayed, a reboot (uptime going back) continues without one */
+			if (data->trace_synced && uptime_ms > data->trace_uptime_ms) {
+				data->trace_next_ms += uptime_ms - data->trace_uptime_ms;
+			}
+
+			data->trace_uptime_ms = uptime_ms;
+			data->trace_synced = true;
+			continue;
+		}
+
+		data->trace_uptime_ms += tag * SENSOR_TRACE_TICK_MSEC;
+		data->trace_next_ms += tag * SENSOR_TRACE_TICK_MSEC;
+		data->trace_frame.co2_ppm = sys_get_le16(&record[2]);
+		data->trace_frame.temperature_ticks = sys_get_le16(&record[4]);
+		data->trace_frame.humidity_ticks = sys_get_le16(&record[6]);
+		data->trace_pending = true;
+		break;
+	}
+}
+
+static bool scd4x_emul_data_ready(struct scd4x_emul_data *data)
+{
+	if (data->trace) {
+		/* Every frame is delivered once its time has come, none is skipped */
+		return data->mode != SCD4X_EMUL_MODE_IDLE && data->mode != SCD4X_EMUL_MODE_SLEEP &&
+		       data->trace_pending &&
+		       k_uptime_get() - data->trace_start_ms >= data->trace_next_ms;
+	}
+
+	return scd4x_emul_measurements_done(data) > data->measurements_consumed;
+}
+
+static void scd4x_emul_start_schedule(struct scd4x_emul_data *data, enum scd4x_emul_mode mode,
+				      uint32_t interval_ms)
+{
+	data->mode = mode;
+	data->interval_ms = interval_ms;
+	data->schedule_start_ms = k_uptime_get();
+	data->measurements_consumed = 0;
+}
+
+static void scd4x_emul_respond(struct scd4x_emul_data *data, const uint16_t *words, size_t count)
+{
+	memcpy(data->response, words, count * sizeof(uint16_t));
+	data->response_words = count;
+}
+
+static bool scd4x_emul_is_measuring(struct scd4x_emul_data *data)
+{
+	return data->mode == SCD4X_EMUL_MODE_PERIODIC ||
+	       data->mode == SCD4X_EMUL_MODE_LOW_POWER_PERIODIC;
+}
+
+static int scd4x_emul_execute(struct scd4x_emul_data *data, uint16_t cmd, const uint16_t *args,
+			      size_t arg_count)
+{
+	uint16_t words[SCD4X_EMUL_MAX_RESPONSE_WORDS];
+
+	if (data->mode == SCD4X_EMUL_MODE_SLEEP && cmd != SCD4X_CMD_WAKE_UP) {
+		/* Sensor does not acknowledge anything but wake up while sleeping */
+		return -EIO;
+	}
+
+	if (scd4x_emul_is_measuring(data) && cmd != SCD4X_CMD_READ_MEASUREMENT &&
+	    cmd != SCD4X_CMD_GET_DATA_READY_STATUS && cmd != SCD4X_CMD_STOP_PERIODIC_MEASUREMENT &&
+	    cmd != SCD4X_CMD_SET_AMBIENT_PRESSURE) {
+		/* The real sensor would reject the command, keep going but make it visible */
+		LOG_WRN("Command 0x%04x issued during periodic measurement", cmd);
+	}
+
+	switch (cmd) {
+	case SCD4X_CMD_START_PERIODIC_MEASUREMENT:
+		scd4x_emul_start_schedule(data, SCD4X_EMUL_MODE_PERIODIC,
+					  SCD4X_PERIODIC_MEASUREMENT_INTERVAL_MSEC);
+		break;
+	case SCD4X_CMD_START_LOW_POWER_PERIODIC_MEASUREMENT:
+		scd4x_emul_start_schedule(data, SCD4X_EMUL_MODE_LOW_POWER_PERIODIC,
+					  SCD4X_LOW_POWER_MEASUREMENT_INTERVAL_MSEC);
+		break;
+	case SCD4X_CMD_MEASURE_SINGLE_SHOT:
+	case SCD4X_CMD_MEASURE_SINGLE_SHOT_RHT_ONLY:
+		scd4x_emul_start_schedule(data, SCD4X_EMUL_MODE_SINGLE_SHOT,
+					  SCD4X_SINGLE_SHOT_DURATION_MSEC);
+		break;
+	case SCD4X_CMD_STOP_PERIODIC_MEASUREMENT:
+	case SCD4X_CMD_WAKE_UP:
+	case SCD4X_CMD_REINIT:
+		data->mode = SCD4X_EMUL_MODE_IDLE;
+		break;
+	case SCD4X_CMD_POWER_DOWN:
+		data->mode = SCD4X_EMUL_MODE_SLEEP;
+		break;
+	case SCD4X_CMD_READ_MEASUREMENT:
+		if (!scd4x_emul_data_ready(data)) {
+			/* No new measurement, the sensor NACKs the read */
+			return -EIO;
+		}
+		data->measurements_consumed = scd4x_emul_measurements_done(data);
+		if (data->mode == SCD4X_EMUL_MODE_SINGLE_SHOT) {
+			data->mode = SCD4X_EMUL_MODE_IDLE;
+		}
+		data->read_count++;
+		if (data->trace) {
+			data->co2_ppm = data->trace_frame.co2_ppm;
+			data->temperature_ticks = data->trace_frame.temperature_ticks;
+			data->humidity_ticks = data->trace_frame.humidity_ticks;
+			scd4x_emul_trace_advance(data);
+		}
+		words[0] = (uint16_t)CLAMP((int32_t)data->co2_ppm + data->co2_correction, 0,
+					   UINT16_MAX);
+		words[1] = data->temperature_ticks;
+		words[2] = data->humidity_ticks;
+		scd4x_emul_respond(data, words, 3);
+		break;
+	case SCD4X_CMD_GET_DATA_READY_STATUS:
+		words[0] = scd4x_emul_data_ready(data) ? 0x8006 : 0x8000;
+		scd4x_emul_respond(data, words, 1);
+		break;
+	case SCD4X_CMD_PERFORM_FORCED_RECALIBRATION:
+		if (arg_count < 1) {
+			return -EIO;
+		}
+		if (scd4x_emul_is_measuring(data)) {
+			words[0] = SCD4X_FRC_FAILED;
+		} else {
+			int32_t correction = (int32_t)args[0] - data->co2_ppm - data->co2_correction;
+
+			data->co2_correction += correction;
+			words[0] = (uint16_t)(correction + SCD4X_FRC_CORRECTION_OFFSET);
+		}
+		scd4x_emul_respond(data, words, 1);
+		break;
+	case SCD4X_CMD_SET_TEMPERATURE_OFFSET:
+		data->temperature_offset = arg_count ? args[0] : data->temperature_offset;
+		break;
+	case SCD4X_CMD_GET_TEMPERATURE_OFFSET:
+		scd4x_emul_respond(data, &data->temperature_offset, 1);
+		break;
+	case SCD4X_CMD_SET_SENSOR_ALTITUDE:
+		data->altitude = arg_count ? args[0] : data->altitude;
+		break;
+	case SCD4X_CMD_GET_SENSOR_ALTITUDE:
+		scd4x_emul_respond(data, &data->altitude, 1);
+		break;
+	case SCD4X_CMD_SET_AUTOMATIC_SELF_CALIBRATION:
+		data->asc_enabled = arg_count ? args[0] : data->asc_enabled;
+		break;
+	case SCD4X_CMD_GET_AUTOMATIC_SELF_CALIBRATION:
+		scd4x_emul_respond(data, &data->asc_enabled, 1);
+		break;
+	case SCD4X_CMD_GET_SERIAL_NUMBER:
+		words[0] = 0xE4B8;
+		words[1] = 0x3F86;
+		words[2] = 0x0001;
+		scd4x_emul_respond(data, words, 3);
+		break;
+	case SCD4X_CMD_PERFORM_SELF_TEST:
+		words[0] = 0x0000;
+		scd4x_emul_respond(data, words, 1);
+		break;
+	case SCD4X_CMD_PERFORM_FACTORY_RESET:
+		data->co2_correction = 0;
+		break;
+	case SCD4X_CMD_SET_AMBIENT_PRESSURE:
+	case SCD4X_CMD_PERSIST_SETTINGS:
+		break;
+	default:
+		LOG_ERR("Unsupported command 0x%04x", cmd);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static int scd4x_emul_write(struct scd4x_emul_data *data, const uint8_t *buf, uint32_t len)
+{
+	uint16_t args[2];
+	size_t arg_count = 0;
+
+	if (len < 2 || (len - 2) % SCD4X_WORD_SIZE != 0 ||
+	    (len - 2) / SCD4X_WORD_SIZE > ARRAY_SIZE(args)) {
+		return -EIO;
+	}
+
+	for (uint32_t offset = 2; offset < len; offset += SCD4X_WORD_SIZE) {
+		if (scd4x_emul_crc(&buf[offset]) != buf[offset + 2]) {
+			LOG_ERR("CRC mismatch in command argument");
+			return -EIO;
+		}
+		args[arg_count++] = sys_get_be16(&buf[offset]);
+	}
+
+	/* A new command discards any unread response */
+	data->response_words = 0;
+
+	return scd4x_emul_execute(data, sys_get_be16(buf), args, arg_count);
+}
+
+static int scd4x_emul_read(struct scd4x_emul_data *data, uint8_t *buf, uint32_t len)
+{
+	if (data->response_words == 0 || len > data->response_words * SCD4X_WORD_SIZE) {
+		return -EIO;
+	}
+
+	for (uint32_t offset = 0; offset < len; offset += SCD4X_WORD_SIZE) {
+		uint8_t word[SCD4X_WORD_SIZE];
+
+		sys_put_be16(data->response[offset / SCD4X_WORD_SIZE], word);
+		word[2] = scd4x_emul_crc(word);
+		memcpy(&buf[offset], word, MIN(len - offset, SCD4X_WORD_SIZE));
+	}
+	data->response_words = 0;
+
+	return 0;
+}
+
+static int scd4x_emul_transfer(const struct emul *target, struct i2c_msg *msgs, int num_msgs,
+			       int addr)
+{
+	struct scd4x_emul_data *data = target->data;
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+	int err = 0;
+
+	ARG_UNUSED(addr);
+
+	for (int i = 0; i < num_msgs && !err; i++) {
+		if (msgs[i].flags & I2C_MSG_READ) {
+			err = scd4x_emul_read(data, msgs[i].buf, msgs[i].len);
+		} else {
+			err = scd4x_emul_write(data, msgs[i].buf, msgs[i].len);
+		}
+	}
+
+	k_spin_unlock(&data->lock, key);
+
+	return err;
+}
+
+void emul_scd4x_set_measurement(const struct emul *target, uint16_t co2_ppm,
+				int32_t temperature_mc, uint32_t humidity_mpct)
+{
+	struct scd4x_emul_data *data = target->data;
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+	/* Datasheet chapter 3.5.2: T = -45 + 175 * ticks / 2^16, RH = 100 * ticks / 2^16 */
+	data->co2_ppm = co2_ppm;
+	data->temperature_ticks =
+		(uint16_t)CLAMP(((int64_t)temperature_mc + 45000) * 65536 / 175000, 0, UINT16_MAX);
+	data->humidity_ticks =
+		(uint16_t)CLAMP((int64_t)humidity_mpct * 65536 / 100000, 0, UINT16_MAX);
+
+	k_spin_unlock(&data->lock, key);
+}
+
+int emul_scd4x_set_trace(const struct emul *target, const uint8_t *trace, size_t len)
+{
+	struct scd4x_emul_data *data = target->data;
+
+	if (len < SENSOR_TRACE_HEADER_SIZE || !sensor_trace_check_header(trace)) {
+		return -EINVAL;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+	data->trace = trace;
+	data->trace_len = len;
+	data->trace_pos = SENSOR_TRACE_HEADER_SIZE;
+	data->trace_start_ms = k_uptime_get();
+	data->trace_next_ms = 0;
+	data->trace_uptime_ms = 0;
+	data->trace_synced = false;
+	scd4x_emul_trace_advance(data);
+
+	k_spin_unlock(&data->lock, key);
+
+	return 0;
+}
+
+bool emul_scd4x_trace_done(const struct emul *target)
+{
+	struct scd4x_emul_data *data = target->data;
+
+	return data->trace && !data->trace_pending;
+}
+
+uint32_t emul_scd4x_read_count(const struct emul *target)
+{
+	struct scd4x_emul_data *data = target->data;
+
+	return data->read_count;
+}
+
+static int scd4x_emul_init(const struct emul *target, const struct device *parent)
+{
+	ARG_UNUSED(parent);
+
+	/* Typical indoor conditions */
+	emul_scd4x_set_measurement(target, 600, 22500, 45000);
+
+	return 0;
+}
+
+static const struct i2c_emul_api scd4x_emul_api_i2c = {
+	.transfer = scd4x_emul_transfer,
+};
+
+#define SCD4X_EMUL(n)                                                                              \
+	static struct scd4x_emul_data scd4x_emul_data_##n;                                        \
+	EMUL_DT_INST_DEFINE(n, scd4x_emul_init, &scd4x_emul_data_##n, NULL, &scd4x_emul_api_i2c,  \
+			    NULL)
+
+DT_INST_FOREACH_STATUS_OKAY(SCD4X_EMUL)
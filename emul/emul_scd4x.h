@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef EMUL_SCD4X_H
+#define EMUL_SCD4X_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/drivers/emul.h>
+
+/**
+ * @brief Sets the values returned by the following SCD4x measurements.
+ *
+ * @param target          SCD4x emulator.
+ * @param co2_ppm         CO2 concentration in ppm.
+ * @param temperature_mc  Temperature in milli degrees Celsius.
+ * @param humidity_mpct   Relative humidity in milli percent.
+ */
+void emul_scd4x_set_measurement(const struct emul *target, uint16_t co2_ppm,
+				int32_t temperature_mc, uint32_t humidity_mpct);
+
+/**
+ * @brief Replays a recorded sensor trace instead of the values set by
+ *	  emul_scd4x_set_measurement().
+ *
+ * Each measurement read returns the next trace frame. A frame becomes ready once the time
+ * recorded since the first one has passed, in simulated time, so the replay is deterministic
+ * however fast the simulation runs. The trace must stay valid during the replay.
+ *
+ * @param target  SCD4x emulator.
+ * @param trace   Trace in the format of sensor_trace.h, starting with its header.
+ * @param len     Trace length in bytes.
+ *
+ * @return 0 if success, -EINVAL if the trace header is not valid.
+ */
+int emul_scd4x_set_trace(const struct emul *target, const uint8_t *trace, size_t len);
+
+/**
+ * @brief Checks whether all frames of the replayed trace were read.
+ *
+ * @param target  SCD4x emulator.
+ */
+bool emul_scd4x_trace_done(const struct emul *target);
+
+/**
+ * @brief Returns the number of measurements read from the emulator so far.
+ *
+ * @param target  SCD4x emulator.
+ */
+uint32_t emul_scd4x_read_count(const struct emul *target);
+
+#endif /* EMUL_SCD4X_H */
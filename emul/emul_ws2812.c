@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define DT_DRV_COMPAT worldsemi_ws2812_spi
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/spi.h>
+#include <zephyr/drivers/spi_emul.h>
+#include <zephyr/logging/log.h>
+
+#include "emul_ws2812.h"
+
+LOG_MODULE_REGISTER(emul_ws2812, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
+
+struct ws2812_emul_cfg {
+	uint8_t one_frame;
+};
+
+struct ws2812_emul_data {
+	uint32_t frame_count;
+	uint32_t last_grb;
+};
+
+static int ws2812_emul_io(const struct emul *target, const struct spi_config *config,
+			  const struct spi_buf_set *tx_bufs, const struct spi_buf_set *rx_bufs)
+{
+	const struct ws2812_emul_cfg *cfg = target->cfg;
+	struct ws2812_emul_data *data = target->data;
+	uint32_t grb = 0;
+	size_t bits = 0;
+
+	ARG_UNUSED(config);
+	ARG_UNUSED(rx_bufs);
+
+	if (tx_bufs == NULL) {
+		return -EINVAL;
+	}
+
+	/* Every SPI byte encodes a single bit, decode the first pixel only */
+	for (size_t i = 0; i < tx_bufs->count; i++) {
+		const uint8_t *buf = tx_bufs->buffers[i].buf;
+
+		for (size_t j = 0; j < tx_bufs->buffers[i].len && bits < 24; j++, bits++) {
+			grb = (grb << 1) | (buf[j] == cfg->one_frame ? 1 : 0);
+		}
+	}
+
+	data->last_grb = grb;
+	data->frame_count++;
+	LOG_DBG("Frame %u: GRB 0x%06x", data->frame_count, grb);
+
+	return 0;
+}
+
+uint32_t emul_ws2812_frame_count(const struct emul *target)
+{
+	struct ws2812_emul_data *data = target->data;
+
+	return data->frame_count;
+}
+
+uint32_t emul_ws2812_last_grb(const struct emul *target)
+{
+	struct ws2812_emul_data *data = target->data;
+
+	return data->last_grb;
+}
+
+static int ws2812_emul_init(const struct emul *target, const struct device *parent)
+{
+	ARG_UNUSED(target);
+	ARG_UNUSED(parent);
+
+	return 0;
+}
+
+static const struct spi_emul_api ws2812_emul_api_spi = {
+	.io = ws2812_emul_io,
+};
+
+#define WS2812_EMUL(n)                                                                             \
+	static const struct ws2812_emul_cfg ws2812_emul_cfg_##n = {                               \
+		.one_frame = DT_INST_PROP(n, spi_one_frame),                                      \
+	};                                                                                         \
+	static struct ws2812_emul_data ws2812_emul_data_##n;                                      \
+	EMUL_DT_INST_DEFINE(n, ws2812_emul_init, &ws2812_emul_data_##n, &ws2812_emul_cfg_##n,     \
+			    &ws2812_emul_api_spi, NULL)
+
+DT_INST_FOREACH_STATUS_OKAY(WS2812_EMUL)
@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef EMUL_WS2812_H
+#define EMUL_WS2812_H
+
+#include <stdint.h>
+#include <zephyr/drivers/emul.h>
+
+/**
+ * @brief Returns the number of frames sent to the LED strip so far.
+ *
+ * @param target  WS2812 emulator.
+ */
+uint32_t emul_ws2812_frame_count(const struct emul *target);
+
+/**
+ * @brief Returns the colour of the first pixel of the last frame in GRB order.
+ *
+ * @param target  WS2812 emulator.
+ */
+uint32_t emul_ws2812_last_grb(const struct emul *target);
+
+#endif /* EMUL_WS2812_H */
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SCD4X_COMMANDS_H
+#define SCD4X_COMMANDS_H
+
+/* SCD4x I2C command codes, Sensirion SCD4x datasheet chapter 3.5 */
+#define SCD4X_CMD_START_PERIODIC_MEASUREMENT 0x21B1
+#define SCD4X_CMD_READ_MEASUREMENT 0xEC05
+#define SCD4X_CMD_STOP_PERIODIC_MEASUREMENT 0x3F86
+#define SCD4X_CMD_SET_TEMPERATURE_OFFSET 0x241D
+#define SCD4X_CMD_GET_TEMPERATURE_OFFSET 0x2318
+#define SCD4X_CMD_SET_SENSOR_ALTITUDE 0x2427
+#define SCD4X_CMD_GET_SENSOR_ALTITUDE 0x2322
+#define SCD4X_CMD_SET_AMBIENT_PRESSURE 0xE000
+#define SCD4X_CMD_PERFORM_FORCED_RECALIBRATION 0x362F
+#define SCD4X_CMD_SET_AUTOMATIC_SELF_CALIBRATION 0x2416
+#define SCD4X_CMD_GET_AUTOMATIC_SELF_CALIBRATION 0x2313
+#define SCD4X_CMD_START_LOW_POWER_PERIODIC_MEASUREMENT 0x21AC
+#define SCD4X_CMD_GET_DATA_READY_STATUS 0xE4B8
+#define SCD4X_CMD_PERSIST_SETTINGS 0x3615
+#define SCD4X_CMD_GET_SERIAL_NUMBER 0x3682
+#define SCD4X_CMD_PERFORM_SELF_TEST 0x3639
+#define SCD4X_CMD_PERFORM_FACTORY_RESET 0x3632
+#define SCD4X_CMD_REINIT 0x3646
+#define SCD4X_CMD_MEASURE_SINGLE_SHOT 0x219D
+#define SCD4X_CMD_MEASURE_SINGLE_SHOT_RHT_ONLY 0x2196
+#define SCD4X_CMD_POWER_DOWN 0x36E0
+#define SCD4X_CMD_WAKE_UP 0x36F6
+
+/* Measurement intervals of the periodic modes */
+#define SCD4X_PERIODIC_MEASUREMENT_INTERVAL_MSEC 5000
+#define SCD4X_LOW_POWER_MEASUREMENT_INTERVAL_MSEC 30000
+#define SCD4X_SINGLE_SHOT_DURATION_MSEC 5000
+
+/* Lower 11 bits of the data ready status word are non-zero when data is ready */
+#define SCD4X_DATA_READY_MASK 0x07FF
+
+/* FRC returns 0xFFFF when recalibration failed, otherwise correction + 0x8000 */
+#define SCD4X_FRC_FAILED 0xFFFF
+#define SCD4X_FRC_CORRECTION_OFFSET 0x8000
+
+/* Every 16-bit word on the bus is followed by CRC-8 (poly 0x31, init 0xFF) */
+#define SCD4X_WORD_SIZE 3
+#define SCD4X_CRC8_POLYNOMIAL 0x31
+#define SCD4X_CRC8_INIT 0xFF
+
+#endif /* SCD4X_COMMANDS_H */
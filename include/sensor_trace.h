@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SENSOR_TRACE_H
+#define SENSOR_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/sys/byteorder.h>
+
+/* Binary trace of raw SCD4x measurements, written by src/trace_recorder.c and replayed
+ * by the SCD4x emulator. All fields are little endian.
+ *
+ * The trace starts with an 8 byte header: "AQTR", format version, record size, 2 zero bytes.
+ * Records of 8 bytes follow, each starting with a tag word:
+ *  - 0x0000 - 0xFFFD: measurement taken tag * 10 ms after the previous one, followed by
+ *    the three signal words of the read measurement response (CO2 ppm, T ticks, RH ticks).
+ *  - SENSOR_TRACE_TAG_SYNC: uptime in ms (32 bits) of the next measurement and a zero word.
+ *    Emitted at the start and after long gaps. Uptime going back means the device rebooted.
+ *  - SENSOR_TRACE_TAG_END: end of the trace, i.e. erased flash.
+ */
+#define SENSOR_TRACE_MAGIC "AQTR"
+#define SENSOR_TRACE_VERSION 1
+#define SENSOR_TRACE_HEADER_SIZE 8
+#define SENSOR_TRACE_RECORD_SIZE 8
+
+#define SENSOR_TRACE_TAG_SYNC 0xFFFE
+#define SENSOR_TRACE_TAG_END 0xFFFF
+#define SENSOR_TRACE_TICK_MSEC 10
+#define SENSOR_TRACE_DELTA_MAX 0xFFFD
+
+/* Signal words of a read measurement response, SCD4x datasheet chapter 3.5.2 */
+struct sensor_trace_frame {
+	uint16_t co2_ppm;
+	uint16_t temperature_ticks;
+	uint16_t humidity_ticks;
+};
+
+static inline void sensor_trace_put_header(uint8_t *buf)
+{
+	buf[0] = 'A';
+	buf[1] = 'Q';
+	buf[2] = 'T';
+	buf[3] = 'R';
+	buf[4] = SENSOR_TRACE_VERSION;
+	buf[5] = SENSOR_TRACE_RECORD_SIZE;
+	buf[6] = 0;
+	buf[7] = 0;
+}
+
+static inline bool sensor_trace_check_header(const uint8_t *buf)
+{
+	return buf[0] == 'A' && buf[1] == 'Q' && buf[2] == 'T' && buf[3] == 'R' &&
+	       buf[4] == SENSOR_TRACE_VERSION && buf[5] == SENSOR_TRACE_RECORD_SIZE;
+}
+
+static inline void sensor_trace_put_frame(uint8_t *buf, uint16_t delta,
+					  const struct sensor_trace_frame *frame)
+{
+	sys_put_le16(delta, &buf[0]);
+	sys_put_le16(frame->co2_ppm, &buf[2]);
+	sys_put_le16(frame->temperature_ticks, &buf[4]);
+	sys_put_le16(frame->humidity_ticks, &buf[6]);
+}
+
+static inline void sensor_trace_put_sync(uint8_t *buf, uint32_t uptime_ms)
+{
+	sys_put_le16(SENSOR_TRACE_TAG_SYNC, &buf[0]);
+	sys_put_le32(uptime_ms, &buf[2]);
+	sys_put_le16(0, &buf[6]);
+}
+
+#endif /* SENSOR_TRACE_H */
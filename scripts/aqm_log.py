@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2024 Jan Gnip
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+
+"""Decodes binary dictionary logs of the release build (configuration/zigbee/release.conf).
+
+The log is the raw bytes captured from the console UART, e.g.
+"cat /dev/ttyACM0 > boot.bin", the dictionary is generated from the same build with
+"west build -t aqm_log_dictionary".
+
+    aqm_log.py build/aqm_log_dictionary.json boot.bin
+    cat /dev/ttyACM0 | aqm_log.py build/aqm_log_dictionary.json -
+
+The parser of the Zephyr tree the firmware was built with is used, found through
+ZEPHYR_BASE or --zephyr-base.
+"""
+
+import argparse
+import os
+import sys
+
+
+def load_parser(zephyr_base, dictionary):
+    sys.path.insert(0, os.path.join(zephyr_base, "scripts", "logging", "dictionary"))
+
+    import dictionary_parser
+    from dictionary_parser.log_database import LogDatabase
+
+    database = LogDatabase.read_json_database(dictionary)
+    if database is None:
+        raise ValueError(f"cannot read log dictionary {dictionary}")
+
+    parser = dictionary_parser.get_parser(database)
+    if parser is None:
+        raise ValueError(f"unsupported log dictionary version in {dictionary}")
+
+    return parser
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("dictionary", help="aqm_log_dictionary.json of the running build")
+    parser.add_argument("log", help="binary log capture, - for stdin")
+    parser.add_argument("--zephyr-base", default=os.environ.get("ZEPHYR_BASE"))
+    parser.add_argument("--debug", action="store_true", help="dump records while parsing")
+    args = parser.parse_args()
+
+    if not args.zephyr_base:
+        parser.error("ZEPHYR_BASE is not set, use --zephyr-base")
+
+    log_parser = load_parser(args.zephyr_base, args.dictionary)
+
+    if args.log == "-":
+        data = sys.stdin.buffer.read()
+    else:
+        with open(args.log, "rb") as f:
+            data = f.read()
+
+    if not log_parser.parse_log_data(data, debug=args.debug):
+        sys.exit("log data could not be parsed completely, does the dictionary match the build?")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,290 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2024 Jan Gnip
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+
+"""Per module flash, RAM and stack frame budget of a Zephyr build.
+
+Sizes are summed from the input sections of the GNU linker map, stack frames are read from
+the .su files written by -fstack-usage. Data initialised from flash counts for both. Modules
+and budgets are set in a JSON file, limits are in bytes and null means report only:
+
+    {"flash": 421888, "ram": 262144,
+     "modules": [{"name": "app", "match": "^app/", "flash": 65536, "ram": null,
+                  "frame": 512}]}
+
+Each object file belongs to the first module whose regular expression matches its archive
+path (e.g. "zephyr/subsys/logging/libsubsys__logging.a"), the rest to "other". "frame" limits
+the largest stack frame of a single function in the module.
+
+    aqm_size.py build/zephyr/zephyr.map build configuration/zigbee/size_budget.json \\
+        --report build/aqm_size_report.json
+
+With --baseline, the flash and RAM of every module are also printed as a difference to an
+earlier --report, e.g. the release build against the debug build.
+
+Exits with status 1 if a budget is exceeded.
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+
+OTHER = "other"
+
+MEMORY_REGION = re.compile(r"^(\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)")
+OUTPUT_SECTION = re.compile(r"^([^\s*]\S*)(?:\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)"
+                            r"(?:\s+load address 0x([0-9a-fA-F]+))?)?\s*$")
+INPUT_SECTION = re.compile(r"^ ([^\s*]\S*)(?:\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*))?$")
+CONTINUATION = re.compile(r"^\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)"
+                          r"(?:\s+load address 0x([0-9a-fA-F]+))?\s*(\S.*)?$")
+OBJECT_DIR = re.compile(r"^(.*?)/?CMakeFiles/([^/]+)\.dir/")
+STACK_USAGE = re.compile(r"^(.*):(\d+):(\d+):(.+)\t(\d+)\t(\S+)")
+
+# Not loaded, present in the ELF only
+NON_ALLOC = (".debug", ".comment", ".ARM.attributes", ".stab", ".symtab", ".strtab", ".shstrtab",
+             ".note", "/DISCARD/")
+
+
+def region_kind(name):
+    name = name.upper()
+    if "FLASH" in name:
+        return "flash"
+    if "RAM" in name:
+        return "ram"
+    return None
+
+
+def parse_map(path):
+    """Returns {object path: {"flash": bytes, "ram": bytes}}."""
+    regions = []
+    sizes = {}
+    in_memory = False
+    in_map = False
+    # Flash and RAM charge of the current output section
+    charge = ()
+    pending = None
+
+    def region_of(addr):
+        for origin, length, kind in regions:
+            if origin <= addr < origin + length:
+                return kind
+        return None
+
+    def add(obj, size):
+        entry = sizes.setdefault(obj, {"flash": 0, "ram": 0})
+        for kind in charge:
+            entry[kind] += size
+
+    def open_section(name, vma, load):
+        if name.startswith(NON_ALLOC):
+            return ()
+        kinds = {region_of(vma)}
+        if load is not None:
+            kinds.add(region_of(load))
+        return tuple(k for k in kinds if k)
+
+    with open(path, errors="replace") as f:
+        for line in f:
+            line = line.rstrip("\n")
+
+            if line.startswith("Memory Configuration"):
+                in_memory = True
+                continue
+            if line.startswith("Linker script and memory map"):
+                in_memory = False
+                in_map = True
+                continue
+
+            if in_memory:
+                match = MEMORY_REGION.match(line)
+                if match and match.group(1) != "*default*" and region_kind(match.group(1)):
+                    regions.append((int(match.group(2), 16), int(match.group(3), 16),
+                                    region_kind(match.group(1))))
+                continue
+
+            if not in_map or not line:
+                continue
+
+            if pending:
+                kind, name = pending
+                pending = None
+                match = CONTINUATION.match(line)
+                if match:
+                    if kind == "output":
+                        load = int(match.group(3), 16) if match.group(3) else None
+                        charge = open_section(name, int(match.group(1), 16), load)
+                    elif match.group(4):
+                        add(match.group(4), int(match.group(2), 16))
+                    continue
+
+            if not line[0].isspace():
+                match = OUTPUT_SECTION.match(line)
+                if not match:
+                    continue
+                if match.group(2) is None:
+                    pending = ("output", match.group(1))
+                else:
+                    load = int(match.group(4), 16) if match.group(4) else None
+                    charge = open_section(match.group(1), int(match.group(2), 16), load)
+                continue
+
+            match = INPUT_SECTION.match(line)
+            if not match or not charge:
+                continue
+            if match.group(2) is None:
+                pending = ("input", match.group(1))
+            elif match.group(4):
+                add(match.group(4), int(match.group(3), 16))
+
+    return sizes
+
+
+def archive_of(su_path):
+    """Archive path of the object a .su file belongs to, as named in the linker map."""
+    match = OBJECT_DIR.match(su_path)
+    if not match:
+        return su_path
+
+    directory, target = match.groups()
+    # The application target is built in the top level directory but archived under app/
+    if target == "app" and not directory:
+        directory = "app"
+
+    # Objects of target X in directory D are archived as D/libX.a
+    return f"{directory}/lib{target}.a".lstrip("/")
+
+
+def parse_stack_usage(build_dir):
+    """Returns [(archive path, function, frame bytes, qualifiers)]."""
+    frames = []
+
+    for root, _, files in os.walk(build_dir):
+        for name in files:
+            if not name.endswith(".su"):
+                continue
+
+            path = os.path.join(root, name)
+            rel = os.path.relpath(path, build_dir).replace(os.sep, "/")
+            archive = archive_of(rel)
+
+            with open(path, errors="replace") as f:
+                for line in f:
+                    su = STACK_USAGE.match(line)
+                    if su:
+                        frames.append((archive, su.group(4), int(su.group(5)), su.group(6)))
+
+    return frames
+
+
+def module_of(modules, path):
+    for module in modules:
+        if module["regex"].search(path):
+            return module["name"]
+    return OTHER
+
+
+def report(sizes, frames, budget):
+    modules = [dict(m, regex=re.compile(m["match"])) for m in budget.get("modules", [])]
+    names = [m["name"] for m in modules] + [OTHER]
+    rows = {name: {"name": name, "flash": 0, "ram": 0, "frame": 0, "frame_function": None,
+                   "dynamic_frames": 0} for name in names}
+
+    for obj, size in sizes.items():
+        # "dir/libfoo.a(bar.c.obj)" or a plain object file
+        row = rows[module_of(modules, obj.split("(")[0])]
+        row["flash"] += size["flash"]
+        row["ram"] += size["ram"]
+
+    for archive, function, frame, qualifiers in frames:
+        row = rows[module_of(modules, archive)]
+        if "dynamic" in qualifiers:
+            row["dynamic_frames"] += 1
+        if frame > row["frame"]:
+            row["frame"] = frame
+            row["frame_function"] = function
+
+    limits = {m["name"]: m for m in budget.get("modules", [])}
+    over = []
+
+    def check(name, key, value, limit):
+        if limit is not None and value > limit:
+            over.append({"module": name, "kind": key, "value": value, "limit": limit})
+
+    for name in names:
+        for key in ("flash", "ram", "frame"):
+            check(name, key, rows[name][key], limits.get(name, {}).get(key))
+
+    total = {key: sum(rows[name][key] for name in names) for key in ("flash", "ram")}
+    for key in ("flash", "ram"):
+        check("total", key, total[key], budget.get(key))
+
+    return {
+        "total": total,
+        "budget": {key: budget.get(key) for key in ("flash", "ram")},
+        "modules": [dict(rows[name], budget={key: limits.get(name, {}).get(key)
+                                             for key in ("flash", "ram", "frame")})
+                    for name in names],
+        "over": over,
+    }
+
+
+def print_report(result):
+    print(f"{'module':<12} {'flash':>8} {'ram':>8} {'frame':>6}  largest frame")
+    for row in result["modules"]:
+        print(f"{row['name']:<12} {row['flash']:>8} {row['ram']:>8} {row['frame']:>6}  "
+              f"{row['frame_function'] or '-'}")
+    total = result["total"]
+    print(f"{'total':<12} {total['flash']:>8} {total['ram']:>8}")
+
+    for entry in result["over"]:
+        print(f"{entry['module']} {entry['kind']} {entry['value']} exceeds budget {entry['limit']}",
+              file=sys.stderr)
+
+
+def print_delta(result, baseline):
+    before = {row["name"]: row for row in baseline["modules"]}
+    print(f"{'module':<12} {'flash':>8} {'ram':>8}  change to baseline")
+    for row in result["modules"]:
+        old = before.get(row["name"], {"flash": 0, "ram": 0})
+        print(f"{row['name']:<12} {row['flash'] - old['flash']:>+8} {row['ram'] - old['ram']:>+8}")
+    total, old = result["total"], baseline["total"]
+    print(f"{'total':<12} {total['flash'] - old['flash']:>+8} {total['ram'] - old['ram']:>+8}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("map", help="linker map, build/zephyr/zephyr.map")
+    parser.add_argument("build_dir", help="build directory searched for .su files")
+    parser.add_argument("budget", help="module budget JSON")
+    parser.add_argument("--report", help="write the JSON report to this file")
+    parser.add_argument("--baseline", help="JSON report of another build to print differences to")
+    args = parser.parse_args()
+
+    with open(args.budget) as f:
+        budget = json.load(f)
+
+    result = report(parse_map(args.map), parse_stack_usage(args.build_dir), budget)
+    print_report(result)
+
+    if args.baseline:
+        with open(args.baseline) as f:
+            print()
+            print_delta(result, json.load(f))
+
+    if args.report:
+        with open(args.report, "w") as f:
+            json.dump(result, f, indent=2)
+            f.write("\n")
+
+    if result["over"]:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
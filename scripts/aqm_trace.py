@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2024 Jan Gnip
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+
+"""Converts sensor traces (include/sensor_trace.h) to and from CSV.
+
+The trace can be the raw bytes captured from the trace UART, e.g.
+"cat /dev/ttyACM1 > day.aqt", or the output of "aqm trace dump".
+
+    aqm_trace.py decode day.aqt > day.csv
+    aqm_trace.py encode day.csv day.aqt
+
+CSV columns: uptime_ms, co2_ppm, temperature_c, humidity_pct.
+"""
+
+import argparse
+import csv
+import re
+import struct
+import sys
+
+MAGIC = b"AQTR"
+VERSION = 1
+HEADER_SIZE = 8
+RECORD_SIZE = 8
+TAG_SYNC = 0xFFFE
+TAG_END = 0xFFFF
+TICK_MSEC = 10
+DELTA_MAX = 0xFFFD
+
+HEXDUMP_LINE = re.compile(r"^\s*[0-9a-fA-F]{8}:((?:\s[0-9a-fA-F]{2})+)")
+
+
+def load(path):
+    with open(path, "rb") as f:
+        data = f.read()
+
+    if data.startswith(MAGIC):
+        return data
+
+    # Shell hex dump: "00000000: 41 51 54 52 ... |AQTR....|"
+    out = bytearray()
+    for line in data.decode(errors="ignore").splitlines():
+        match = HEXDUMP_LINE.match(line)
+        if match:
+            out += bytes.fromhex(match.group(1))
+
+    return bytes(out)
+
+
+def decode(data):
+    if len(data) < HEADER_SIZE or data[:4] != MAGIC or data[4] != VERSION:
+        raise ValueError("not a sensor trace")
+
+    # A stream may hold several recordings, each starting with its header
+    uptime = 0
+    pos = HEADER_SIZE
+    while pos + RECORD_SIZE <= len(data):
+        record = data[pos:pos + RECORD_SIZE]
+        pos += RECORD_SIZE
+
+        if record[:4] == MAGIC:
+            continue
+
+        tag, a, b, c = struct.unpack("<4H", record)
+        if tag == TAG_END:
+            break
+        if tag == TAG_SYNC:
+            uptime = a | (b << 16)
+            continue
+
+        uptime += tag * TICK_MSEC
+        yield uptime, a, -45 + 175 * b / 65536, 100 * c / 65536
+
+
+def encode(rows):
+    out = bytearray(MAGIC + bytes([VERSION, RECORD_SIZE, 0, 0]))
+    last = None
+
+    for uptime, co2, temperature, humidity in rows:
+        t_ticks = min(max(round((temperature + 45) * 65536 / 175), 0), 0xFFFF)
+        rh_ticks = min(max(round(humidity * 65536 / 100), 0), 0xFFFF)
+        delta = None if last is None else (uptime - last) // TICK_MSEC
+
+        if delta is None or delta < 0 or delta > DELTA_MAX:
+            out += struct.pack("<HIH", TAG_SYNC, uptime & 0xFFFFFFFF, 0)
+            last = uptime
+            delta = 0
+        else:
+            last += delta * TICK_MSEC
+
+        out += struct.pack("<4H", delta, co2, t_ticks, rh_ticks)
+
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="cmd", required=True)
+    dec = sub.add_parser("decode", help="trace to CSV on stdout")
+    dec.add_argument("trace")
+    enc = sub.add_parser("encode", help="CSV to trace")
+    enc.add_argument("csv")
+    enc.add_argument("trace")
+    args = parser.parse_args()
+
+    if args.cmd == "decode":
+        writer = csv.writer(sys.stdout)
+        writer.writerow(["uptime_ms", "co2_ppm", "temperature_c", "humidity_pct"])
+        for uptime, co2, temperature, humidity in decode(load(args.trace)):
+            writer.writerow([uptime, co2, f"{temperature:.3f}", f"{humidity:.3f}"])
+    else:
+        with open(args.csv, newline="") as f:
+            rows = [(int(r[0]), int(r[1]), float(r[2]), float(r[3]))
+                    for r in csv.reader(f) if r and not r[0].startswith(("#", "uptime"))]
+        with open(args.trace, "wb") as f:
+            f.write(encode(rows))
+
+
+if __name__ == "__main__":
+    main()
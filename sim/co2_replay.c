@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Replays a recorded CO2 trace through the filters of src/co2_filter.c and the CO2 report
+ * gate behind them. Each trace line is "t_ms,raw_ppm,true_ppm", lines starting with '#' are
+ * comments.
+ */
+
+#include <stdlib.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
+
+#include "co2_filter.h"
+#include "co2_replay.h"
+#include "report_gate.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
+
+#define TRACE_ROWS_MAX 2048
+
+/* True concentration jumps at least this much between readings at a step */
+#define STEP_MIN_PPM 200
+
+/* Filtered value must settle within 10 % of a step in this time */
+#define STEP_LAG_MAX_MSEC (120 * MSEC_PER_SEC)
+
+/* Noise is measured where the true concentration did not change for this long */
+#define STEADY_MSEC (120 * MSEC_PER_SEC)
+
+struct trace_row {
+	uint32_t t_ms;
+	uint16_t raw;
+	uint16_t truth;
+};
+
+struct replay_result {
+	uint32_t cycles;
+	uint32_t noise_ppm;
+	uint32_t lag_max_ms;
+	/* Step lag of the attribute value, filter and report gate */
+	uint32_t e2e_lag_max_ms;
+};
+
+static const char trace_text[] = {
+#include "co2_office.csv.inc"
+	'\0'
+};
+
+static struct trace_row rows[TRACE_ROWS_MAX];
+static uint16_t filtered[TRACE_ROWS_MAX];
+static uint16_t reported[TRACE_ROWS_MAX];
+
+static int trace_parse(void)
+{
+	const char *line = trace_text;
+	int count = 0;
+
+	while (*line) {
+		if (*line != '#' && *line != '\n') {
+			char *end;
+
+			if (count == TRACE_ROWS_MAX) {
+				return -ENOMEM;
+			}
+
+			rows[count].t_ms = strtoul(line, &end, 10);
+			rows[count].raw = strtoul(end + 1, &end, 10);
+			rows[count].truth = strtoul(end + 1, &end, 10);
+			count++;
+		}
+
+		line = strchr(line, '\n');
+		if (!line) {
+			break;
+		}
+		line++;
+	}
+
+	return count;
+}
+
+static uint32_t isqrt(uint64_t value)
+{
+	uint64_t root = 0;
+
+	for (uint64_t bit = 1ULL << 62; bit; bit >>= 2) {
+		if (value >= root + bit) {
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
+	}
+
+	return (uint32_t)root;
+}
+
+/* RMS error of the filtered readings where the true concentration is steady */
+static uint32_t steady_noise(const uint16_t *values, int count)
+{
+	uint64_t sum = 0;
+	uint32_t n = 0;
+	int since = 0;
+
+	for (int i = 1; i < count; i++) {
+		if (rows[i].truth != rows[i - 1].truth) {
+			since = i;
+		} else if (rows[i].t_ms - rows[since].t_ms >= STEADY_MSEC) {
+			int32_t error = (int32_t)values[i] - rows[i].truth;
+
+			sum += (int64_t)error * error;
+			n++;
+		}
+	}
+
+	return n ? isqrt(sum / n) : 0;
+}
+
+/* Longest time the filtered readings took to get within 10 % of a step */
+static uint32_t step_lag(const uint16_t *values, int count)
+{
+	uint32_t lag_max = 0;
+
+	for (int i = 1; i < count; i++) {
+		int32_t step = abs((int32_t)rows[i].truth - rows[i - 1].truth);
+
+		if (step < STEP_MIN_PPM) {
+			continue;
+		}
+
+		int j = i;
+
+		while (j < count && abs((int32_t)values[j] - rows[j].truth) > step / 10) {
+			j++;
+		}
+
+		lag_max = MAX(lag_max, (j < count ? rows[j].t_ms : UINT32_MAX) - rows[i].t_ms);
+	}
+
+	return lag_max;
+}
+
+/* Attribute value behind the report gate, a written value holds until the next write */
+static void gate_replay(int count)
+{
+	uint16_t value = 0;
+
+	report_gate_reset(REPORT_GATE_CO2);
+
+	for (int i = 0; i < count; i++) {
+		int32_t output;
+
+		if (report_gate_filter(REPORT_GATE_CO2, filtered[i], rows[i].t_ms, &output)) {
+			report_gate_sent(REPORT_GATE_CO2, output, rows[i].t_ms);
+			value = (uint16_t)output;
+		}
+
+		reported[i] = value;
+	}
+
+	/* The live run starts with a fresh gate */
+	report_gate_reset(REPORT_GATE_CO2);
+}
+
+static void replay(enum co2_filter_type type, int count, struct replay_result *result)
+{
+	uint64_t cycles = 0;
+
+	co2_filter_set_type(type);
+
+	for (int i = 0; i < count; i++) {
+		uint32_t start = k_cycle_get_32();
+
+		filtered[i] = co2_filter_update(rows[i].raw, rows[i].t_ms);
+		cycles += k_cycle_get_32() - start;
+	}
+
+	result->cycles = (uint32_t)(cycles / count);
+	result->noise_ppm = steady_noise(filtered, count);
+	result->lag_max_ms = step_lag(filtered, count);
+	result->e2e_lag_max_ms = result->lag_max_ms;
+
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_REPORT_GATE)) {
+		gate_replay(count);
+		result->e2e_lag_max_ms = step_lag(reported, count);
+	}
+}
+
+int co2_replay_run(void)
+{
+	enum co2_filter_type selected = co2_filter_get_type();
+	struct replay_result raw = { 0 };
+	int count = trace_parse();
+	int err = 0;
+
+	if (count <= 0) {
+		LOG_ERR("Cannot parse the CO2 trace (err %d)", count);
+		return count ? count : -EINVAL;
+	}
+
+	for (int type = 0; type < CO2_FILTER_COUNT; type++) {
+		struct replay_result result;
+
+		replay(type, count, &result);
+
+		LOG_INF("CO2 filter %-10s: %u cycles/sample, noise %u ppm, step lag %u s, "
+			"end-to-end %u s",
+			co2_filter_name(type), result.cycles, result.noise_ppm,
+			result.lag_max_ms / MSEC_PER_SEC, result.e2e_lag_max_ms / MSEC_PER_SEC);
+
+		if (type == CO2_FILTER_NONE) {
+			raw = result;
+		} else if (result.noise_ppm >= raw.noise_ppm ||
+			   result.lag_max_ms > STEP_LAG_MAX_MSEC) {
+			LOG_ERR("CO2 filter %s does not beat the raw readings within %u s lag",
+				co2_filter_name(type), STEP_LAG_MAX_MSEC / MSEC_PER_SEC);
+			err = -EIO;
+		}
+	}
+
+	co2_filter_set_type(selected);
+
+	LOG_INF("CO2 trace: %d readings over %u s", count, rows[count - 1].t_ms / MSEC_PER_SEC);
+
+	return err;
+}
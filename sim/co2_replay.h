@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef CO2_REPLAY_H
+#define CO2_REPLAY_H
+
+/**
+ * @brief Replays the recorded CO2 trace through every filter and checks the results.
+ *
+ * Logs cycles per sample, residual noise and step lag of each filter, and the step lag of
+ * the attribute value behind the CO2 report gate. The selected filter is restored and the
+ * CO2 gate reset afterwards.
+ *
+ * @return 0 if every filter reduced the noise of the raw readings within the lag bound,
+ *	   negative error code otherwise.
+ */
+int co2_replay_run(void);
+
+#endif /* CO2_REPLAY_H */
@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Checks the conversions of src/sample_conv.c bit for bit against the sensor_value_to_double()
+ * based conversions they replaced, over pseudo-random readings in the SCD4x range, every whole
+ * number of centi units in the attribute range and every whole CO2 ppm value.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "conv_bench.h"
+#include "sample_conv.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
+
+#define INPUTS CONFIG_AIR_MONITOR_SIM_CONV_BENCH_INPUTS
+
+/* Timed loops cycle through this many precomputed readings, a power of two */
+#define RING_SIZE 1024
+
+/* SCD4x datasheet chapter 3.5.2: output range in micro units */
+#define TEMPERATURE_MIN_MICRO (-45LL * 1000000)
+#define TEMPERATURE_MAX_MICRO (130LL * 1000000)
+#define HUMIDITY_MAX_MICRO (100LL * 1000000)
+#define CO2_MAX_PPM 40000
+
+/* ZCL 4.4.2.2.1.1: temperature attribute range in centi degrees */
+#define TEMPERATURE_MIN_CENTI (-27315)
+#define TEMPERATURE_MAX_CENTI INT16_MAX
+
+enum conv_channel {
+	CONV_TEMPERATURE,
+	CONV_HUMIDITY,
+	/* Whole ppm as the SCD4x reports them */
+	CONV_CO2,
+	/* Fractional ppm, long division path */
+	CONV_CO2_MICRO,
+	CONV_CHANNEL_COUNT,
+};
+
+struct conv_result {
+	uint32_t inputs;
+	uint32_t mismatches;
+	uint64_t cycles;
+	uint64_t cycles_ref;
+};
+
+static const char *const channel_names[] = {
+	[CONV_TEMPERATURE] = "temperature",
+	[CONV_HUMIDITY] = "humidity",
+	[CONV_CO2] = "co2",
+	[CONV_CO2_MICRO] = "co2 micro",
+};
+
+static struct sensor_value ring[CONV_CHANNEL_COUNT][RING_SIZE];
+static uint32_t rand_state;
+
+/* Keeps the timed conversions from being optimized out */
+static volatile uint32_t sink;
+
+static uint64_t bench_cycles(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	return __builtin_ia32_rdtsc();
+#else
+	return k_cycle_get_32();
+#endif
+}
+
+/* xorshift32, the same readings on every run */
+static uint32_t bench_rand(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+
+	return rand_state;
+}
+
+static struct sensor_value bench_value(int64_t min_micro, int64_t max_micro)
+{
+	uint64_t r = ((uint64_t)bench_rand() << 32) | bench_rand();
+	int64_t micro = min_micro + (int64_t)(r % (uint64_t)(max_micro - min_micro + 1));
+
+	/* Truncating division gives val2 the sign of val1 */
+	return (struct sensor_value){
+		.val1 = (int32_t)(micro / 1000000),
+		.val2 = (int32_t)(micro % 1000000),
+	};
+}
+
+static struct sensor_value channel_value(enum conv_channel channel)
+{
+	switch (channel) {
+	case CONV_TEMPERATURE:
+		return bench_value(TEMPERATURE_MIN_MICRO, TEMPERATURE_MAX_MICRO);
+	case CONV_HUMIDITY:
+		return bench_value(0, HUMIDITY_MAX_MICRO);
+	case CONV_CO2:
+		return (struct sensor_value){ .val1 = bench_rand() % (CO2_MAX_PPM + 1) };
+	default:
+		return bench_value(0, CO2_MAX_PPM * 1000000LL);
+	}
+}
+
+/* Conversions before src/sample_conv.c */
+static int16_t ref_temperature(const struct sensor_value *val)
+{
+	return (int16_t)(sensor_value_to_double(val) * 100);
+}
+
+static uint16_t ref_humidity(const struct sensor_value *val)
+{
+	return (uint16_t)(int16_t)(sensor_value_to_double(val) * 100);
+}
+
+static uint32_t ref_co2_fraction(const struct sensor_value *val)
+{
+	float fraction = sensor_value_to_double(val) * 0.000001;
+	uint32_t bits;
+
+	memcpy(&bits, &fraction, sizeof(bits));
+
+	return bits;
+}
+
+static uint32_t conv(enum conv_channel channel, const struct sensor_value *val)
+{
+	switch (channel) {
+	case CONV_TEMPERATURE:
+		return (uint16_t)sample_conv_temperature(val);
+	case CONV_HUMIDITY:
+		return sample_conv_humidity(val);
+	default:
+		return sample_conv_co2_fraction(val);
+	}
+}
+
+static uint32_t conv_ref(enum conv_channel channel, const struct sensor_value *val)
+{
+	switch (channel) {
+	case CONV_TEMPERATURE:
+		return (uint16_t)ref_temperature(val);
+	case CONV_HUMIDITY:
+		return ref_humidity(val);
+	default:
+		return ref_co2_fraction(val);
+	}
+}
+
+static void compare(enum conv_channel channel, const struct sensor_value *val,
+		    struct conv_result *result)
+{
+	result->inputs++;
+
+	if (conv(channel, val) != conv_ref(channel, val)) {
+		result->mismatches++;
+	}
+}
+
+/* Times INPUTS conversions with fn over the precomputed readings */
+#define TIME_LOOP(fn, type, ring_, total)                                                          \
+	do {                                                                                       \
+		uint64_t start = bench_cycles();                                                   \
+		type acc = 0;                                                                      \
+		for (uint32_t i = 0; i < INPUTS; i++) {                                            \
+			acc ^= fn(&(ring_)[i & (RING_SIZE - 1)]);                                  \
+		}                                                                                  \
+		total = bench_cycles() - start;                                                    \
+		sink = acc;                                                                        \
+	} while (0)
+
+static void time_channel(enum conv_channel channel, struct conv_result *result)
+{
+	const struct sensor_value *values = ring[channel];
+
+	switch (channel) {
+	case CONV_TEMPERATURE:
+		TIME_LOOP(sample_conv_temperature, int16_t, values, result->cycles);
+		TIME_LOOP(ref_temperature, int16_t, values, result->cycles_ref);
+		break;
+	case CONV_HUMIDITY:
+		TIME_LOOP(sample_conv_humidity, uint16_t, values, result->cycles);
+		TIME_LOOP(ref_humidity, uint16_t, values, result->cycles_ref);
+		break;
+	default:
+		/* Both CO2 channels */
+		TIME_LOOP(sample_conv_co2_fraction, uint32_t, values, result->cycles);
+		TIME_LOOP(ref_co2_fraction, uint32_t, values, result->cycles_ref);
+		break;
+	}
+}
+
+int conv_bench_run(void)
+{
+	struct conv_result results[CONV_CHANNEL_COUNT] = {0};
+	int err = 0;
+
+	rand_state = 0x2545f491;
+
+	for (int channel = 0; channel < CONV_CHANNEL_COUNT; channel++) {
+		for (uint32_t i = 0; i < INPUTS; i++) {
+			struct sensor_value val = channel_value(channel);
+
+			if (i < RING_SIZE) {
+				ring[channel][i] = val;
+			}
+
+			compare(channel, &val, &results[channel]);
+		}
+
+		time_channel(channel, &results[channel]);
+	}
+
+	/* Every whole number of centi units, where the double product may truncate low */
+	for (int32_t centi = TEMPERATURE_MIN_CENTI; centi <= TEMPERATURE_MAX_CENTI; centi++) {
+		struct sensor_value val = {
+			.val1 = centi / 100,
+			.val2 = (centi % 100) * 10000,
+		};
+
+		compare(CONV_TEMPERATURE, &val, &results[CONV_TEMPERATURE]);
+
+		if (centi >= 0 && centi <= HUMIDITY_MAX_MICRO / 10000) {
+			compare(CONV_HUMIDITY, &val, &results[CONV_HUMIDITY]);
+		}
+	}
+
+	/* Every reading the SCD4x can report */
+	for (int32_t ppm = 0; ppm <= UINT16_MAX; ppm++) {
+		struct sensor_value val = {.val1 = ppm};
+
+		compare(CONV_CO2, &val, &results[CONV_CO2]);
+	}
+
+	for (int channel = 0; channel < CONV_CHANNEL_COUNT; channel++) {
+		const struct conv_result *r = &results[channel];
+
+		LOG_INF("Conversion %-11s: %u / %u mismatches, %u cycles vs %u with double",
+			channel_names[channel], r->mismatches, r->inputs,
+			(uint32_t)(r->cycles / INPUTS), (uint32_t)(r->cycles_ref / INPUTS));
+
+		if (r->mismatches) {
+			LOG_ERR("Conversion %s: differs from the double path", channel_names[channel]);
+			err = -EIO;
+		}
+	}
+
+	return err;
+}
@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef CONV_BENCH_H
+#define CONV_BENCH_H
+
+/**
+ * @brief Compares the sample conversions with the double arithmetic they replaced.
+ *
+ * Logs mismatches and cycles per conversion of both paths for temperature, humidity, whole
+ * and fractional CO2 ppm. Cycles are read from the host time stamp counter, simulated time
+ * does not advance while code runs.
+ *
+ * @return 0 if every conversion is bit-identical to the double path, negative error code
+ *	   otherwise.
+ */
+int conv_bench_run(void);
+
+#endif /* CONV_BENCH_H */
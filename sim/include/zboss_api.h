@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Minimal stand-in for the ZBOSS API used by the sample path on native_sim.
+ * Only the attribute store is provided, the Zigbee stack itself is not available.
+ */
+
+#ifndef ZBOSS_API_H
+#define ZBOSS_API_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef uint8_t zb_uint8_t;
+typedef int8_t zb_int8_t;
+typedef uint16_t zb_uint16_t;
+typedef int16_t zb_int16_t;
+typedef uint32_t zb_uint32_t;
+typedef int32_t zb_int32_t;
+typedef uint8_t zb_bool_t;
+typedef uint8_t zb_bufid_t;
+typedef int32_t zb_ret_t;
+
+#define ZB_FALSE ((zb_bool_t)0)
+#define ZB_TRUE ((zb_bool_t)1)
+
+#define RET_OK 0
+#define RET_ERROR (-1)
+
+typedef enum zb_zcl_status_e {
+	ZB_ZCL_STATUS_SUCCESS = 0x00,
+	ZB_ZCL_STATUS_FAIL = 0x01,
+	ZB_ZCL_STATUS_UNSUP_ATTRIB = 0x86,
+	ZB_ZCL_STATUS_INVALID_VALUE = 0x87,
+} zb_zcl_status_t;
+
+#define ZB_ZCL_CLUSTER_SERVER_ROLE 0x01
+#define ZB_ZCL_CLUSTER_CLIENT_ROLE 0x02
+
+#define ZB_ZCL_CLUSTER_ID_BASIC 0x0000
+#define ZB_ZCL_CLUSTER_ID_IDENTIFY 0x0003
+#define ZB_ZCL_CLUSTER_ID_TEMP_MEASUREMENT 0x0402
+#define ZB_ZCL_CLUSTER_ID_REL_HUMIDITY_MEASUREMENT 0x0405
+
+#define ZB_ZCL_ATTR_TEMP_MEASUREMENT_VALUE_ID 0x0000
+#define ZB_ZCL_ATTR_REL_HUMIDITY_MEASUREMENT_VALUE_ID 0x0000
+
+zb_zcl_status_t zb_zcl_set_attr_val(zb_uint8_t ep, zb_uint16_t cluster_id, zb_uint8_t cluster_role,
+				    zb_uint16_t attr_id, zb_uint8_t *value,
+				    zb_bool_t check_access);
+
+#endif /* ZBOSS_API_H */
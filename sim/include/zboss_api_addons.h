@@ -0,0 +1,12 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ZBOSS_API_ADDONS_H
+#define ZBOSS_API_ADDONS_H 1
+
+#include <zboss_api.h>
+
+#endif /* ZBOSS_API_ADDONS_H */
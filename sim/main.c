@@ -0,0 +1,433 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Host entry point for native_sim: drives the sample path against the emulated SCD4x
+ * and the stand-in attribute store, and reports its latency and throughput.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/logging/log.h>
+
+#include "air_quality_monitor.h"
+#include "bus_pm.h"
+#include "co2_replay.h"
+#include "conv_bench.h"
+#include "flash_log.h"
+#include "history.h"
+#include "profiler.h"
+#include "report_gate.h"
+#include "rgb_led.h"
+#include "sample_pipeline.h"
+#include "sampling_scheduler.h"
+#include "sensor_thread.h"
+#include "sleep_cycle.h"
+#include "emul_scd4x.h"
+#include "emul_ws2812.h"
+#include "zb_sim.h"
+
+LOG_MODULE_REGISTER(app, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
+
+/* Air quality check period */
+#define AIR_QUALITY_CHECK_PERIOD_MSEC (1000 * CONFIG_AIR_MONITOR_CHECK_PERIOD_SECONDS)
+
+/* A live run fails when no sample arrives for this long */
+#if defined(CONFIG_AIR_MONITOR_SLEEP_CYCLE)
+#define SAMPLE_TIMEOUT_MSEC (2 * SLEEP_CYCLE_PERIOD_MSEC)
+#else
+#define SAMPLE_TIMEOUT_MSEC (4 * AIR_QUALITY_CHECK_PERIOD_MSEC)
+#endif
+
+/* Same as ZB_ZCL_AIR_MONITOR_HISTORY_FRAME_DATA_MAX */
+#define HISTORY_FRAME_SIZE 64
+
+static const struct emul *scd4x_emul = EMUL_DT_GET(DT_COMPAT_GET_ANY_STATUS_OKAY(sensirion_scd4x));
+static const struct emul *ws2812_emul = EMUL_DT_GET(DT_ALIAS(led_strip));
+
+#if defined(CONFIG_AIR_MONITOR_SIM_TRACE_REPLAY)
+static const uint8_t sensor_trace[] = {
+#include "sensor_trace.bin.inc"
+};
+#endif
+
+struct latency_stats {
+	uint32_t min;
+	uint32_t max;
+	uint64_t total;
+	uint32_t count;
+	uint32_t errors;
+};
+
+/* Hand-over from the sensor thread, stands in for zigbee_schedule_callback() */
+static K_SEM_DEFINE(sample_sem, 0, CONFIG_AIR_MONITOR_SAMPLE_QUEUE_SIZE);
+static uint32_t sample_ready_cycles;
+
+static void sample_ready(void)
+{
+	sample_ready_cycles = k_cycle_get_32();
+	k_sem_give(&sample_sem);
+}
+
+/* Runs the samples queued by the sensor thread through the pipeline of src/main.c */
+static uint32_t check_air_quality(struct latency_stats *stats)
+{
+	struct air_quality_sample sample;
+	uint32_t processed = 0;
+	int err;
+
+	while (sample_pipeline_next(&sample, &err)) {
+		if (err) {
+			stats->errors++;
+		}
+
+		processed++;
+	}
+
+	return processed;
+}
+
+/* Deterministic CO2 ramp crossing all LED thresholds, with slow T and RH drift.
+ * Channels hold their value for several checks, as they do in a quiet room.
+ */
+static void set_next_measurement(uint32_t i)
+{
+	uint16_t co2 = 400 + ((i / 2) * 37) % 1800;
+	int32_t temperature = 20000 + (int32_t)((i / 4) % 500) * 10;
+	uint32_t humidity = 40000 + ((i / 8) % 200) * 50;
+
+	emul_scd4x_set_measurement(scd4x_emul, co2, temperature, humidity);
+}
+
+static void log_profile(void)
+{
+	struct profiler_stats stats;
+	uint32_t hz = profiler_cycles_per_sec();
+
+	for (int stage = 0; stage < PROFILER_STAGE_COUNT; stage++) {
+		profiler_get(stage, &stats);
+
+		if (stats.count) {
+			LOG_INF("Stage %-12s [cycles @ %u Hz]: count %u min %u avg %u max %u",
+				profiler_stage_name(stage), hz, stats.count, stats.min,
+				(uint32_t)(stats.total / stats.count), stats.max);
+		}
+	}
+}
+
+/* Downloads the whole history in frames as the Air Monitor History cluster does */
+static void log_history(void)
+{
+	struct history_record records[HISTORY_FRAME_SIZE / 2];
+	uint8_t frame[HISTORY_FRAME_SIZE];
+	struct history_info info;
+	uint32_t start_s = 0;
+	uint32_t frames = 0;
+	uint32_t decoded = 0;
+	size_t len;
+
+	history_get_info(&info);
+
+	while (start_s != HISTORY_END) {
+		history_read(start_s, frame, sizeof(frame), &len, &start_s);
+
+		int count = history_decode(frame, len, records, ARRAY_SIZE(records));
+
+		if (count < 0) {
+			LOG_ERR("Malformed history frame");
+			return;
+		}
+
+		decoded += count;
+		frames++;
+	}
+
+	LOG_INF("History: %u samples from %u s to %u s in %u bytes, %u frames, %u decoded",
+		info.count, info.oldest_s, info.newest_s, info.used, frames, decoded);
+}
+
+/* Flushes the flash log, recovers it as after a reboot and replays it */
+static void log_flash_log(void)
+{
+	struct history_record records[HISTORY_FRAME_SIZE / 2];
+	struct flash_log_pos pos = { 0 };
+	uint8_t frame[HISTORY_FRAME_SIZE];
+	struct flash_log_stats log;
+	uint32_t frames = 0;
+	uint32_t decoded = 0;
+	uint16_t boot;
+	size_t len;
+
+	flash_log_flush();
+	flash_log_get_stats(&log);
+
+	LOG_INF("Flash log: boot %u, %u chunks written, %u pages erased, %u batches dropped",
+		log.boot, log.writes, log.erases, log.dropped);
+
+	if (flash_log_init()) {
+		LOG_ERR("Flash log recovery failed");
+		return;
+	}
+
+	while (pos.boot != FLASH_LOG_END) {
+		flash_log_read(&pos, frame, sizeof(frame), &len, &boot, K_FOREVER);
+
+		int count = history_decode(frame, len, records, ARRAY_SIZE(records));
+
+		if (count < 0) {
+			LOG_ERR("Malformed flash log frame");
+			return;
+		}
+
+		decoded += count;
+		frames++;
+	}
+
+	flash_log_get_stats(&log);
+
+	LOG_INF("Flash log recovered: %u of %u pages in %u reads, %u samples in %u frames",
+		log.pages_used, log.pages, log.recovery_reads, decoded, frames);
+}
+
+static void log_report_gate(void)
+{
+	static const char *const names[] = { "temperature", "humidity", "co2" };
+	struct report_gate_config config;
+	struct report_gate_stats stats;
+
+	for (int channel = 0; channel < REPORT_GATE_COUNT; channel++) {
+		report_gate_get(channel, &config, &stats);
+
+		LOG_INF("Report gate %-11s: %u sent, %u suppressed", names[channel], stats.sent,
+			stats.suppressed);
+	}
+}
+
+static void log_led(void)
+{
+	struct rgb_led_stats led;
+
+	rgb_led_get_stats(&led);
+
+	LOG_INF("LED: %u frames in %u animation wakeups, %u unchanged, bus on %u us per frame",
+		led.frames, led.wakeups, led.unchanged,
+		led.frames ? (uint32_t)(k_cyc_to_us_floor64(led.bus_on_cycles) / led.frames) : 0);
+}
+
+/* pwm0 drives the status LEDs of the Zigbee build only */
+/* Fails if the residency is inconsistent with the transactions seen by the emulators */
+static int log_bus_pm(void)
+{
+	const uint32_t transactions[] = {
+		[BUS_PM_SENSOR_I2C] = emul_scd4x_read_count(scd4x_emul),
+		[BUS_PM_LED_SPI] = emul_ws2812_frame_count(ws2812_emul),
+	};
+	int64_t uptime_ms = k_uptime_get();
+	int err = 0;
+
+	for (int id = 0; id < BUS_PM_STATUS_PWM; id++) {
+		struct bus_pm_residency r;
+
+		bus_pm_get_residency(id, &r);
+
+		uint64_t total = r.active_ms + r.suspended_ms;
+		/* Active share in 0.01 % */
+		uint32_t share = total ? (uint32_t)(r.active_ms * 10000 / total) : 0;
+
+		LOG_INF("%s: active %llu ms (%u.%02u %%), suspended %llu ms, %u resumes",
+			bus_pm_name(id), r.active_ms, share / 100, share % 100, r.suspended_ms,
+			r.resumes);
+
+		/* Every transaction is bracketed and the accounting starts after boot */
+		if ((transactions[id] && !r.resumes) || r.errors || total > uptime_ms) {
+			LOG_ERR("%s: residency inconsistent with %u transactions in %lld ms",
+				bus_pm_name(id), transactions[id], uptime_ms);
+			err = -EIO;
+		}
+	}
+
+	return err;
+}
+
+#if defined(CONFIG_AIR_MONITOR_SLEEP_CYCLE)
+
+/* Charge of one sleep cycle from the simulated time spent in every state and the currents of
+ * the energy model. Charges are in nC (uA * ms), energy in uJ.
+ */
+static void log_energy(uint32_t reports, int64_t elapsed_ms)
+{
+	struct sampling_scheduler_status sched;
+	struct bus_pm_residency i2c;
+	uint64_t sensor_ms = 0;
+
+	if (!reports) {
+		return;
+	}
+
+	sampling_scheduler_get_status(&sched);
+	bus_pm_get_residency(BUS_PM_SENSOR_I2C, &i2c);
+
+	for (int i = 0; i < SAMPLING_MODE_COUNT; i++) {
+		sensor_ms += (uint64_t)sched.residency_s[i] * MSEC_PER_SEC;
+	}
+
+	uint64_t period_ms = elapsed_ms / reports;
+	uint64_t measure_ms = MIN(sensor_ms * sched.duty_cycle / 10000 / reports, period_ms);
+	/* Every report is preceded by one parent poll */
+	uint64_t frames_x100 = 100ULL * (zb_sim_attr_write_count() + reports) / reports;
+
+	uint64_t sleep_nc = CONFIG_AIR_MONITOR_SIM_ENERGY_SLEEP_UA * period_ms;
+	uint64_t measure_nc = CONFIG_AIR_MONITOR_SIM_ENERGY_SENSOR_MEASURE_UA * measure_ms;
+	uint64_t idle_nc = CONFIG_AIR_MONITOR_SIM_ENERGY_SENSOR_IDLE_UA * (period_ms - measure_ms);
+	uint64_t bus_nc = CONFIG_AIR_MONITOR_SIM_ENERGY_BUS_UA * i2c.active_ms / reports;
+	uint64_t radio_nc = CONFIG_AIR_MONITOR_SIM_ENERGY_FRAME_UC * 10 * frames_x100;
+	uint64_t total_nc = sleep_nc + measure_nc + idle_nc + bus_nc + radio_nc;
+
+	LOG_INF("Sleep cycle: %u reports every %llu s, sensor measuring %llu ms, bus active "
+		"%llu ms, %llu.%02llu frames per report", reports, period_ms / MSEC_PER_SEC,
+		measure_ms, i2c.active_ms / reports, frames_x100 / 100, frames_x100 % 100);
+	LOG_INF("Charge per report [uC]: sleep %llu, sensor measuring %llu, sensor idle %llu, "
+		"bus %llu, radio %llu", sleep_nc / 1000, measure_nc / 1000, idle_nc / 1000,
+		bus_nc / 1000, radio_nc / 1000);
+	LOG_INF("Energy per report: %llu uJ at %u mV, average current %llu uA",
+		total_nc * CONFIG_AIR_MONITOR_SIM_ENERGY_SUPPLY_MV / 1000000,
+		CONFIG_AIR_MONITOR_SIM_ENERGY_SUPPLY_MV, total_nc / period_ms);
+}
+
+#endif /* CONFIG_AIR_MONITOR_SLEEP_CYCLE */
+
+static void latency_stats_add(struct latency_stats *stats, uint32_t cycles)
+{
+	stats->min = MIN(stats->min, cycles);
+	stats->max = MAX(stats->max, cycles);
+	stats->total += cycles;
+	stats->count++;
+}
+
+int main(void)
+{
+	struct latency_stats stats = { .min = UINT32_MAX };
+	uint32_t samples = 0;
+	bool replay = false;
+	int err;
+
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_PROFILING)) {
+		profiler_init();
+	}
+
+	rgb_led_init();
+	air_quality_monitor_init();
+
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_FLASH_LOG) && flash_log_init()) {
+		LOG_ERR("Cannot init flash log");
+	}
+
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_SLEEP_CYCLE)) {
+		struct air_quality_sample retained;
+
+		/* Cold start on the host, restores the state of a soft reset on the target */
+		sleep_cycle_init(&retained);
+	}
+
+	/* LED indication is disabled after boot, same as pressing the user button */
+	rgb_led_toggle_state();
+
+	err = conv_bench_run();
+	if (err) {
+		return err;
+	}
+
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_CO2_FILTER)) {
+		err = co2_replay_run();
+		if (err) {
+			return err;
+		}
+	}
+
+#if defined(CONFIG_AIR_MONITOR_SIM_TRACE_REPLAY)
+	if (emul_scd4x_set_trace(scd4x_emul, sensor_trace, sizeof(sensor_trace))) {
+		LOG_ERR("Invalid sensor trace %s", CONFIG_AIR_MONITOR_SIM_TRACE_FILE);
+		return -EINVAL;
+	}
+
+	replay = true;
+	LOG_INF("Replaying sensor trace %s, %zu bytes", CONFIG_AIR_MONITOR_SIM_TRACE_FILE,
+		sizeof(sensor_trace));
+#else
+	LOG_INF("Running %d air quality checks", CONFIG_AIR_MONITOR_SIM_ITERATIONS);
+	set_next_measurement(0);
+#endif
+
+	/* Start of the live run, the energy model averages over it */
+	int64_t started __maybe_unused = k_uptime_get();
+
+	sensor_thread_start(K_MSEC(AIR_QUALITY_CHECK_PERIOD_MSEC), sample_ready);
+
+	while (replay ? !emul_scd4x_trace_done(scd4x_emul) || k_sem_count_get(&sample_sem)
+		      : samples < CONFIG_AIR_MONITOR_SIM_ITERATIONS) {
+		if (k_sem_take(&sample_sem, K_MSEC(SAMPLE_TIMEOUT_MSEC))) {
+			if (replay) {
+				/* Recorded gaps, e.g. single shot measurements, are replayed too */
+				continue;
+			}
+
+			LOG_ERR("No sample from the sensor thread");
+			return -ETIMEDOUT;
+		}
+
+		uint32_t processed = check_air_quality(&stats);
+
+		/* Hand-over plus commit latency, measured from the moment the sample was queued */
+		latency_stats_add(&stats, k_cycle_get_32() - sample_ready_cycles);
+		samples += processed;
+
+		if (!replay) {
+			set_next_measurement(samples);
+		}
+	}
+
+	uint32_t avg = stats.count ? (uint32_t)(stats.total / stats.count) : 0;
+	struct sensor_thread_stats fetch;
+
+	sensor_thread_get_stats(&fetch);
+
+	LOG_INF("Samples: %u published, %u commit errors, %u sensor reads", samples, stats.errors,
+		emul_scd4x_read_count(scd4x_emul));
+	LOG_INF("Publish latency [us]: min %u avg %u max %u", k_cyc_to_us_floor32(stats.min),
+		k_cyc_to_us_floor32(avg), k_cyc_to_us_floor32(stats.max));
+	LOG_INF("Throughput: %u samples/s", avg ? (uint32_t)(sys_clock_hw_cycles_per_sec() / avg) : 0);
+	LOG_INF("Fetches: %u, %u late, %u data ready polls without data", fetch.fetches,
+		fetch.late, fetch.not_ready);
+	LOG_INF("Fetch lag [ms]: last %u avg %u max %u", fetch.lag_ms, fetch.lag_avg_ms,
+		fetch.lag_max_ms);
+	LOG_INF("Attribute writes: %u, LED frames: %u", zb_sim_attr_write_count(),
+		emul_ws2812_frame_count(ws2812_emul));
+	log_led();
+
+	err = log_bus_pm();
+	if (err) {
+		return err;
+	}
+
+#if defined(CONFIG_AIR_MONITOR_SLEEP_CYCLE)
+	log_energy(samples, k_uptime_get() - started);
+#endif
+
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_REPORT_GATE)) {
+		log_report_gate();
+	}
+
+	log_history();
+
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_FLASH_LOG)) {
+		log_flash_log();
+	}
+
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_PROFILING)) {
+		log_profile();
+	}
+
+	return 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zboss_api.h>
+
+#include "air_quality_monitor.h"
+#include "zb_sim.h"
+
+LOG_MODULE_REGISTER(zb_sim, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
+
+/* Largest attribute type used by the application (single precision float) */
+#define ZB_SIM_ATTR_MAX_SIZE 4
+
+struct zb_sim_attr {
+	uint16_t cluster_id;
+	uint16_t attr_id;
+	uint8_t size;
+	uint8_t value[ZB_SIM_ATTR_MAX_SIZE];
+};
+
+/* Server attributes written by the sample path */
+static struct zb_sim_attr attrs[] = {
+	{ ZB_ZCL_CLUSTER_ID_TEMP_MEASUREMENT, ZB_ZCL_ATTR_TEMP_MEASUREMENT_VALUE_ID, 2 },
+	{ ZB_ZCL_CLUSTER_ID_REL_HUMIDITY_MEASUREMENT,
+	  ZB_ZCL_ATTR_REL_HUMIDITY_MEASUREMENT_VALUE_ID, 2 },
+	{ ZB_ZCL_CLUSTER_ID_CONCENTRATION_MEASUREMENT,
+	  ZB_ZCL_ATTR_CONCENTRATION_MEASUREMENT_VALUE_ID, 4 },
+};
+
+static uint32_t write_count;
+
+static struct zb_sim_attr *zb_sim_attr_find(uint16_t cluster_id, uint16_t attr_id)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(attrs); i++) {
+		if (attrs[i].cluster_id == cluster_id && attrs[i].attr_id == attr_id) {
+			return &attrs[i];
+		}
+	}
+
+	return NULL;
+}
+
+zb_zcl_status_t zb_zcl_set_attr_val(zb_uint8_t ep, zb_uint16_t cluster_id, zb_uint8_t cluster_role,
+				    zb_uint16_t attr_id, zb_uint8_t *value,
+				    zb_bool_t check_access)
+{
+	struct zb_sim_attr *attr = zb_sim_attr_find(cluster_id, attr_id);
+
+	ARG_UNUSED(check_access);
+
+	if (ep != AIR_QUALITY_MONITOR_ENDPOINT_NB || cluster_role != ZB_ZCL_CLUSTER_SERVER_ROLE ||
+	    attr == NULL) {
+		LOG_ERR("Unknown attribute 0x%04x/0x%04x", cluster_id, attr_id);
+		return ZB_ZCL_STATUS_UNSUP_ATTRIB;
+	}
+
+	memcpy(attr->value, value, attr->size);
+	write_count++;
+
+	return ZB_ZCL_STATUS_SUCCESS;
+}
+
+uint32_t zb_sim_attr_write_count(void)
+{
+	return write_count;
+}
+
+size_t zb_sim_attr_get(uint16_t cluster_id, uint16_t attr_id, void *value, size_t len)
+{
+	struct zb_sim_attr *attr = zb_sim_attr_find(cluster_id, attr_id);
+
+	if (attr == NULL || len < attr->size) {
+		return 0;
+	}
+
+	memcpy(value, attr->value, attr->size);
+
+	return attr->size;
+}
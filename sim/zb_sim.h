@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ZB_SIM_H
+#define ZB_SIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Returns the number of attribute writes accepted by the stand-in attribute store.
+ */
+uint32_t zb_sim_attr_write_count(void);
+
+/**
+ * @brief Copies the current value of an attribute from the stand-in attribute store.
+ *
+ * @param cluster_id  ZCL cluster identifier.
+ * @param attr_id     ZCL attribute identifier.
+ * @param value       Destination buffer.
+ * @param len         Size of the destination buffer.
+ *
+ * @return Number of bytes copied, 0 if the attribute is not stored.
+ */
+size_t zb_sim_attr_get(uint16_t cluster_id, uint16_t attr_id, void *value, size_t len);
+
+#endif /* ZB_SIM_H */
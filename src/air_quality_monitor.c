@@ -5,12 +5,20 @@
  * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
  */
 
+#include <string.h>
+#include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/device.h>
 #include <zephyr/drivers/sensor.h>
-#include <sensor/scd4x/scd4x.h>
 
 #include "air_quality_monitor.h"
+#include "bus_pm.h"
+#include "co2_filter.h"
+#include "profiler.h"
+#include "report_gate.h"
+#include "sample_conv.h"
+#include "sleep_cycle.h"
+#include "trace_recorder.h"
 
 LOG_MODULE_DECLARE(app, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
 
@@ -18,127 +26,249 @@ LOG_MODULE_DECLARE(app, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
 #error "No sensirion,scd4x compatible node found in the device tree"
 #endif
 
+#define SCD4X_NODE DT_COMPAT_GET_ANY_STATUS_OKAY(sensirion_scd4x)
+
 static const struct device *scd = DEVICE_DT_GET_ANY(sensirion_scd4x);
+static const struct device *scd_bus = DEVICE_DT_GET(DT_BUS(SCD4X_NODE));
 
 void air_quality_monitor_init(void)
 {
 	if (scd == NULL || device_is_ready(scd) == false) {
 		LOG_ERR("Failed to initialize SCD4X device");
 	}
+
+	/* Sensor was set up by its driver, the I2C master is resumed per transaction from now */
+	bus_pm_init(BUS_PM_SENSOR_I2C, scd_bus);
 }
 
-int air_quality_monitor_check_air_quality(void)
+/* Last encoded values written to the attribute store */
+static struct air_quality_sample committed;
+
+int air_quality_monitor_sample(struct air_quality_sample *sample)
 {
-	int err = sensor_sample_fetch(scd);
+	struct sensor_value sensor_value;
+	struct sensor_trace_frame frame = { 0 };
 
-	if (err) {
-		LOG_ERR("Failed to fetch sample from SCD4X device");
+	PROFILER_START(fetch);
+	int err = bus_pm_get(BUS_PM_SENSOR_I2C);
+
+	if (!err) {
+		err = sensor_sample_fetch(scd);
+		bus_pm_put(BUS_PM_SENSOR_I2C);
 	}
 
-	return err;
-}
+	PROFILER_STOP(PROFILER_STAGE_FETCH, fetch);
 
-int air_quality_monitor_update_temperature(void)
-{
-	int err = 0;
+	memset(sample, 0, sizeof(*sample));
 
-	double measured_temperature = 0.0;
-	int16_t temperature_attribute = 0;
+	if (err) {
+		LOG_ERR("Failed to fetch sample from SCD4X device");
+		return err;
+	}
 
-	struct sensor_value sensor_value;
+	sample->timestamp = k_uptime_get();
+
+	/* Convert measured values to attribute values, as specified in ZCL */
+	PROFILER_START(temperature_get);
 	err = sensor_channel_get(scd, SENSOR_CHAN_AMBIENT_TEMP, &sensor_value);
-	measured_temperature = sensor_value_to_double(&sensor_value);
+	PROFILER_STOP(PROFILER_STAGE_CHANNEL_GET, temperature_get);
 	if (err) {
 		LOG_ERR("Failed to get sensor temperature: %d", err);
 	} else {
-		/* Convert measured value to attribute value, as specified in ZCL */
-		temperature_attribute =
-			(int16_t)(measured_temperature *
-				  ZCL_TEMPERATURE_MEASUREMENT_MEASURED_VALUE_MULTIPLIER);
-		LOG_INF("Attribute T:%10d", temperature_attribute);
-
-		/* Set ZCL attribute */
-		zb_zcl_status_t status = zb_zcl_set_attr_val(
-			AIR_QUALITY_MONITOR_ENDPOINT_NB, ZB_ZCL_CLUSTER_ID_TEMP_MEASUREMENT,
-			ZB_ZCL_CLUSTER_SERVER_ROLE, ZB_ZCL_ATTR_TEMP_MEASUREMENT_VALUE_ID,
-			(zb_uint8_t *)&temperature_attribute, ZB_FALSE);
-		if (status) {
-			LOG_ERR("Failed to set ZCL attribute: %d", status);
-			err = status;
+		PROFILER_START(temperature_conv);
+		sample->temperature = sample_conv_temperature(&sensor_value);
+		PROFILER_STOP(PROFILER_STAGE_CONVERSION, temperature_conv);
+		if (IS_ENABLED(CONFIG_AIR_MONITOR_TRACE_RECORDER)) {
+			frame.temperature_ticks = sample_conv_temperature_ticks(&sensor_value);
 		}
+		sample->valid |= AIR_QUALITY_SAMPLE_TEMPERATURE;
 	}
 
-	return err;
+	PROFILER_START(humidity_get);
+	err = sensor_channel_get(scd, SENSOR_CHAN_HUMIDITY, &sensor_value);
+	PROFILER_STOP(PROFILER_STAGE_CHANNEL_GET, humidity_get);
+	if (err) {
+		LOG_ERR("Failed to get sensor humidity: %d", err);
+	} else {
+		PROFILER_START(humidity_conv);
+		sample->humidity = sample_conv_humidity(&sensor_value);
+		PROFILER_STOP(PROFILER_STAGE_CONVERSION, humidity_conv);
+		if (IS_ENABLED(CONFIG_AIR_MONITOR_TRACE_RECORDER)) {
+			frame.humidity_ticks = sample_conv_humidity_ticks(&sensor_value);
+		}
+		sample->valid |= AIR_QUALITY_SAMPLE_HUMIDITY;
+	}
+
+	PROFILER_START(co2_get);
+	err = sensor_channel_get(scd, SENSOR_CHAN_CO2, &sensor_value);
+	PROFILER_STOP(PROFILER_STAGE_CHANNEL_GET, co2_get);
+	if (err) {
+		LOG_ERR("Failed to get sensor co2: %d", err);
+	} else {
+		PROFILER_START(co2_conv);
+		sample->co2_ppm = sample_conv_co2_ppm(&sensor_value);
+		sample->co2_attr = sample_conv_co2_fraction(&sensor_value);
+		PROFILER_STOP(PROFILER_STAGE_CONVERSION, co2_conv);
+		sample->valid |= AIR_QUALITY_SAMPLE_CO2;
+	}
+
+	/* Raw readings are recorded before any filtering */
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_TRACE_RECORDER) &&
+	    sample->valid == (AIR_QUALITY_SAMPLE_TEMPERATURE | AIR_QUALITY_SAMPLE_HUMIDITY |
+			      AIR_QUALITY_SAMPLE_CO2)) {
+		frame.co2_ppm = sample->co2_ppm;
+		trace_recorder_add(sample->timestamp, &frame);
+	}
+
+	/* Everything downstream (attributes, LED, history) sees the filtered concentration */
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_CO2_FILTER) && (sample->valid & AIR_QUALITY_SAMPLE_CO2)) {
+		PROFILER_START(co2_filter);
+		uint16_t filtered = co2_filter_update(sample->co2_ppm, sample->timestamp);
+
+		if (filtered != sample->co2_ppm) {
+			sample->co2_ppm = filtered;
+			sample->co2_attr =
+				sample_conv_co2_fraction(&(struct sensor_value){ .val1 = filtered });
+		}
+		PROFILER_STOP(PROFILER_STAGE_FILTER, co2_filter);
+	}
+
+	PROFILER_START(sample_log);
+	LOG_INF("Sample T:%d H:%u CO2:%u ppm", sample->temperature, sample->humidity,
+		sample->co2_ppm);
+	PROFILER_STOP(PROFILER_STAGE_SAMPLE_LOG, sample_log);
+
+	return sample->valid ? 0 : -ENODATA;
 }
 
-int air_quality_monitor_update_humidity(void)
+static int air_quality_monitor_set_attr(zb_uint16_t cluster_id, zb_uint16_t attr_id, void *value)
 {
-	int err = 0;
+	PROFILER_START(set_attr);
+	zb_zcl_status_t status = zb_zcl_set_attr_val(AIR_QUALITY_MONITOR_ENDPOINT_NB, cluster_id,
+						     ZB_ZCL_CLUSTER_SERVER_ROLE, attr_id,
+						     (zb_uint8_t *)value, ZB_FALSE);
 
-	double measured_humidity = 0.0;
-	int16_t humidity_attribute = 0;
+	PROFILER_STOP(PROFILER_STAGE_SET_ATTR, set_attr);
 
-	struct sensor_value sensor_value;
-	err = sensor_channel_get(scd, SENSOR_CHAN_HUMIDITY, &sensor_value);
-	measured_humidity = sensor_value_to_double(&sensor_value);
-	if (err) {
-		LOG_ERR("Failed to get sensor humidity: %d", err);
-	} else {
-		/* Convert measured value to attribute value, as specified in ZCL */
-		humidity_attribute = (int16_t)(measured_humidity *
-					       ZCL_HUMIDITY_MEASUREMENT_MEASURED_VALUE_MULTIPLIER);
-		LOG_INF("Attribute H:%10d", humidity_attribute);
-
-		zb_zcl_status_t status = zb_zcl_set_attr_val(
-			AIR_QUALITY_MONITOR_ENDPOINT_NB, ZB_ZCL_CLUSTER_ID_REL_HUMIDITY_MEASUREMENT,
-			ZB_ZCL_CLUSTER_SERVER_ROLE, ZB_ZCL_ATTR_REL_HUMIDITY_MEASUREMENT_VALUE_ID,
-			(zb_uint8_t *)&humidity_attribute, ZB_FALSE);
-		if (status) {
-			LOG_ERR("Failed to set ZCL attribute: %d", status);
-			err = status;
+	if (status) {
+		LOG_ERR("Failed to set ZCL attribute 0x%04x/0x%04x: %d", cluster_id, attr_id,
+			status);
+	}
+
+	return status;
+}
+
+static bool air_quality_monitor_changed(const struct air_quality_sample *sample, uint8_t channel,
+					bool changed)
+{
+	/* Channel is written if it is valid and either never written or different */
+	return (sample->valid & channel) && (!(committed.valid & channel) || changed);
+}
+
+/* Replaces channel values by their smoothed values, channels held back by the report gate
+ * are marked invalid so that they are not written
+ */
+static void air_quality_monitor_gate(struct air_quality_sample *values)
+{
+	int32_t output;
+
+	if (values->valid & AIR_QUALITY_SAMPLE_TEMPERATURE) {
+		if (report_gate_filter(REPORT_GATE_TEMPERATURE, values->temperature,
+				       values->timestamp, &output)) {
+			values->temperature = (int16_t)output;
+		} else {
+			values->valid &= ~AIR_QUALITY_SAMPLE_TEMPERATURE;
 		}
 	}
 
-	return err;
+	if (values->valid & AIR_QUALITY_SAMPLE_HUMIDITY) {
+		if (report_gate_filter(REPORT_GATE_HUMIDITY, values->humidity, values->timestamp,
+				       &output)) {
+			values->humidity = (uint16_t)output;
+		} else {
+			values->valid &= ~AIR_QUALITY_SAMPLE_HUMIDITY;
+		}
+	}
+
+	if (values->valid & AIR_QUALITY_SAMPLE_CO2) {
+		if (!report_gate_filter(REPORT_GATE_CO2, values->co2_ppm, values->timestamp,
+					&output)) {
+			values->valid &= ~AIR_QUALITY_SAMPLE_CO2;
+		} else if (output != values->co2_ppm) {
+			values->co2_ppm = (uint16_t)output;
+			values->co2_attr =
+				sample_conv_co2_fraction(&(struct sensor_value){ .val1 = output });
+		}
+	}
 }
 
-int air_quality_monitor_update_co2(double* co2)
+int air_quality_monitor_commit(const struct air_quality_sample *sample)
 {
 	int err = 0;
+	int status;
+	/* Attribute values are passed by pointer, keep a writable copy */
+	struct air_quality_sample values = *sample;
+
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_REPORT_GATE)) {
+		air_quality_monitor_gate(&values);
+	}
 
-	double measured_co2 = 0.0;
-	float co2_attribute = 0.0;
+	if (air_quality_monitor_changed(&values, AIR_QUALITY_SAMPLE_TEMPERATURE,
+					values.temperature != committed.temperature)) {
+		status = air_quality_monitor_set_attr(ZB_ZCL_CLUSTER_ID_TEMP_MEASUREMENT,
+						      ZB_ZCL_ATTR_TEMP_MEASUREMENT_VALUE_ID,
+						      &values.temperature);
+		if (status) {
+			err = status;
+		} else {
+			committed.temperature = values.temperature;
+			committed.valid |= AIR_QUALITY_SAMPLE_TEMPERATURE;
+			if (IS_ENABLED(CONFIG_AIR_MONITOR_REPORT_GATE)) {
+				report_gate_sent(REPORT_GATE_TEMPERATURE, values.temperature,
+						 values.timestamp);
+			}
+		}
+	}
 
-	struct sensor_value sensor_value;
-	err = sensor_channel_get(scd, SENSOR_CHAN_CO2, &sensor_value);
-	measured_co2 = sensor_value_to_double(&sensor_value);
-	*co2 = measured_co2;
-	if (err) {
-		LOG_ERR("Failed to get sensor co2: %d", err);
-	} else {
-		/* Convert measured value to attribute value, as specified in ZCL */
-		co2_attribute = measured_co2 * ZCL_CO2_MEASUREMENT_MEASURED_VALUE_MULTIPLIER;
-		LOG_INF("Attribute CO2:%10f", co2_attribute);
-
-		zb_zcl_status_t status =
-			zb_zcl_set_attr_val(AIR_QUALITY_MONITOR_ENDPOINT_NB,
-					    ZB_ZCL_CLUSTER_ID_CONCENTRATION_MEASUREMENT,
-					    ZB_ZCL_CLUSTER_SERVER_ROLE,
-					    ZB_ZCL_ATTR_CONCENTRATION_MEASUREMENT_VALUE_ID,
-					    (zb_uint8_t *)&co2_attribute, ZB_FALSE);
+	if (air_quality_monitor_changed(&values, AIR_QUALITY_SAMPLE_HUMIDITY,
+					values.humidity != committed.humidity)) {
+		status = air_quality_monitor_set_attr(ZB_ZCL_CLUSTER_ID_REL_HUMIDITY_MEASUREMENT,
+						      ZB_ZCL_ATTR_REL_HUMIDITY_MEASUREMENT_VALUE_ID,
+						      &values.humidity);
 		if (status) {
-			LOG_ERR("Failed to set ZCL attribute: %d", status);
 			err = status;
+		} else {
+			committed.humidity = values.humidity;
+			committed.valid |= AIR_QUALITY_SAMPLE_HUMIDITY;
+			if (IS_ENABLED(CONFIG_AIR_MONITOR_REPORT_GATE)) {
+				report_gate_sent(REPORT_GATE_HUMIDITY, values.humidity,
+						 values.timestamp);
+			}
 		}
 	}
 
-	return err;
-}
+	if (air_quality_monitor_changed(&values, AIR_QUALITY_SAMPLE_CO2,
+					values.co2_attr != committed.co2_attr)) {
+		status = air_quality_monitor_set_attr(ZB_ZCL_CLUSTER_ID_CONCENTRATION_MEASUREMENT,
+						      ZB_ZCL_ATTR_CONCENTRATION_MEASUREMENT_VALUE_ID,
+						      &values.co2_attr);
+		if (status) {
+			err = status;
+		} else {
+			committed.co2_ppm = values.co2_ppm;
+			committed.co2_attr = values.co2_attr;
+			committed.valid |= AIR_QUALITY_SAMPLE_CO2;
+			if (IS_ENABLED(CONFIG_AIR_MONITOR_REPORT_GATE)) {
+				report_gate_sent(REPORT_GATE_CO2, values.co2_ppm, values.timestamp);
+			}
+		}
+	}
 
-int air_quality_monitor_calibrate(void)
-{
-	sensirion_scd4x_stop_periodic_measurement(scd);
-	sensirion_scd4x_calibrate(scd);
-	sensirion_scd4x_start_periodic_measurement(scd);
-	return 0;
+	committed.timestamp = sample->timestamp;
+
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_SLEEP_CYCLE)) {
+		sleep_cycle_store(&committed);
+	}
+
+	return err;
 }
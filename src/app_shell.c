@@ -0,0 +1,11 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/shell/shell.h>
+
+/* Root of the application commands, modules add their subcommands with SHELL_SUBCMD_ADD */
+SHELL_SUBCMD_SET_CREATE(aqm_cmds, (aqm));
+SHELL_CMD_REGISTER(aqm, &aqm_cmds, "Air quality monitor commands", NULL);
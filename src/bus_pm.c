@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/pm/device_runtime.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+
+#include "bus_pm.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
+
+struct bus_pm_entry {
+	const struct device *dev;
+	bool initialized;
+	uint32_t users;
+	/* Uptime ticks of bus_pm_init() and of the last resume */
+	int64_t init_ticks;
+	int64_t resumed_ticks;
+	/* Completed active periods */
+	int64_t active_ticks;
+	uint32_t resumes;
+	uint32_t errors;
+};
+
+static const char *const bus_names[] = {
+	[BUS_PM_SENSOR_I2C] = "i2c0",
+	[BUS_PM_LED_SPI] = "spi1",
+	[BUS_PM_STATUS_PWM] = "pwm0",
+};
+
+BUILD_ASSERT(ARRAY_SIZE(bus_names) == BUS_PM_COUNT, "Missing bus name");
+
+/* Guards the accounting only, the device runtime PM has its own locking */
+static struct k_spinlock lock;
+static struct bus_pm_entry entries[BUS_PM_COUNT];
+
+static bool bus_pm_unsupported(int err)
+{
+	/* Emulated buses have no power management */
+	return err == -ENOTSUP || err == -ENOSYS || err == -EALREADY;
+}
+
+void bus_pm_init(enum bus_pm_id id, const struct device *dev)
+{
+	struct bus_pm_entry *entry = &entries[id];
+
+	if (IS_ENABLED(CONFIG_PM_DEVICE_RUNTIME) && dev) {
+		int err = pm_device_runtime_enable(dev);
+
+		if (err && !bus_pm_unsupported(err)) {
+			LOG_WRN("Cannot enable runtime PM of %s: %d", dev->name, err);
+		}
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	entry->dev = dev;
+	entry->initialized = true;
+	entry->init_ticks = k_uptime_ticks();
+
+	k_spin_unlock(&lock, key);
+}
+
+int bus_pm_get(enum bus_pm_id id)
+{
+	struct bus_pm_entry *entry = &entries[id];
+	int err = 0;
+
+	if (IS_ENABLED(CONFIG_PM_DEVICE_RUNTIME) && entry->dev) {
+		err = pm_device_runtime_get(entry->dev);
+		if (bus_pm_unsupported(err)) {
+			err = 0;
+		}
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	if (err) {
+		entry->errors++;
+	} else if (entry->users++ == 0) {
+		entry->resumed_ticks = k_uptime_ticks();
+		entry->resumes++;
+	}
+
+	k_spin_unlock(&lock, key);
+
+	return err;
+}
+
+void bus_pm_put(enum bus_pm_id id)
+{
+	struct bus_pm_entry *entry = &entries[id];
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	__ASSERT(entry->users > 0, "Unbalanced bus_pm_put() of %s", bus_names[id]);
+
+	if (--entry->users == 0) {
+		entry->active_ticks += k_uptime_ticks() - entry->resumed_ticks;
+	}
+
+	k_spin_unlock(&lock, key);
+
+	if (IS_ENABLED(CONFIG_PM_DEVICE_RUNTIME) && entry->dev) {
+		int err = pm_device_runtime_put(entry->dev);
+
+		if (err && !bus_pm_unsupported(err)) {
+			LOG_WRN("Cannot suspend %s: %d", entry->dev->name, err);
+		}
+	}
+}
+
+void bus_pm_get_residency(enum bus_pm_id id, struct bus_pm_residency *residency)
+{
+	struct bus_pm_entry *entry = &entries[id];
+	int64_t now = k_uptime_ticks();
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	int64_t active = entry->active_ticks;
+	int64_t total = entry->initialized ? now - entry->init_ticks : 0;
+
+	if (entry->users) {
+		/* Count the ongoing transaction up to now */
+		active += now - entry->resumed_ticks;
+	}
+
+	residency->resumes = entry->resumes;
+	residency->errors = entry->errors;
+
+	k_spin_unlock(&lock, key);
+
+	residency->active_ms = k_ticks_to_ms_floor64(active);
+	residency->suspended_ms = k_ticks_to_ms_floor64(total - active);
+}
+
+const char *bus_pm_name(enum bus_pm_id id)
+{
+	return bus_names[id];
+}
+
+#if defined(CONFIG_SHELL)
+
+static int cmd_bus_pm(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	for (int id = 0; id < BUS_PM_COUNT; id++) {
+		struct bus_pm_residency r;
+
+		bus_pm_get_residency(id, &r);
+
+		uint64_t total = r.active_ms + r.suspended_ms;
+		/* Active share in 0.01 % */
+		uint32_t share = total ? (uint32_t)(r.active_ms * 10000 / total) : 0;
+
+		shell_print(sh, "%s: active %llu ms (%u.%02u %%), suspended %llu ms, %u resumes, "
+			    "%u errors", bus_names[id], r.active_ms, share / 100, share % 100,
+			    r.suspended_ms, r.resumes, r.errors);
+	}
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((aqm), pm, NULL, "Peripheral power state residency", cmd_bus_pm, 1, 0);
+
+#endif /* CONFIG_SHELL */
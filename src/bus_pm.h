@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef BUS_PM_H
+#define BUS_PM_H
+
+#include <stdint.h>
+#include <zephyr/device.h>
+
+/* Peripherals resumed only for the duration of their transactions */
+enum bus_pm_id {
+	/* i2c0, SCD4x commands and measurement fetches */
+	BUS_PM_SENSOR_I2C,
+	/* spi1, WS2812 frames */
+	BUS_PM_LED_SPI,
+	/* pwm0, status LED patterns, driven through nrfx */
+	BUS_PM_STATUS_PWM,
+	BUS_PM_COUNT,
+};
+
+struct bus_pm_residency {
+	/* Transitions from suspended to active */
+	uint32_t resumes;
+	/* Resumes refused by the driver */
+	uint32_t errors;
+	/* Time in each state since bus_pm_init() */
+	uint64_t active_ms;
+	uint64_t suspended_ms;
+};
+
+/**
+ * @brief Enables runtime power management of the peripheral and starts its residency
+ *	  accounting, the peripheral is suspended until the first bus_pm_get().
+ *
+ * @param id   Peripheral.
+ * @param dev  Zephyr device, NULL if the caller suspends the peripheral itself.
+ */
+void bus_pm_init(enum bus_pm_id id, const struct device *dev);
+
+/**
+ * @brief Resumes the peripheral for a transaction. Calls nest, each needs a bus_pm_put().
+ *
+ * @note Not callable from ISRs, resuming a device may sleep.
+ *
+ * @return 0 if success, error code if the device could not be resumed.
+ */
+int bus_pm_get(enum bus_pm_id id);
+
+/**
+ * @brief Ends a transaction, the peripheral is suspended after the last one.
+ */
+void bus_pm_put(enum bus_pm_id id);
+
+/**
+ * @brief Returns the residency of the peripheral up to now. Safe to call from any thread.
+ */
+void bus_pm_get_residency(enum bus_pm_id id, struct bus_pm_residency *residency);
+
+/**
+ * @brief Returns the name of the peripheral.
+ */
+const char *bus_pm_name(enum bus_pm_id id);
+
+#endif /* BUS_PM_H */
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+
+#include "calibration.h"
+#include "co2_filter.h"
+#include "sampling_scheduler.h"
+#include "scd4x_cmd.h"
+#include "sensor_thread.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
+
+/* Command execution times, SCD4x datasheet chapter 3.5 */
+#define SCD4X_STOP_PERIODIC_MEASUREMENT_DELAY K_MSEC(500)
+#define SCD4X_FORCED_RECALIBRATION_DELAY K_MSEC(400)
+
+/* First measurement after restart is available one measurement interval later */
+#define SCD4X_FIRST_MEASUREMENT_DELAY K_MSEC(SCD4X_PERIODIC_MEASUREMENT_INTERVAL_MSEC)
+
+static void calibration_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(calibration_work, calibration_work_handler);
+static atomic_t busy;
+static enum calibration_state state;
+static uint16_t reference;
+static int16_t correction;
+static bool failed;
+static calibration_progress_cb_t progress_cb;
+
+static void calibration_set_state(enum calibration_state new_state)
+{
+	state = new_state;
+	LOG_DBG("Calibration state %d", state);
+
+	if (progress_cb) {
+		progress_cb(state);
+	}
+}
+
+static void calibration_next(enum calibration_state next, k_timeout_t delay)
+{
+	calibration_set_state(next);
+	k_work_reschedule_for_queue(sensor_thread_work_q(), &calibration_work, delay);
+}
+
+static void calibration_restart(void)
+{
+	/* Sampling must resume even when recalibration failed */
+	if (scd4x_cmd_send(SCD4X_CMD_START_PERIODIC_MEASUREMENT)) {
+		failed = true;
+	}
+
+	calibration_next(CALIBRATION_STATE_RESTARTING, K_NO_WAIT);
+}
+
+static void calibration_finish(void)
+{
+	calibration_set_state(failed ? CALIBRATION_STATE_FAILED : CALIBRATION_STATE_DONE);
+
+	if (failed) {
+		LOG_ERR("CO2 calibration to %u ppm failed", reference);
+	} else {
+		LOG_INF("CO2 calibration to %u ppm done, correction %d ppm", reference, correction);
+
+		/* Readings jump by the correction, the filter must not average across it */
+		if (IS_ENABLED(CONFIG_AIR_MONITOR_CO2_FILTER)) {
+			co2_filter_reset();
+		}
+	}
+
+	sensor_thread_resume(SCD4X_FIRST_MEASUREMENT_DELAY);
+	atomic_clear(&busy);
+}
+
+static void calibration_work_handler(struct k_work *work)
+{
+	uint16_t result;
+
+	switch (state) {
+	case CALIBRATION_STATE_STOPPING:
+		if (scd4x_cmd_send_arg(SCD4X_CMD_PERFORM_FORCED_RECALIBRATION, reference)) {
+			failed = true;
+			calibration_restart();
+		} else {
+			calibration_next(CALIBRATION_STATE_RECALIBRATING,
+					 SCD4X_FORCED_RECALIBRATION_DELAY);
+		}
+		break;
+	case CALIBRATION_STATE_RECALIBRATING:
+		if (scd4x_cmd_read(&result, 1) || result == SCD4X_FRC_FAILED) {
+			failed = true;
+		} else {
+			correction = (int16_t)(result - SCD4X_FRC_CORRECTION_OFFSET);
+		}
+		calibration_restart();
+		break;
+	case CALIBRATION_STATE_RESTARTING:
+		calibration_finish();
+		break;
+	default:
+		/* Entry: sampling must not touch the sensor until periodic mode is back,
+		 * calibration always leaves the sensor in normal periodic mode.
+		 */
+		sensor_thread_suspend();
+		sampling_scheduler_reset();
+		failed = false;
+		if (scd4x_cmd_send(SCD4X_CMD_STOP_PERIODIC_MEASUREMENT)) {
+			failed = true;
+			calibration_restart();
+		} else {
+			calibration_next(CALIBRATION_STATE_STOPPING,
+					 SCD4X_STOP_PERIODIC_MEASUREMENT_DELAY);
+		}
+		break;
+	}
+}
+
+void calibration_init(calibration_progress_cb_t progress)
+{
+	progress_cb = progress;
+}
+
+int calibration_start(uint16_t reference_ppm)
+{
+	if (!atomic_cas(&busy, 0, 1)) {
+		return -EBUSY;
+	}
+
+	reference = reference_ppm;
+
+	int err = k_work_reschedule_for_queue(sensor_thread_work_q(), &calibration_work, K_NO_WAIT);
+
+	if (err < 0) {
+		/* Sensor thread not started yet */
+		atomic_clear(&busy);
+		return err;
+	}
+
+	return 0;
+}
+
+int16_t calibration_correction(void)
+{
+	return correction;
+}
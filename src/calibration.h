@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <stdint.h>
+
+/* Progress of the forced CO2 recalibration, reported through ZCL as enum8 */
+enum calibration_state {
+	CALIBRATION_STATE_IDLE = 0,
+	/* Periodic measurement stopped, waiting for the sensor to become idle */
+	CALIBRATION_STATE_STOPPING = 1,
+	/* Forced recalibration command issued, waiting for the correction */
+	CALIBRATION_STATE_RECALIBRATING = 2,
+	/* Periodic measurement restarted */
+	CALIBRATION_STATE_RESTARTING = 3,
+	CALIBRATION_STATE_DONE = 4,
+	CALIBRATION_STATE_FAILED = 5,
+};
+
+/**
+ * @brief Callback invoked from the sensor thread on every calibration state change.
+ */
+typedef void (*calibration_progress_cb_t)(enum calibration_state state);
+
+/**
+ * @brief Registers the calibration progress callback.
+ */
+void calibration_init(calibration_progress_cb_t progress);
+
+/**
+ * @brief Starts forced CO2 recalibration on the sensor thread.
+ *
+ * Returns immediately, the sensor is driven by a timer based state machine and sampling
+ * is suspended until the calibration finishes. Safe to call from any thread.
+ *
+ * @param reference_ppm  CO2 concentration the sensor is exposed to.
+ *
+ * @return 0 if success, -EBUSY if a calibration is already running.
+ */
+int calibration_start(uint16_t reference_ppm);
+
+/**
+ * @brief Returns the correction in ppm applied by the last successful calibration.
+ */
+int16_t calibration_correction(void);
+
+#endif /* CALIBRATION_H */
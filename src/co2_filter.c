@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+#include "co2_filter.h"
+
+/* Level is kept in Q8 ppm, trend in Q16 ppm per second and gains in Q8 */
+#define LEVEL_FRAC_BITS 8
+#define TREND_FRAC_BITS 16
+#define GAIN_ONE (1 << 8)
+
+/* Trend is saturated at 1000 ppm per second */
+#define TREND_MAX (1000 << TREND_FRAC_BITS)
+
+/* Kalman gain in Q16 */
+#define KALMAN_FRAC_BITS 16
+
+#define MEDIAN_WINDOW CONFIG_AIR_MONITOR_CO2_FILTER_MEDIAN_WINDOW
+#define MAX_GAP_MSEC (1000 * CONFIG_AIR_MONITOR_CO2_FILTER_MAX_GAP_SECONDS)
+
+BUILD_ASSERT(MEDIAN_WINDOW % 2 == 1 && MEDIAN_WINDOW <= 15,
+	     "Median window must be odd and short enough for insertion sort");
+BUILD_ASSERT(CONFIG_AIR_MONITOR_CO2_FILTER_ALPHA <= GAIN_ONE &&
+		     CONFIG_AIR_MONITOR_CO2_FILTER_BETA <= GAIN_ONE,
+	     "Alpha-beta gains are Q8 fractions");
+
+#if defined(CONFIG_AIR_MONITOR_CO2_FILTER_MEDIAN)
+#define DEFAULT_TYPE CO2_FILTER_MEDIAN
+#elif defined(CONFIG_AIR_MONITOR_CO2_FILTER_ALPHA_BETA)
+#define DEFAULT_TYPE CO2_FILTER_ALPHA_BETA
+#elif defined(CONFIG_AIR_MONITOR_CO2_FILTER_KALMAN)
+#define DEFAULT_TYPE CO2_FILTER_KALMAN
+#else
+#define DEFAULT_TYPE CO2_FILTER_NONE
+#endif
+
+/* Written by any thread, applied by the next update */
+static atomic_t selected = ATOMIC_INIT(DEFAULT_TYPE);
+static atomic_t reset_requested;
+
+/* Owned by the thread calling co2_filter_update() */
+static enum co2_filter_type active = DEFAULT_TYPE;
+static bool primed;
+static int64_t last_timestamp;
+
+static uint16_t window[MEDIAN_WINDOW];
+static uint8_t window_len;
+static uint8_t window_pos;
+
+static int32_t level;
+static int32_t trend;
+static uint32_t variance;
+
+static const char *const filter_names[] = {
+	[CO2_FILTER_NONE] = "none",
+	[CO2_FILTER_MEDIAN] = "median",
+	[CO2_FILTER_ALPHA_BETA] = "alpha-beta",
+	[CO2_FILTER_KALMAN] = "kalman",
+};
+
+BUILD_ASSERT(ARRAY_SIZE(filter_names) == CO2_FILTER_COUNT, "Missing filter name");
+
+static uint16_t level_ppm(void)
+{
+	return (uint16_t)CLAMP((level + (1 << (LEVEL_FRAC_BITS - 1))) >> LEVEL_FRAC_BITS, 0,
+			       UINT16_MAX);
+}
+
+static uint16_t median_update(uint16_t ppm)
+{
+	uint16_t sorted[MEDIAN_WINDOW];
+
+	window[window_pos] = ppm;
+	window_pos = (window_pos + 1) % MEDIAN_WINDOW;
+	window_len = MIN(window_len + 1, MEDIAN_WINDOW);
+
+	/* Until the window fills up the median of the readings so far is taken */
+	for (int i = 0; i < window_len; i++) {
+		uint16_t value = window[i];
+		int j = i;
+
+		for (; j > 0 && sorted[j - 1] > value; j--) {
+			sorted[j] = sorted[j - 1];
+		}
+		sorted[j] = value;
+	}
+
+	return sorted[window_len / 2];
+}
+
+static uint16_t alpha_beta_update(uint16_t ppm, uint32_t dt_ms)
+{
+	/* Readings come at least a second apart, shorter intervals would only amplify noise */
+	dt_ms = MAX(dt_ms, MSEC_PER_SEC);
+
+	/* Predict the level from the trend, then correct both by the residual */
+	int32_t predicted = level + (int32_t)(((int64_t)trend * dt_ms / MSEC_PER_SEC) >>
+					      (TREND_FRAC_BITS - LEVEL_FRAC_BITS));
+	int32_t residual = ((int32_t)ppm << LEVEL_FRAC_BITS) - predicted;
+
+	level = predicted +
+		(int32_t)((int64_t)residual * CONFIG_AIR_MONITOR_CO2_FILTER_ALPHA / GAIN_ONE);
+	trend = (int32_t)CLAMP(trend + (int64_t)residual * CONFIG_AIR_MONITOR_CO2_FILTER_BETA *
+					       MSEC_PER_SEC / dt_ms,
+			       -TREND_MAX, TREND_MAX);
+
+	return level_ppm();
+}
+
+static uint16_t kalman_update(uint16_t ppm, uint32_t dt_ms)
+{
+	/* Variances in Q8 ppm^2, process noise grows with the time since the last reading */
+	uint64_t process = (uint64_t)CONFIG_AIR_MONITOR_CO2_FILTER_KALMAN_PROCESS_NOISE * dt_ms *
+			   (1 << LEVEL_FRAC_BITS) / (60 * MSEC_PER_SEC);
+	uint64_t measurement = (uint64_t)CONFIG_AIR_MONITOR_CO2_FILTER_KALMAN_MEASUREMENT_NOISE
+			       << LEVEL_FRAC_BITS;
+	uint64_t predicted = MIN(variance + process, UINT32_MAX);
+	uint32_t gain = (uint32_t)((predicted << KALMAN_FRAC_BITS) / (predicted + measurement));
+	int32_t residual = ((int32_t)ppm << LEVEL_FRAC_BITS) - level;
+
+	level += (int32_t)(((int64_t)residual * gain) >> KALMAN_FRAC_BITS);
+	variance = (uint32_t)(predicted - ((predicted * gain) >> KALMAN_FRAC_BITS));
+
+	return level_ppm();
+}
+
+static void co2_filter_prime(uint16_t ppm)
+{
+	primed = true;
+	window_len = 0;
+	window_pos = 0;
+	level = (int32_t)ppm << LEVEL_FRAC_BITS;
+	trend = 0;
+	variance = CONFIG_AIR_MONITOR_CO2_FILTER_KALMAN_MEASUREMENT_NOISE << LEVEL_FRAC_BITS;
+}
+
+uint16_t co2_filter_update(uint16_t ppm, int64_t timestamp)
+{
+	enum co2_filter_type type = (enum co2_filter_type)atomic_get(&selected);
+	uint32_t dt_ms = (uint32_t)CLAMP(timestamp - last_timestamp, 1, UINT32_MAX);
+
+	if (type != active || atomic_clear(&reset_requested) || dt_ms > MAX_GAP_MSEC) {
+		active = type;
+		primed = false;
+	}
+
+	last_timestamp = timestamp;
+
+	if (!primed) {
+		co2_filter_prime(ppm);
+
+		if (active != CO2_FILTER_MEDIAN) {
+			return ppm;
+		}
+	}
+
+	switch (active) {
+	case CO2_FILTER_MEDIAN:
+		return median_update(ppm);
+	case CO2_FILTER_ALPHA_BETA:
+		return alpha_beta_update(ppm, dt_ms);
+	case CO2_FILTER_KALMAN:
+		return kalman_update(ppm, dt_ms);
+	default:
+		return ppm;
+	}
+}
+
+void co2_filter_set_type(enum co2_filter_type type)
+{
+	if (type < CO2_FILTER_COUNT) {
+		atomic_set(&selected, type);
+		atomic_set(&reset_requested, 1);
+	}
+}
+
+enum co2_filter_type co2_filter_get_type(void)
+{
+	return (enum co2_filter_type)atomic_get(&selected);
+}
+
+void co2_filter_reset(void)
+{
+	atomic_set(&reset_requested, 1);
+}
+
+void co2_filter_seed(uint16_t ppm, int64_t timestamp)
+{
+	active = (enum co2_filter_type)atomic_get(&selected);
+	atomic_clear(&reset_requested);
+	last_timestamp = timestamp;
+	co2_filter_prime(ppm);
+
+	/* The median window holds the level as its only reading */
+	median_update(ppm);
+}
+
+const char *co2_filter_name(enum co2_filter_type type)
+{
+	return type < CO2_FILTER_COUNT ? filter_names[type] : "?";
+}
+
+#if defined(CONFIG_SHELL)
+
+static int cmd_co2_filter(const struct shell *sh, size_t argc, char **argv)
+{
+	if (argc < 2) {
+		shell_print(sh, "CO2 filter: %s", co2_filter_name(co2_filter_get_type()));
+		return 0;
+	}
+
+	for (int type = 0; type < CO2_FILTER_COUNT; type++) {
+		if (!strcmp(argv[1], filter_names[type])) {
+			co2_filter_set_type(type);
+			return 0;
+		}
+	}
+
+	shell_error(sh, "Unknown filter %s, use none, median, alpha-beta or kalman", argv[1]);
+
+	return -EINVAL;
+}
+
+SHELL_SUBCMD_ADD((aqm), co2filter, NULL,
+		 "Show or select the CO2 filter [none|median|alpha-beta|kalman]", cmd_co2_filter, 1,
+		 1);
+
+#endif /* CONFIG_SHELL */
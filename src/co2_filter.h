@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef CO2_FILTER_H
+#define CO2_FILTER_H
+
+#include <stdint.h>
+
+/* CO2 filter applied to every measurement before it is published */
+enum co2_filter_type {
+	/* Raw sensor readings */
+	CO2_FILTER_NONE,
+	/* Median of the last CONFIG_AIR_MONITOR_CO2_FILTER_MEDIAN_WINDOW readings, rejects spikes */
+	CO2_FILTER_MEDIAN,
+	/* Level and trend tracking with fixed gains, follows ramps without lag */
+	CO2_FILTER_ALPHA_BETA,
+	/* Scalar Kalman filter of a random walk level, gain adapts to the sampling interval */
+	CO2_FILTER_KALMAN,
+	CO2_FILTER_COUNT,
+};
+
+/**
+ * @brief Filters a new CO2 reading.
+ *
+ * Fixed point, no heap. Filter state is reset when readings are further apart than
+ * CONFIG_AIR_MONITOR_CO2_FILTER_MAX_GAP_SECONDS. Must be called from a single thread.
+ *
+ * @param ppm        Raw CO2 concentration.
+ * @param timestamp  Uptime of the reading in milliseconds.
+ *
+ * @return Filtered CO2 concentration in ppm.
+ */
+uint16_t co2_filter_update(uint16_t ppm, int64_t timestamp);
+
+/**
+ * @brief Selects the filter and resets its state.
+ */
+void co2_filter_set_type(enum co2_filter_type type);
+
+/**
+ * @brief Returns the selected filter.
+ */
+enum co2_filter_type co2_filter_get_type(void);
+
+/**
+ * @brief Forgets previous readings, e.g. after the sensor was recalibrated.
+ */
+void co2_filter_reset(void);
+
+/**
+ * @brief Starts the filter from a known level instead of the first reading, e.g. the last
+ *	  level before a reset.
+ *
+ * @note Must be called from the thread calling co2_filter_update() or before it runs.
+ *
+ * @param ppm        Filtered CO2 concentration.
+ * @param timestamp  Uptime the level applies to in milliseconds.
+ */
+void co2_filter_seed(uint16_t ppm, int64_t timestamp);
+
+/**
+ * @brief Returns the filter name.
+ */
+const char *co2_filter_name(enum co2_filter_type type);
+
+#endif /* CO2_FILTER_H */
@@ -0,0 +1,647 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/crc.h>
+
+#include "flash_log.h"
+#include "sensor_thread.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
+
+#if defined(FIXED_PARTITION_ID)
+#define FLASH_LOG_AREA_ID FIXED_PARTITION_ID(storage_partition)
+#else
+#define FLASH_LOG_AREA_ID FLASH_AREA_ID(storage)
+#endif
+
+#define FLASH_LOG_PAGE_MAGIC 0x474F4C41
+#define FLASH_LOG_CHUNK_MAGIC 0xC5A1
+#define FLASH_LOG_ERASED_MAGIC 0xFFFF
+
+/* Limits of the page index and of the flash write granularity */
+#define FLASH_LOG_PAGES_MAX 32
+#define FLASH_LOG_WRITE_BLOCK_MAX 16
+
+#define FLASH_LOG_BATCH_SIZE CONFIG_AIR_MONITOR_FLASH_LOG_BATCH_SIZE
+
+BUILD_ASSERT(FLASH_LOG_BATCH_SIZE >= HISTORY_RECORD_SIZE_MAX && FLASH_LOG_BATCH_SIZE <= UINT8_MAX,
+	     "Batch must hold a record and its size must fit the chunk header");
+
+/* Written at the start of a page together with its first chunk */
+struct flash_log_page_hdr {
+	uint32_t magic;
+	/* Incremented with every page opened, orders the pages */
+	uint32_t seq;
+	/* Boot and uptime of the first chunk */
+	uint16_t boot;
+	uint16_t reserved;
+	uint32_t first_s;
+};
+
+BUILD_ASSERT(sizeof(struct flash_log_page_hdr) == FLASH_LOG_WRITE_BLOCK_MAX,
+	     "Page header must be a multiple of any supported write block");
+
+/* Followed by len bytes of a history frame, padded to the write block */
+struct flash_log_chunk_hdr {
+	uint16_t magic;
+	uint8_t len;
+	uint8_t count;
+	uint16_t boot;
+	/* CRC-16/CCITT of the frame, detects torn writes */
+	uint16_t crc;
+};
+
+/* Page index entry, seq is 0 for pages without chunks */
+struct flash_log_page {
+	uint32_t seq;
+	uint16_t boot;
+	uint32_t first_s;
+};
+
+struct flash_log_batch {
+	uint32_t first_s;
+	uint8_t len;
+	uint8_t count;
+	uint8_t data[FLASH_LOG_BATCH_SIZE];
+};
+
+static void write_work_handler(struct k_work *work);
+
+static K_WORK_DEFINE(write_work, write_work_handler);
+static K_MUTEX_DEFINE(flash_mutex);
+
+/* Owned by flash_mutex */
+static const struct flash_area *fa;
+static size_t page_size;
+static size_t write_block;
+static uint16_t page_count;
+static struct flash_log_page pages[FLASH_LOG_PAGES_MAX];
+static uint16_t cur_page;
+static size_t cur_off;
+static uint32_t next_seq;
+static uint16_t boot;
+static bool ready;
+static uint8_t chunk_buf[sizeof(struct flash_log_chunk_hdr) + FLASH_LOG_BATCH_SIZE +
+			 FLASH_LOG_WRITE_BLOCK_MAX];
+
+/* Batches are filled under batch_lock, the pending one is written under flash_mutex */
+static struct k_spinlock batch_lock;
+static struct flash_log_batch batches[2];
+static struct history_state batch_state;
+static int filling;
+static int pending_idx;
+static atomic_t pending;
+static struct flash_log_stats stats;
+
+static off_t page_offset(uint16_t page)
+{
+	return (off_t)page * page_size;
+}
+
+static size_t chunk_size(uint8_t len)
+{
+	return ROUND_UP(sizeof(struct flash_log_chunk_hdr) + len, write_block);
+}
+
+/**
+ * @brief Reads the chunk header at the page offset, and the frame into chunk_buf if requested.
+ *
+ * @return 0 if success, -ENODATA at the end of written data, -EINVAL if the rest of the page
+ *	   is unusable, -EBADMSG if the frame is damaged, *size is valid for 0 and -EBADMSG.
+ */
+static int flash_log_read_chunk(uint16_t page, size_t off, bool with_frame,
+				struct flash_log_chunk_hdr *hdr, size_t *size)
+{
+	if (off + sizeof(*hdr) > page_size) {
+		return -ENODATA;
+	}
+
+	if (flash_area_read(fa, page_offset(page) + off, hdr, sizeof(*hdr))) {
+		return -EINVAL;
+	}
+
+	if (hdr->magic == FLASH_LOG_ERASED_MAGIC) {
+		return -ENODATA;
+	}
+
+	*size = chunk_size(hdr->len);
+
+	if (hdr->magic != FLASH_LOG_CHUNK_MAGIC || off + *size > page_size) {
+		return -EINVAL;
+	}
+
+	if (!with_frame) {
+		return 0;
+	}
+
+	if (flash_area_read(fa, page_offset(page) + off + sizeof(*hdr), chunk_buf, hdr->len) ||
+	    crc16_ccitt(0xFFFF, chunk_buf, hdr->len) != hdr->crc) {
+		return -EBADMSG;
+	}
+
+	return 0;
+}
+
+static int flash_log_open_page(uint32_t first_s)
+{
+	uint16_t page = (cur_page + 1) % page_count;
+	struct flash_log_page_hdr hdr = {
+		.magic = FLASH_LOG_PAGE_MAGIC,
+		.seq = next_seq++,
+		.boot = boot,
+		.reserved = UINT16_MAX,
+		.first_s = first_s,
+	};
+
+	/* Oldest page is dropped */
+	pages[page].seq = 0;
+	cur_page = page;
+	cur_off = page_size;
+
+	int err = flash_area_erase(fa, page_offset(page), page_size);
+
+	stats.erases++;
+
+	if (!err) {
+		err = flash_area_write(fa, page_offset(page), &hdr, sizeof(hdr));
+	}
+
+	if (err) {
+		LOG_ERR("Failed to open flash log page %u: %d", page, err);
+		return err;
+	}
+
+	pages[page] = (struct flash_log_page){
+		.seq = hdr.seq,
+		.boot = hdr.boot,
+		.first_s = hdr.first_s,
+	};
+	cur_off = sizeof(hdr);
+
+	return 0;
+}
+
+static int flash_log_write_chunk(const struct flash_log_batch *batch)
+{
+	struct flash_log_chunk_hdr hdr = {
+		.magic = FLASH_LOG_CHUNK_MAGIC,
+		.len = batch->len,
+		.count = batch->count,
+		.boot = boot,
+		.crc = crc16_ccitt(0xFFFF, batch->data, batch->len),
+	};
+	size_t size = chunk_size(batch->len);
+	int err;
+
+	if (cur_off + size > page_size) {
+		err = flash_log_open_page(batch->first_s);
+		if (err) {
+			return err;
+		}
+	}
+
+	memset(chunk_buf, 0xFF, size);
+	memcpy(chunk_buf, &hdr, sizeof(hdr));
+	memcpy(&chunk_buf[sizeof(hdr)], batch->data, batch->len);
+
+	err = flash_area_write(fa, page_offset(cur_page) + cur_off, chunk_buf, size);
+
+	/* Space of a failed write may be partially programmed, it is skipped either way */
+	cur_off += size;
+
+	return err;
+}
+
+static void flash_log_write_pending(void)
+{
+	if (!atomic_get(&pending)) {
+		return;
+	}
+
+	int err = ready ? flash_log_write_chunk(&batches[pending_idx]) : -ENODEV;
+	k_spinlock_key_t key = k_spin_lock(&batch_lock);
+
+	if (err) {
+		stats.dropped++;
+	} else {
+		stats.writes++;
+	}
+
+	k_spin_unlock(&batch_lock, key);
+
+	atomic_clear(&pending);
+}
+
+/* Must be called with batch_lock held */
+static bool flash_log_swap(void)
+{
+	if (atomic_get(&pending)) {
+		return false;
+	}
+
+	pending_idx = filling;
+	filling ^= 1;
+	batches[filling].len = 0;
+	batches[filling].count = 0;
+	memset(&batch_state, 0, sizeof(batch_state));
+	atomic_set(&pending, 1);
+
+	return true;
+}
+
+static void write_work_handler(struct k_work *work)
+{
+	k_mutex_lock(&flash_mutex, K_FOREVER);
+	flash_log_write_pending();
+	k_mutex_unlock(&flash_mutex);
+}
+
+int flash_log_init(void)
+{
+	struct flash_pages_info info;
+	const struct device *dev;
+	uint16_t max_boot = 0;
+	int newest = -1;
+	int err;
+
+	err = flash_area_open(FLASH_LOG_AREA_ID, &fa);
+	if (err) {
+		return err;
+	}
+
+	dev = flash_area_get_device(fa);
+	if (!device_is_ready(dev)) {
+		return -ENODEV;
+	}
+
+	err = flash_get_page_info_by_offs(dev, fa->fa_off, &info);
+	if (err) {
+		return err;
+	}
+
+	k_mutex_lock(&flash_mutex, K_FOREVER);
+
+	page_size = info.size;
+	page_count = MIN(fa->fa_size / page_size, FLASH_LOG_PAGES_MAX);
+	write_block = flash_get_write_block_size(dev);
+	stats.recovery_reads = 0;
+
+	if (page_count < 2 || write_block > FLASH_LOG_WRITE_BLOCK_MAX) {
+		k_mutex_unlock(&flash_mutex);
+		return -EINVAL;
+	}
+
+	/* Page index from the page headers */
+	for (uint16_t page = 0; page < page_count; page++) {
+		struct flash_log_page_hdr hdr;
+
+		stats.recovery_reads++;
+		memset(&pages[page], 0, sizeof(pages[page]));
+
+		if (flash_area_read(fa, page_offset(page), &hdr, sizeof(hdr)) ||
+		    hdr.magic != FLASH_LOG_PAGE_MAGIC) {
+			continue;
+		}
+
+		pages[page].seq = hdr.seq;
+		pages[page].boot = hdr.boot;
+		pages[page].first_s = hdr.first_s;
+		max_boot = MAX(max_boot, hdr.boot);
+
+		if (newest < 0 || hdr.seq > pages[newest].seq) {
+			newest = page;
+		}
+	}
+
+	if (newest < 0) {
+		/* Empty log, the first chunk opens page 0 */
+		cur_page = page_count - 1;
+		cur_off = page_size;
+		next_seq = 1;
+	} else {
+		struct flash_log_chunk_hdr hdr;
+		size_t size;
+
+		/* Write position from the chunk headers of the newest page only */
+		cur_page = newest;
+		cur_off = sizeof(struct flash_log_page_hdr);
+		next_seq = pages[newest].seq + 1;
+
+		for (;;) {
+			stats.recovery_reads++;
+			err = flash_log_read_chunk(cur_page, cur_off, false, &hdr, &size);
+			if (err == -ENODATA) {
+				break;
+			}
+			if (err) {
+				/* Damaged header, nothing more is written to this page */
+				cur_off = page_size;
+				break;
+			}
+
+			max_boot = MAX(max_boot, hdr.boot);
+			cur_off += size;
+		}
+	}
+
+	boot = (max_boot + 1 == FLASH_LOG_END) ? 1 : max_boot + 1;
+	stats.boot = boot;
+	stats.pages = page_count;
+	ready = true;
+
+	/* Records batched before a re-initialization belong to the previous boot */
+	k_spinlock_key_t key = k_spin_lock(&batch_lock);
+
+	memset(batches, 0, sizeof(batches));
+	memset(&batch_state, 0, sizeof(batch_state));
+	atomic_clear(&pending);
+
+	k_spin_unlock(&batch_lock, key);
+
+	k_mutex_unlock(&flash_mutex);
+
+	LOG_INF("Flash log boot %u, page %u offset %u, %u recovery reads", boot, cur_page,
+		cur_off, stats.recovery_reads);
+
+	return 0;
+}
+
+void flash_log_add(const struct history_record *record)
+{
+	uint8_t encoded[HISTORY_RECORD_SIZE_MAX];
+	bool submit = false;
+	k_spinlock_key_t key = k_spin_lock(&batch_lock);
+	struct flash_log_batch *batch = &batches[filling];
+	struct history_state state = batch_state;
+	size_t n = history_encode(&state, record, encoded);
+
+	if (batch->len + n > FLASH_LOG_BATCH_SIZE) {
+		if (!flash_log_swap()) {
+			/* Previous batch is still not written, the full one is lost */
+			stats.dropped++;
+			batch->len = 0;
+			batch->count = 0;
+		}
+
+		submit = true;
+		batch = &batches[filling];
+		memset(&state, 0, sizeof(state));
+		n = history_encode(&state, record, encoded);
+	}
+
+	if (!batch->len) {
+		batch->first_s = record->time_s;
+	}
+
+	memcpy(&batch->data[batch->len], encoded, n);
+	batch->len += n;
+	batch->count++;
+	batch_state = state;
+
+	k_spin_unlock(&batch_lock, key);
+
+	if (submit) {
+		k_work_submit_to_queue(sensor_thread_work_q(), &write_work);
+	}
+}
+
+void flash_log_flush(void)
+{
+	bool swapped;
+
+	k_mutex_lock(&flash_mutex, K_FOREVER);
+
+	flash_log_write_pending();
+
+	k_spinlock_key_t key = k_spin_lock(&batch_lock);
+
+	swapped = batches[filling].len && flash_log_swap();
+
+	k_spin_unlock(&batch_lock, key);
+
+	if (swapped) {
+		flash_log_write_pending();
+	}
+
+	k_mutex_unlock(&flash_mutex);
+}
+
+static bool flash_log_page_before(const struct flash_log_page *page,
+				  const struct flash_log_pos *pos)
+{
+	return page->boot < pos->boot || (page->boot == pos->boot && page->first_s <= pos->time_s);
+}
+
+int flash_log_read(struct flash_log_pos *pos, uint8_t *buf, size_t size, size_t *len,
+		   uint16_t *frame_boot, k_timeout_t timeout)
+{
+	struct history_state out_state = { 0 };
+	uint16_t order[FLASH_LOG_PAGES_MAX];
+	uint16_t used = 0;
+	uint16_t start = 0;
+	uint16_t count = 0;
+
+	*len = 0;
+	*frame_boot = pos->boot;
+
+	/* The mutex is held for whole page erases, callers that cannot block give up instead */
+	if (k_mutex_lock(&flash_mutex, timeout)) {
+		return -EBUSY;
+	}
+
+	if (!ready) {
+		goto end;
+	}
+
+	/* Pages are opened round robin, the oldest one follows the current one */
+	for (uint16_t i = 1; i <= page_count; i++) {
+		uint16_t page = (cur_page + i) % page_count;
+
+		if (pages[page].seq) {
+			order[used++] = page;
+		}
+	}
+
+	/* Last page starting at or before the position, the oldest page otherwise */
+	while (start + 1 < used && flash_log_page_before(&pages[order[start + 1]], pos)) {
+		start++;
+	}
+
+	for (uint16_t i = start; i < used; i++) {
+		uint16_t page = order[i];
+		size_t limit = (page == cur_page) ? cur_off : page_size;
+		size_t off = sizeof(struct flash_log_page_hdr);
+
+		while (off < limit) {
+			struct flash_log_chunk_hdr hdr;
+			struct history_state state = { 0 };
+			size_t chunk;
+			size_t frame_pos = 0;
+			int err = flash_log_read_chunk(page, off, true, &hdr, &chunk);
+
+			if (err == -ENODATA || err == -EINVAL) {
+				break;
+			}
+
+			off += chunk;
+
+			if (err || hdr.boot < pos->boot) {
+				continue;
+			}
+
+			if (hdr.boot > pos->boot) {
+				/* A frame holds records of a single boot */
+				pos->boot = hdr.boot;
+				pos->time_s = 0;
+
+				if (count) {
+					goto out;
+				}
+
+				*frame_boot = hdr.boot;
+			}
+
+			while (frame_pos < hdr.len) {
+				struct history_record record;
+				struct history_state encoded_state = out_state;
+				uint8_t encoded[HISTORY_RECORD_SIZE_MAX];
+				int n = history_decode_record(&state, &chunk_buf[frame_pos],
+							      hdr.len - frame_pos, &record);
+
+				if (n < 0) {
+					break;
+				}
+
+				frame_pos += n;
+
+				if (record.time_s < pos->time_s) {
+					continue;
+				}
+
+				size_t m = history_encode(&encoded_state, &record, encoded);
+
+				if (*len + m > size) {
+					pos->time_s = record.time_s;
+					goto out;
+				}
+
+				memcpy(&buf[*len], encoded, m);
+				*len += m;
+				out_state = encoded_state;
+				count++;
+			}
+		}
+	}
+
+end:
+	pos->boot = FLASH_LOG_END;
+out:
+	k_mutex_unlock(&flash_mutex);
+
+	return count;
+}
+
+void flash_log_get_stats(struct flash_log_stats *out)
+{
+	uint16_t pages_used = 0;
+
+	k_mutex_lock(&flash_mutex, K_FOREVER);
+
+	for (uint16_t page = 0; page < page_count; page++) {
+		if (pages[page].seq) {
+			pages_used++;
+		}
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&batch_lock);
+
+	*out = stats;
+	out->pages_used = pages_used;
+	out->page = cur_page;
+	out->offset = cur_off;
+
+	k_spin_unlock(&batch_lock, key);
+
+	k_mutex_unlock(&flash_mutex);
+}
+
+#if defined(CONFIG_SHELL)
+
+static int cmd_flog_show(const struct shell *sh, size_t argc, char **argv)
+{
+	struct flash_log_stats log;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	flash_log_get_stats(&log);
+
+	shell_print(sh, "boot %u, %u of %u pages used, page %u offset %u", log.boot,
+		    log.pages_used, log.pages, log.page, log.offset);
+	shell_print(sh, "%u chunks written, %u pages erased, %u batches dropped", log.writes,
+		    log.erases, log.dropped);
+	shell_print(sh, "recovery scan: %u reads", log.recovery_reads);
+
+	return 0;
+}
+
+static int cmd_flog_flush(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	flash_log_flush();
+	shell_print(sh, "Flash log flushed");
+
+	return 0;
+}
+
+static int cmd_flog_dump(const struct shell *sh, size_t argc, char **argv)
+{
+	struct history_record records[FLASH_LOG_BATCH_SIZE / 2];
+	uint8_t frame[FLASH_LOG_BATCH_SIZE];
+	struct flash_log_pos pos = {
+		.boot = argc > 1 ? strtoul(argv[1], NULL, 10) : 0,
+		.time_s = argc > 2 ? strtoul(argv[2], NULL, 10) : 0,
+	};
+	uint16_t frame_boot;
+	size_t len;
+
+	while (pos.boot != FLASH_LOG_END) {
+		flash_log_read(&pos, frame, sizeof(frame), &len, &frame_boot, K_FOREVER);
+
+		int count = history_decode(frame, len, records, ARRAY_SIZE(records));
+
+		for (int i = 0; i < count; i++) {
+			shell_print(sh, "boot %u %u s: T %d RH %u CO2 %u valid 0x%x", frame_boot,
+				    records[i].time_s, records[i].temperature,
+				    records[i].humidity, records[i].co2_ppm, records[i].valid);
+		}
+	}
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(flog_cmds,
+	SHELL_CMD(show, NULL, "Show flash log state", cmd_flog_show),
+	SHELL_CMD(flush, NULL, "Write batched samples to flash", cmd_flog_flush),
+	SHELL_CMD_ARG(dump, NULL, "Print logged samples [boot [from uptime in s]]", cmd_flog_dump,
+		      1, 2),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_SUBCMD_ADD((aqm), flog, &flog_cmds, "Persistent sample log", cmd_flog_show, 1, 0);
+
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef FLASH_LOG_H
+#define FLASH_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+#include "history.h"
+
+/* Persistent log of history records in the storage partition.
+ *
+ * Records are collected in RAM batches of CONFIG_AIR_MONITOR_FLASH_LOG_BATCH_SIZE bytes and
+ * written as a single chunk, encoded as a history frame, once the batch is full. Pages are
+ * used round robin so every page is erased once per pass over the partition.
+ *
+ * Uptime restarts with every boot, so log positions are (boot, uptime) pairs. The boot
+ * counter is recovered from the log at initialization and incremented.
+ */
+
+/* Boot number of a position past the newest record */
+#define FLASH_LOG_END UINT16_MAX
+
+struct flash_log_pos {
+	uint16_t boot;
+	/* Uptime in seconds */
+	uint32_t time_s;
+};
+
+struct flash_log_stats {
+	/* Current boot number */
+	uint16_t boot;
+	/* Pages holding chunks, out of the pages in the partition */
+	uint16_t pages_used;
+	uint16_t pages;
+	/* Write position */
+	uint16_t page;
+	uint32_t offset;
+	/* Chunks written and pages erased since boot */
+	uint32_t writes;
+	uint32_t erases;
+	/* Batches lost because the previous one was still being written, or a write failed */
+	uint32_t dropped;
+	/* Flash reads done by the recovery scan at initialization */
+	uint32_t recovery_reads;
+};
+
+/**
+ * @brief Scans the partition, recovers the write position and the boot counter.
+ *
+ * Reads every page header and the chunk headers of the newest page only.
+ *
+ * @return 0 if success, error code if failure.
+ */
+int flash_log_init(void);
+
+/**
+ * @brief Appends the record to the current batch. Safe to call from any thread.
+ *
+ * Full batches are written on the sensor thread.
+ */
+void flash_log_add(const struct history_record *record);
+
+/**
+ * @brief Writes all batched records to flash, blocks until done.
+ */
+void flash_log_flush(void);
+
+/**
+ * @brief Encodes logged records from the position into a self contained history frame.
+ *
+ * All records of a frame belong to a single boot. Records not yet flushed are not included.
+ *
+ * @param pos        In: position of the first record to include. Out: position of the
+ *		     following frame, FLASH_LOG_END boot if there are no more records.
+ * @param buf        Output buffer, at least HISTORY_RECORD_SIZE_MAX bytes.
+ * @param size       Size of the output buffer.
+ * @param[out] len   Bytes written.
+ * @param[out] boot  Boot the records in the frame belong to.
+ * @param timeout    How long to wait while the log is being written or a page erased.
+ *
+ * @return Number of records in the frame, can be 0 when the frame moves to the next boot,
+ *	   -EBUSY if the log stayed locked for the timeout, the position is left untouched.
+ */
+int flash_log_read(struct flash_log_pos *pos, uint8_t *buf, size_t size, size_t *len,
+		   uint16_t *boot, k_timeout_t timeout);
+
+/**
+ * @brief Returns log statistics.
+ */
+void flash_log_get_stats(struct flash_log_stats *stats);
+
+#endif /* FLASH_LOG_H */
@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+
+#include "history.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
+
+/* Storage is split into blocks, each starting with a record encoded against zero, so that
+ * the oldest block can be dropped and decoding can start at any block.
+ */
+#define HISTORY_BLOCK_SIZE 64
+#define HISTORY_BLOCK_COUNT (CONFIG_AIR_MONITOR_HISTORY_SIZE / HISTORY_BLOCK_SIZE)
+
+/* Temperature, humidity and CO2, channel i is valid if AIR_QUALITY_SAMPLE_* bit i is set */
+#define HISTORY_CHANNELS 3
+#define HISTORY_VALID_BITS 3
+#define HISTORY_VALID_MASK BIT_MASK(HISTORY_VALID_BITS)
+
+BUILD_ASSERT(ARRAY_SIZE(((struct history_state *)0)->values) == HISTORY_CHANNELS,
+	     "History state must hold every channel");
+BUILD_ASSERT(HISTORY_BLOCK_COUNT >= 2, "History must hold at least two blocks");
+BUILD_ASSERT(AIR_QUALITY_SAMPLE_TEMPERATURE == BIT(0) && AIR_QUALITY_SAMPLE_HUMIDITY == BIT(1) &&
+		     AIR_QUALITY_SAMPLE_CO2 == BIT(2),
+	     "History channel order must follow the sample valid bits");
+
+struct history_block {
+	uint32_t first_s;
+	uint8_t len;
+	uint8_t count;
+	uint8_t data[HISTORY_BLOCK_SIZE];
+};
+
+static struct k_spinlock lock;
+static struct history_block blocks[HISTORY_BLOCK_COUNT];
+static uint16_t oldest;
+static uint16_t used_blocks;
+static struct history_state write_state;
+static uint32_t next_due_s;
+
+static inline uint32_t zigzag_encode(int32_t value)
+{
+	return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t zigzag_decode(uint32_t value)
+{
+	return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static size_t varint_put(uint8_t *out, uint64_t value)
+{
+	size_t n = 0;
+
+	while (value >= 0x80) {
+		out[n++] = (uint8_t)value | 0x80;
+		value >>= 7;
+	}
+	out[n++] = (uint8_t)value;
+
+	return n;
+}
+
+static int varint_get(const uint8_t *in, size_t len, uint64_t *value)
+{
+	*value = 0;
+
+	/* Longest field is 35 bits */
+	for (size_t n = 0; n < MIN(len, 5); n++) {
+		*value |= (uint64_t)(in[n] & 0x7F) << (7 * n);
+
+		if (!(in[n] & 0x80)) {
+			return n + 1;
+		}
+	}
+
+	return -EINVAL;
+}
+
+static struct history_block *history_block(uint16_t i)
+{
+	return &blocks[(oldest + i) % HISTORY_BLOCK_COUNT];
+}
+
+size_t history_encode(struct history_state *state, const struct history_record *record,
+		      uint8_t *out)
+{
+	const int32_t values[HISTORY_CHANNELS] = {
+		record->temperature,
+		record->humidity,
+		record->co2_ppm,
+	};
+	size_t n = varint_put(out, ((uint64_t)(record->time_s - state->time_s)
+				    << HISTORY_VALID_BITS) | record->valid);
+
+	state->time_s = record->time_s;
+
+	for (int i = 0; i < HISTORY_CHANNELS; i++) {
+		if (record->valid & BIT(i)) {
+			n += varint_put(&out[n], zigzag_encode(values[i] - state->values[i]));
+			state->values[i] = values[i];
+		}
+	}
+
+	return n;
+}
+
+int history_decode_record(struct history_state *state, const uint8_t *in, size_t len,
+			  struct history_record *record)
+{
+	uint64_t field;
+	int n = varint_get(in, len, &field);
+	int pos = n;
+
+	if (n < 0) {
+		return n;
+	}
+
+	state->time_s += (uint32_t)(field >> HISTORY_VALID_BITS);
+	record->valid = field & HISTORY_VALID_MASK;
+
+	for (int i = 0; i < HISTORY_CHANNELS; i++) {
+		if (record->valid & BIT(i)) {
+			n = varint_get(&in[pos], len - pos, &field);
+			if (n < 0) {
+				return n;
+			}
+
+			pos += n;
+			state->values[i] += zigzag_decode((uint32_t)field);
+		}
+	}
+
+	record->time_s = state->time_s;
+	record->temperature = (int16_t)state->values[0];
+	record->humidity = (uint16_t)state->values[1];
+	record->co2_ppm = (uint16_t)state->values[2];
+
+	return pos;
+}
+
+static void history_append(const struct history_record *record)
+{
+	struct history_block *block = used_blocks ? history_block(used_blocks - 1) : NULL;
+	struct history_state state = write_state;
+	uint8_t encoded[HISTORY_RECORD_SIZE_MAX];
+	size_t n = history_encode(&state, record, encoded);
+
+	if (!block || block->len + n > HISTORY_BLOCK_SIZE) {
+		if (used_blocks == HISTORY_BLOCK_COUNT) {
+			oldest = (oldest + 1) % HISTORY_BLOCK_COUNT;
+			used_blocks--;
+		}
+
+		block = history_block(used_blocks++);
+		block->first_s = record->time_s;
+		block->len = 0;
+		block->count = 0;
+
+		memset(&state, 0, sizeof(state));
+		n = history_encode(&state, record, encoded);
+	}
+
+	memcpy(&block->data[block->len], encoded, n);
+	block->len += n;
+	block->count++;
+	write_state = state;
+}
+
+bool history_add(const struct air_quality_sample *sample, struct history_record *stored)
+{
+	const uint32_t interval_s = CONFIG_AIR_MONITOR_HISTORY_INTERVAL_SECONDS;
+	struct history_record record = {
+		.time_s = (uint32_t)(sample->timestamp / MSEC_PER_SEC),
+		.temperature = sample->temperature,
+		.humidity = sample->humidity,
+		.co2_ppm = sample->co2_ppm,
+		.valid = sample->valid & HISTORY_VALID_MASK,
+	};
+
+	if (!record.valid) {
+		return false;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	if (used_blocks && record.time_s < next_due_s) {
+		k_spin_unlock(&lock, key);
+		return false;
+	}
+
+	/* Samples stay on the interval grid unless a whole interval was missed */
+	if (used_blocks && record.time_s < next_due_s + interval_s) {
+		next_due_s += interval_s;
+	} else {
+		next_due_s = record.time_s + interval_s;
+	}
+
+	history_append(&record);
+
+	k_spin_unlock(&lock, key);
+
+	if (stored) {
+		*stored = record;
+	}
+
+	return true;
+}
+
+uint16_t history_read(uint32_t start_s, uint8_t *buf, size_t size, size_t *len, uint32_t *next)
+{
+	struct history_state out_state = { 0 };
+	uint16_t first = 0;
+	uint16_t count = 0;
+
+	*len = 0;
+	*next = HISTORY_END;
+
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	/* Last block starting at or before the start time, the oldest block otherwise */
+	while (first + 1 < used_blocks && history_block(first + 1)->first_s <= start_s) {
+		first++;
+	}
+
+	for (uint16_t i = first; i < used_blocks; i++) {
+		struct history_block *block = history_block(i);
+		struct history_state state = { 0 };
+		size_t pos = 0;
+
+		while (pos < block->len) {
+			struct history_record record;
+			struct history_state encoded_state = out_state;
+			uint8_t encoded[HISTORY_RECORD_SIZE_MAX];
+
+			/* Blocks are written by history_encode() only */
+			pos += history_decode_record(&state, &block->data[pos], block->len - pos,
+						     &record);
+
+			if (record.time_s < start_s) {
+				continue;
+			}
+
+			size_t n = history_encode(&encoded_state, &record, encoded);
+
+			if (*len + n > size) {
+				*next = record.time_s;
+				goto out;
+			}
+
+			memcpy(&buf[*len], encoded, n);
+			*len += n;
+			out_state = encoded_state;
+			count++;
+		}
+	}
+
+out:
+	k_spin_unlock(&lock, key);
+
+	return count;
+}
+
+int history_decode(const uint8_t *buf, size_t len, struct history_record *records, size_t max)
+{
+	struct history_state state = { 0 };
+	size_t pos = 0;
+	int count = 0;
+
+	while (pos < len && count < max) {
+		int n = history_decode_record(&state, &buf[pos], len - pos, &records[count]);
+
+		if (n < 0) {
+			return n;
+		}
+
+		pos += n;
+		count++;
+	}
+
+	return count;
+}
+
+void history_get_info(struct history_info *info)
+{
+	memset(info, 0, sizeof(*info));
+
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	if (used_blocks) {
+		info->oldest_s = history_block(0)->first_s;
+		info->newest_s = write_state.time_s;
+	}
+
+	for (uint16_t i = 0; i < used_blocks; i++) {
+		info->count += history_block(i)->count;
+		info->used += history_block(i)->len;
+	}
+
+	k_spin_unlock(&lock, key);
+}
+
+#if defined(CONFIG_SHELL)
+
+static int cmd_history_show(const struct shell *sh, size_t argc, char **argv)
+{
+	struct history_info info;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	history_get_info(&info);
+
+	shell_print(sh, "%u samples from %u s to %u s, %u of %u bytes", info.count, info.oldest_s,
+		    info.newest_s, info.used, HISTORY_BLOCK_COUNT * HISTORY_BLOCK_SIZE);
+
+	return 0;
+}
+
+static int cmd_history_dump(const struct shell *sh, size_t argc, char **argv)
+{
+	struct history_record records[HISTORY_BLOCK_SIZE / 2];
+	uint8_t frame[HISTORY_BLOCK_SIZE];
+	uint32_t start_s = argc > 1 ? strtoul(argv[1], NULL, 10) : 0;
+	size_t len;
+
+	while (start_s != HISTORY_END) {
+		history_read(start_s, frame, sizeof(frame), &len, &start_s);
+
+		int count = history_decode(frame, len, records, ARRAY_SIZE(records));
+
+		for (int i = 0; i < count; i++) {
+			shell_print(sh, "%u s: T %d RH %u CO2 %u valid 0x%x", records[i].time_s,
+				    records[i].temperature, records[i].humidity,
+				    records[i].co2_ppm, records[i].valid);
+		}
+	}
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(history_cmds,
+	SHELL_CMD(show, NULL, "Show history fill state", cmd_history_show),
+	SHELL_CMD_ARG(dump, NULL, "Print samples [from uptime in s]", cmd_history_dump, 1, 1),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_SUBCMD_ADD((aqm), history, &history_cmds, "Sample history", cmd_history_show, 1, 0);
+
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "air_quality_monitor.h"
+
+/* RAM history of samples, one sample kept per CONFIG_AIR_MONITOR_HISTORY_INTERVAL_SECONDS.
+ *
+ * Samples are stored as records delta encoded against the previous record, with every field
+ * a LEB128 varint:
+ *
+ *   (time delta in seconds << 3) | AIR_QUALITY_SAMPLE_* valid channels
+ *   zigzag temperature delta (0.01 degree Celsius)   if valid
+ *   zigzag humidity delta (0.01 %)                    if valid
+ *   zigzag CO2 delta (ppm)                            if valid
+ *
+ * The first record of a frame is encoded against all fields zero, so it holds absolute values
+ * and every frame decodes on its own. Channel deltas are taken against the last record in
+ * which the channel was valid.
+ */
+
+/* Longest encoded record: 35 bit time and valid field, three 17 bit zigzag deltas */
+#define HISTORY_RECORD_SIZE_MAX 14
+
+/* Returned by history_read() when the frame reaches the newest sample */
+#define HISTORY_END UINT32_MAX
+
+/* Decoded history sample */
+struct history_record {
+	/* Uptime in seconds */
+	uint32_t time_s;
+	/* ZCL temperature MeasuredValue (0.01 degree Celsius) */
+	int16_t temperature;
+	/* ZCL relative humidity MeasuredValue (0.01 %) */
+	uint16_t humidity;
+	/* CO2 concentration in ppm */
+	uint16_t co2_ppm;
+	/* AIR_QUALITY_SAMPLE_* channels holding a valid value */
+	uint8_t valid;
+};
+
+/* Encoder and decoder state: time of the previous record and last valid value of every
+ * channel. Zero initialized at the start of every frame.
+ */
+struct history_state {
+	uint32_t time_s;
+	int32_t values[3];
+};
+
+struct history_info {
+	/* Uptime in seconds of the oldest and newest sample, both 0 if empty */
+	uint32_t oldest_s;
+	uint32_t newest_s;
+	uint16_t count;
+	/* Bytes used by the encoded samples */
+	uint16_t used;
+};
+
+/**
+ * @brief Stores the sample if a history interval elapsed since the last one stored.
+ *
+ * Oldest samples are dropped when the history is full. Safe to call from any thread.
+ *
+ * @param sample       Sample to store.
+ * @param[out] record  Stored record, may be NULL.
+ *
+ * @return true if the sample was stored.
+ */
+bool history_add(const struct air_quality_sample *sample, struct history_record *record);
+
+/**
+ * @brief Appends the record to a frame.
+ *
+ * @param state   Frame state, records must come in time order.
+ * @param record  Record to encode.
+ * @param out     Output buffer, at least HISTORY_RECORD_SIZE_MAX bytes.
+ *
+ * @return Number of bytes written.
+ */
+size_t history_encode(struct history_state *state, const struct history_record *record,
+		      uint8_t *out);
+
+/**
+ * @brief Decodes the next record of a frame.
+ *
+ * @return Number of bytes consumed, -EINVAL if the record is malformed.
+ */
+int history_decode_record(struct history_state *state, const uint8_t *in, size_t len,
+			  struct history_record *record);
+
+/**
+ * @brief Encodes samples not older than the start time into a self contained frame.
+ *
+ * @param start_s    Uptime in seconds of the first sample to include.
+ * @param buf        Output buffer, at least HISTORY_RECORD_SIZE_MAX bytes.
+ * @param size       Size of the output buffer.
+ * @param[out] len   Bytes written.
+ * @param[out] next  Start time of the following frame, HISTORY_END if there are no more samples.
+ *
+ * @return Number of samples in the frame.
+ */
+uint16_t history_read(uint32_t start_s, uint8_t *buf, size_t size, size_t *len, uint32_t *next);
+
+/**
+ * @brief Decodes a frame produced by history_read().
+ *
+ * @return Number of decoded records, -EINVAL if the frame is malformed.
+ */
+int history_decode(const uint8_t *buf, size_t len, struct history_record *records, size_t max);
+
+/**
+ * @brief Returns history fill state. Safe to call from any thread.
+ */
+void history_get_info(struct history_info *info);
+
+#endif /* HISTORY_H */
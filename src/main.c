@@ -5,6 +5,7 @@
  * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
  */
 
+#include <string.h>
 #include <zephyr/device.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/drivers/uart.h>
@@ -14,6 +15,7 @@
 #include <zboss_api.h>
 #include <zboss_api_addons.h>
 #include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
 #include <zigbee/zigbee_app_utils.h>
 #include <zigbee/zigbee_error_handler.h>
 #include <dk_buttons_and_leds.h>
@@ -24,7 +26,24 @@
 
 #include "zb_range_extender.h"
 #include "air_quality_monitor.h"
+#include "zb_air_quality_monitor.h"
 #include "rgb_led.h"
+#include "status_led.h"
+#include "sensor_thread.h"
+#include "calibration.h"
+#include "sampling_scheduler.h"
+#include "poll_manager.h"
+#include "profiler.h"
+#include "zb_diag.h"
+#include "history.h"
+#include "flash_log.h"
+#include "offline_manager.h"
+#include "report_gate.h"
+#include "sample_pipeline.h"
+#include "trace_recorder.h"
+#include "power_mode.h"
+#include "sleep_cycle.h"
+#include "mem_watermark.h"
 
 /* Manufacturer name (32 bytes). */
 #define ZIGBEE_MANUF_NAME "DIY"
@@ -37,20 +56,26 @@
  */
 #define ZIGBEE_DATE_CODE "20240722"
 
-/* Air quality check period */
-#define AIR_QUALITY_CHECK_PERIOD_MSEC (1000 * CONFIG_AIR_MONITOR_CHECK_PERIOD_SECONDS)
-
 /* Delay for first air quality check */
 #define AIR_QUALITY_CHECK_INITIAL_DELAY_MSEC (1000 * CONFIG_FIRST_AIR_MONITOR_CHECK_DELAY_SECONDS)
 
-/* Time of LED on state while blinking for identify mode */
-#define IDENTIFY_LED_BLINK_TIME_MSEC 500
+/* Fast poll window after joining, covers key exchange and the coordinator interview */
+#define JOIN_FAST_POLL_TIMEOUT_MSEC 60000
+
+/* Fast poll window extended by every ZCL command received from the coordinator */
+#define CONFIGURE_FAST_POLL_TIMEOUT_MSEC 10000
+
+/* Supply voltage attribute value before the first sample */
+#define SUPPLY_VOLTAGE_UNKNOWN 0xFF
+
+/* Poll control attributes are in quarter seconds */
+#define MSEC_TO_QUARTER_SECONDS(ms) ((ms) / 250)
 
 /* User LED */
-#define STATUS_LED DK_LED2
+#define STATUS_LED STATUS_LED_ID_STATUS
 
 /* LED used for device identification */
-#define IDENTIFY_LED DK_LED1
+#define IDENTIFY_LED STATUS_LED_ID_PAIRING
 
 /* Button used to force SCD4X calibration */
 #define USER_BUTTON DK_BTN2_MSK
@@ -69,6 +94,11 @@ BUILD_ASSERT(DT_NODE_HAS_COMPAT(DT_CHOSEN(zephyr_console), zephyr_cdc_acm_uart),
 	     "Console device is not ACM CDC UART device");
 LOG_MODULE_REGISTER(app, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
 
+BUILD_ASSERT(ZB_ZCL_AIR_MONITOR_DIAGNOSTICS_HISTOGRAM_BINS == ZB_DIAG_HISTOGRAM_BINS,
+	     "Diagnostics histogram attributes must match the collected histograms");
+BUILD_ASSERT(ZB_ZCL_AIR_MONITOR_DIAGNOSTICS_STACK_THREADS == MEM_WATERMARK_THREAD_COUNT,
+	     "Stack watermark attribute must match the sampled threads");
+
 /* Stores all cluster-related attributes */
 static struct zb_device_ctx dev_ctx;
 
@@ -82,6 +112,15 @@ ZB_ZCL_DECLARE_BASIC_ATTRIB_LIST_EXT(basic_attr_list, &dev_ctx.basic_attr.zcl_ve
 				     dev_ctx.basic_attr.location_id, &dev_ctx.basic_attr.ph_env,
 				     dev_ctx.basic_attr.sw_ver);
 
+/* Supply voltage sampled by the SAADC, reported as the battery voltage */
+ZB_ZCL_DECLARE_POWER_CONFIG_ATTRIB_LIST(power_config_attr_list,
+					&dev_ctx.power_config_attrs.battery_voltage,
+					&dev_ctx.power_config_attrs.battery_size,
+					&dev_ctx.power_config_attrs.battery_quantity,
+					&dev_ctx.power_config_attrs.battery_rated_voltage,
+					&dev_ctx.power_config_attrs.battery_alarm_mask,
+					&dev_ctx.power_config_attrs.battery_voltage_min_threshold);
+
 /* Declare attribute list for Identify cluster (client). */
 ZB_ZCL_DECLARE_IDENTIFY_CLIENT_ATTRIB_LIST(identify_client_attr_list);
 
@@ -107,12 +146,53 @@ ZB_ZCL_DECLARE_CONCENTRATION_MEASUREMENT_ATTRIB_LIST(concentration_measurement_a
 						     &dev_ctx.concentration_attrs.max_measure_value,
 						     &dev_ctx.concentration_attrs.tolerance);
 
+ZB_ZCL_DECLARE_POLL_CONTROL_ATTRIB_LIST(poll_control_attr_list,
+					&dev_ctx.poll_control_attrs.checkin_interval,
+					&dev_ctx.poll_control_attrs.long_poll_interval,
+					&dev_ctx.poll_control_attrs.short_poll_interval,
+					&dev_ctx.poll_control_attrs.fast_poll_timeout,
+					&dev_ctx.poll_control_attrs.checkin_interval_min,
+					&dev_ctx.poll_control_attrs.long_poll_interval_min,
+					&dev_ctx.poll_control_attrs.fast_poll_timeout_max);
+
+ZB_ZCL_DECLARE_AIR_MONITOR_CONTROL_ATTRIB_LIST(air_monitor_control_attr_list,
+					       &dev_ctx.control_attrs.calibration_state,
+					       &dev_ctx.control_attrs.calibration_correction,
+					       &dev_ctx.control_attrs.calibration_reference,
+					       &dev_ctx.control_attrs.sampling_mode,
+					       &dev_ctx.control_attrs.duty_cycle,
+					       &dev_ctx.control_attrs.fetch_lag);
+
+ZB_ZCL_DECLARE_AIR_MONITOR_DIAGNOSTICS_ATTRIB_LIST(
+	air_monitor_diagnostics_attr_list, &dev_ctx.diagnostics_attrs.alarm_delay_max,
+	&dev_ctx.diagnostics_attrs.alarm_delay_avg, &dev_ctx.diagnostics_attrs.callback_delay_max,
+	&dev_ctx.diagnostics_attrs.callback_delay_avg, &dev_ctx.diagnostics_attrs.buf_get_failures,
+	&dev_ctx.diagnostics_attrs.schedule_failures, &dev_ctx.diagnostics_attrs.memory_low,
+	&dev_ctx.diagnostics_attrs.memory_low_run_max, &dev_ctx.diagnostics_attrs.oom,
+	dev_ctx.diagnostics_attrs.alarm_histogram, dev_ctx.diagnostics_attrs.callback_histogram,
+	&dev_ctx.diagnostics_attrs.reports_sent, &dev_ctx.diagnostics_attrs.reports_suppressed,
+	dev_ctx.diagnostics_attrs.stack_watermarks, &dev_ctx.diagnostics_attrs.stack_headroom_min,
+	&dev_ctx.diagnostics_attrs.heap_peak, &dev_ctx.diagnostics_attrs.mem_slab_peak);
+
+ZB_ZCL_DECLARE_AIR_MONITOR_HISTORY_ATTRIB_LIST(air_monitor_history_attr_list,
+					       &dev_ctx.history_attrs.oldest_time,
+					       &dev_ctx.history_attrs.newest_time,
+					       &dev_ctx.history_attrs.sample_count,
+					       &dev_ctx.history_attrs.interval,
+					       &dev_ctx.history_attrs.current_time,
+					       &dev_ctx.history_attrs.log_boot);
+
 /* Clusters setup */
 ZB_HA_DECLARE_AIR_QUALITY_MONITOR_CLUSTER_LIST(air_quality_monitor_cluster_list, basic_attr_list,
-					       identify_client_attr_list, identify_server_attr_list,
+					       power_config_attr_list, identify_client_attr_list,
+					       identify_server_attr_list,
 					       temperature_measurement_attr_list,
 					       humidity_measurement_attr_list,
-					       concentration_measurement_attr_list);
+					       concentration_measurement_attr_list,
+					       poll_control_attr_list,
+					       air_monitor_control_attr_list,
+					       air_monitor_diagnostics_attr_list,
+					       air_monitor_history_attr_list);
 
 /* Endpoint setup (single) */
 ZB_HA_DECLARE_AIR_QUALITY_MONITOR_EP(air_quality_monitor_ep, AIR_QUALITY_MONITOR_ENDPOINT_NB,
@@ -145,8 +225,29 @@ static void mandatory_clusters_attr_init(void)
 	ZB_ZCL_SET_STRING_VAL(dev_ctx.basic_attr.date_code, ZIGBEE_DATE_CODE,
 			      ZB_ZCL_STRING_CONST_SIZE(ZIGBEE_DATE_CODE));
 
+	/* Power configuration cluster attributes, the power source is updated from VBUS */
+	dev_ctx.power_config_attrs.battery_voltage = SUPPLY_VOLTAGE_UNKNOWN;
+	dev_ctx.power_config_attrs.battery_size = ZB_ZCL_POWER_CONFIG_BATTERY_SIZE_OTHER;
+	dev_ctx.power_config_attrs.battery_quantity = 1;
+	dev_ctx.power_config_attrs.battery_rated_voltage = 0;
+	dev_ctx.power_config_attrs.battery_alarm_mask = 0;
+	dev_ctx.power_config_attrs.battery_voltage_min_threshold = 0;
+
 	/* Identify cluster attributes */
 	dev_ctx.identify_attr.identify_time = ZB_ZCL_IDENTIFY_IDENTIFY_TIME_DEFAULT_VALUE;
+
+	/* Poll control cluster attributes */
+	dev_ctx.poll_control_attrs.checkin_interval =
+		MSEC_TO_QUARTER_SECONDS(1000 * CONFIG_AIR_MONITOR_CHECKIN_INTERVAL_SECONDS);
+	dev_ctx.poll_control_attrs.long_poll_interval =
+		MSEC_TO_QUARTER_SECONDS(poll_manager_long_poll_interval());
+	dev_ctx.poll_control_attrs.short_poll_interval = 1;
+	dev_ctx.poll_control_attrs.fast_poll_timeout =
+		MSEC_TO_QUARTER_SECONDS(CONFIGURE_FAST_POLL_TIMEOUT_MSEC);
+	dev_ctx.poll_control_attrs.checkin_interval_min = 0;
+	dev_ctx.poll_control_attrs.long_poll_interval_min = 0;
+	dev_ctx.poll_control_attrs.fast_poll_timeout_max =
+		MSEC_TO_QUARTER_SECONDS(JOIN_FAST_POLL_TIMEOUT_MSEC);
 }
 
 static void measurements_clusters_attr_init(void)
@@ -173,18 +274,57 @@ static void measurements_clusters_attr_init(void)
 	dev_ctx.concentration_attrs.max_measure_value =
 		ZB_ZCL_CONCENTRATION_MEASUREMENT_MAX_VALUE_DEFAULT_VALUE; // 10 000ppm
 	dev_ctx.concentration_attrs.tolerance = 0.0001f; // 100 ppm
+
+	/* Air monitor control */
+	dev_ctx.control_attrs.calibration_state = CALIBRATION_STATE_IDLE;
+	dev_ctx.control_attrs.calibration_correction = 0;
+	dev_ctx.control_attrs.calibration_reference = CONFIG_AIR_MONITOR_CALIBRATION_REFERENCE_PPM;
+	dev_ctx.control_attrs.sampling_mode = SAMPLING_MODE_NORMAL;
+	dev_ctx.control_attrs.duty_cycle = 10000;
+	dev_ctx.control_attrs.fetch_lag = 0;
+
+	/* Air monitor diagnostics, histograms start empty with all bins zero */
+	dev_ctx.diagnostics_attrs.alarm_histogram[0] =
+		ZB_ZCL_AIR_MONITOR_DIAGNOSTICS_HISTOGRAM_SIZE - 1;
+	dev_ctx.diagnostics_attrs.callback_histogram[0] =
+		ZB_ZCL_AIR_MONITOR_DIAGNOSTICS_HISTOGRAM_SIZE - 1;
+	dev_ctx.diagnostics_attrs.stack_watermarks[0] =
+		ZB_ZCL_AIR_MONITOR_DIAGNOSTICS_STACK_WATERMARKS_SIZE - 1;
+	dev_ctx.diagnostics_attrs.stack_headroom_min = UINT16_MAX;
+
+	/* Air monitor history, empty until the first sample */
+	dev_ctx.history_attrs.interval = CONFIG_AIR_MONITOR_HISTORY_INTERVAL_SECONDS;
+
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_FLASH_LOG)) {
+		struct flash_log_stats log;
+
+		flash_log_get_stats(&log);
+		dev_ctx.history_attrs.log_boot = log.boot;
+	}
 }
 
-/**@brief Function to toggle the identify LED
- *
- * @param  bufid  Unused parameter, required by ZBOSS scheduler API.
- */
-static void toggle_identify_led(zb_bufid_t bufid)
+/**@brief Starts the measurement attributes from the values published before a reset. */
+static void retained_attrs_init(void)
 {
-	static int blink_status;
+	struct air_quality_sample sample;
+
+	if (!sleep_cycle_init(&sample)) {
+		return;
+	}
+
+	if (sample.valid & AIR_QUALITY_SAMPLE_TEMPERATURE) {
+		dev_ctx.temp_attrs.measure_value = sample.temperature;
+	}
 
-	dk_set_led(IDENTIFY_LED, (++blink_status) % 2);
-	ZB_SCHEDULE_APP_ALARM(toggle_identify_led, bufid, ZB_MILLISECONDS_TO_BEACON_INTERVAL(100));
+	if (sample.valid & AIR_QUALITY_SAMPLE_HUMIDITY) {
+		dev_ctx.humidity_attrs.measure_value = sample.humidity;
+	}
+
+	if (sample.valid & AIR_QUALITY_SAMPLE_CO2) {
+		/* IEEE 754 bit pattern of the attribute value */
+		memcpy(&dev_ctx.concentration_attrs.measure_value, &sample.co2_attr,
+		       sizeof(dev_ctx.concentration_attrs.measure_value));
+	}
 }
 
 /**@brief Function to handle identify notification events on the first endpoint.
@@ -193,17 +333,13 @@ static void toggle_identify_led(zb_bufid_t bufid)
  */
 static void identify_cb(zb_bufid_t bufid)
 {
-	zb_ret_t zb_err_code;
-
 	if (bufid) {
-		/* Schedule a self-scheduling function that will toggle the LED */
-		ZB_SCHEDULE_APP_CALLBACK(toggle_identify_led, bufid);
+		/* Blinking is played by the PWM, nothing runs until identify ends */
+		status_led_set(IDENTIFY_LED, STATUS_LED_BLINK);
+		poll_manager_request(POLL_REASON_IDENTIFY, 0);
 	} else {
-		/* Cancel the toggling function alarm and turn off LED */
-		zb_err_code = ZB_SCHEDULE_APP_ALARM_CANCEL(toggle_identify_led, ZB_ALARM_ANY_PARAM);
-		ZVUNUSED(zb_err_code);
-
-		dk_set_led(IDENTIFY_LED, 0);
+		status_led_set(IDENTIFY_LED, STATUS_LED_OFF);
+		poll_manager_release(POLL_REASON_IDENTIFY);
 	}
 }
 
@@ -215,6 +351,8 @@ static void start_identifying(zb_bufid_t bufid)
 {
 	ZVUNUSED(bufid);
 
+	zb_diag_fired(start_identifying);
+
 	if (ZB_JOINED()) {
 		/* Check if endpoint is in identifying mode,
 		 * if not put desired endpoint in identifying mode.
@@ -240,49 +378,292 @@ static void start_identifying(zb_bufid_t bufid)
 	}
 }
 
+/**@brief Publishes sampling mode, duty cycle and fetch lag if they changed. */
+static void update_sampling_status(void)
+{
+	struct sampling_scheduler_status status;
+	struct sensor_thread_stats stats;
+
+	sampling_scheduler_get_status(&status);
+	sensor_thread_get_stats(&stats);
+
+	if (status.mode != dev_ctx.control_attrs.sampling_mode) {
+		zb_uint8_t sampling_mode = status.mode;
+
+		zb_zcl_set_attr_val(AIR_QUALITY_MONITOR_ENDPOINT_NB,
+				    ZB_ZCL_CLUSTER_ID_AIR_MONITOR_CONTROL, ZB_ZCL_CLUSTER_SERVER_ROLE,
+				    ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_SAMPLING_MODE_ID, &sampling_mode,
+				    ZB_FALSE);
+	}
+
+	if (status.duty_cycle != dev_ctx.control_attrs.duty_cycle) {
+		zb_zcl_set_attr_val(AIR_QUALITY_MONITOR_ENDPOINT_NB,
+				    ZB_ZCL_CLUSTER_ID_AIR_MONITOR_CONTROL, ZB_ZCL_CLUSTER_SERVER_ROLE,
+				    ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_DUTY_CYCLE_ID,
+				    (zb_uint8_t *)&status.duty_cycle, ZB_FALSE);
+	}
+
+	if (stats.lag_avg_ms != dev_ctx.control_attrs.fetch_lag) {
+		zb_zcl_set_attr_val(AIR_QUALITY_MONITOR_ENDPOINT_NB,
+				    ZB_ZCL_CLUSTER_ID_AIR_MONITOR_CONTROL, ZB_ZCL_CLUSTER_SERVER_ROLE,
+				    ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_FETCH_LAG_ID,
+				    (zb_uint8_t *)&stats.lag_avg_ms, ZB_FALSE);
+	}
+}
+
+/**@brief Copies latency statistics into the diagnostics attributes.
+ *
+ * @param  type       Latency type.
+ * @param  max        Maximum delay attribute.
+ * @param  avg        Average delay attribute.
+ * @param  histogram  Histogram attribute, octet string.
+ */
+static void update_latency_attrs(enum zb_diag_latency_type type, zb_uint16_t *max,
+				 zb_uint16_t *avg, zb_uint8_t *histogram)
+{
+	struct zb_diag_latency latency;
+
+	zb_diag_get_latency(type, &latency);
+
+	*max = (zb_uint16_t)MIN(latency.max_ms, UINT16_MAX);
+	*avg = latency.count ? (zb_uint16_t)MIN(latency.total_ms / latency.count, UINT16_MAX) : 0;
+
+	for (int bin = 0; bin < ZB_DIAG_HISTOGRAM_BINS; bin++) {
+		sys_put_le16(MIN(latency.histogram[bin], UINT16_MAX), &histogram[1 + 2 * bin]);
+	}
+}
+
+/**@brief Copies the last stack, heap and memory slab sample into the diagnostics attributes.
+ *
+ * @param  attrs  Diagnostics attributes.
+ */
+static void update_mem_watermark_attrs(struct zb_zcl_air_monitor_diagnostics_attrs_t *attrs)
+{
+	struct mem_watermark_stats stats;
+
+	mem_watermark_get_stats(&stats);
+
+	for (int i = 0; i < MEM_WATERMARK_THREAD_COUNT; i++) {
+		sys_put_le16(MIN(stats.stacks[i].used_max, UINT16_MAX),
+			     &attrs->stack_watermarks[1 + 4 * i]);
+		sys_put_le16(MIN(stats.stacks[i].size, UINT16_MAX),
+			     &attrs->stack_watermarks[3 + 4 * i]);
+	}
+
+	attrs->stack_headroom_min = MIN(mem_watermark_headroom_min(&stats), UINT16_MAX);
+	attrs->heap_peak = stats.heap_peak;
+	attrs->mem_slab_peak = stats.slab_peak_pct;
+}
+
+/**@brief Refreshes the diagnostics attributes.
+ *
+ * None of them is reportable, so the attribute storage is updated directly.
+ */
+static void update_diagnostics(void)
+{
+	struct zb_zcl_air_monitor_diagnostics_attrs_t *attrs = &dev_ctx.diagnostics_attrs;
+	struct zb_diag_counters counters;
+
+	update_latency_attrs(ZB_DIAG_LATENCY_ALARM, &attrs->alarm_delay_max,
+			     &attrs->alarm_delay_avg, attrs->alarm_histogram);
+	update_latency_attrs(ZB_DIAG_LATENCY_CALLBACK, &attrs->callback_delay_max,
+			     &attrs->callback_delay_avg, attrs->callback_histogram);
+
+	zb_diag_get_counters(&counters);
+
+	attrs->buf_get_failures = counters.buf_get_failures;
+	attrs->schedule_failures = counters.schedule_failures;
+	attrs->memory_low = counters.memory_low;
+	attrs->memory_low_run_max = counters.memory_low_streak_max;
+	attrs->oom = counters.oom;
+
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_REPORT_GATE)) {
+		struct report_gate_config config;
+		struct report_gate_stats stats;
+
+		attrs->reports_sent = 0;
+		attrs->reports_suppressed = 0;
+
+		for (int channel = 0; channel < REPORT_GATE_COUNT; channel++) {
+			report_gate_get(channel, &config, &stats);
+			attrs->reports_sent += stats.sent;
+			attrs->reports_suppressed += stats.suppressed;
+		}
+	}
+
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_MEM_WATERMARK)) {
+		update_mem_watermark_attrs(attrs);
+	}
+}
+
+/**@brief Refreshes the history attributes.
+ *
+ * None of them is reportable, so the attribute storage is updated directly.
+ *
+ * @param  current_time  Uptime of the newest sample in seconds.
+ */
+static void update_history_attrs(zb_uint32_t current_time)
+{
+	struct history_info info;
+
+	history_get_info(&info);
+
+	dev_ctx.history_attrs.oldest_time = info.oldest_s;
+	dev_ctx.history_attrs.newest_time = info.newest_s;
+	dev_ctx.history_attrs.sample_count = info.count;
+	dev_ctx.history_attrs.current_time = current_time;
+}
+
+/**@brief Publishes samples queued by the sensor thread.
+ *
+ * @param  bufid  Unused parameter, required by ZBOSS scheduler API.
+ */
 static void check_air_quality(zb_bufid_t bufid)
 {
 	ZVUNUSED(bufid);
 
-	int err = air_quality_monitor_check_air_quality();
+	struct air_quality_sample sample;
+	int err;
 
-	if (err) {
-		LOG_ERR("Failed to check air quality: %d", err);
+	zb_diag_fired(check_air_quality);
+
+	while (sample_pipeline_next(&sample, &err)) {
+		update_history_attrs((zb_uint32_t)(sample.timestamp / MSEC_PER_SEC));
+	}
+
+	update_sampling_status();
+	update_diagnostics();
+}
+
+/**@brief Hands queued samples over to the ZBOSS thread, called from the sensor thread. */
+static void sample_ready(void)
+{
+	zb_ret_t zb_err = zb_diag_schedule_callback(check_air_quality, 0);
+
+	if (zb_err) {
+		LOG_ERR("Failed to schedule app callback: %d", zb_err);
+	}
+}
+
+/**@brief Publishes calibration progress, runs on the ZBOSS thread.
+ *
+ * @param  state  New calibration state.
+ */
+static void calibration_progress(zb_uint8_t state)
+{
+	zb_int16_t correction = calibration_correction();
+
+	zb_diag_fired(calibration_progress);
+
+	zb_zcl_set_attr_val(AIR_QUALITY_MONITOR_ENDPOINT_NB, ZB_ZCL_CLUSTER_ID_AIR_MONITOR_CONTROL,
+			    ZB_ZCL_CLUSTER_SERVER_ROLE,
+			    ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_CALIBRATION_STATE_ID, &state, ZB_FALSE);
+
+	if (state == CALIBRATION_STATE_DONE) {
+		zb_zcl_set_attr_val(AIR_QUALITY_MONITOR_ENDPOINT_NB,
+				    ZB_ZCL_CLUSTER_ID_AIR_MONITOR_CONTROL, ZB_ZCL_CLUSTER_SERVER_ROLE,
+				    ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_CALIBRATION_CORRECTION_ID,
+				    (zb_uint8_t *)&correction, ZB_FALSE);
+	}
+
+	/* Progress reports and a possible retry from the coordinator go out without delay */
+	if (state == CALIBRATION_STATE_DONE || state == CALIBRATION_STATE_FAILED) {
+		status_led_set(STATUS_LED, STATUS_LED_OFF);
+		poll_manager_release(POLL_REASON_CALIBRATION);
 	} else {
-		err = air_quality_monitor_update_temperature();
-		if (err) {
-			LOG_ERR("Failed to update temperature: %d", err);
-		}
+		status_led_set(STATUS_LED, STATUS_LED_BREATHE);
+		poll_manager_request(POLL_REASON_CALIBRATION, 0);
+	}
+}
 
-		err = air_quality_monitor_update_humidity();
-		if (err) {
-			LOG_ERR("Failed to update humidity: %d", err);
-		}
+/**@brief Hands calibration progress over to the ZBOSS thread, called from the sensor thread. */
+static void calibration_progress_cb(enum calibration_state state)
+{
+	zb_ret_t zb_err = zb_diag_schedule_callback(calibration_progress, state);
 
-		double co2 = 0.0;
-		err = air_quality_monitor_update_co2(&co2);
-		if (err) {
-			LOG_ERR("Failed to update co2: %d", err);
-			return;
-		}
+	if (zb_err) {
+		LOG_ERR("Failed to schedule app callback: %d", zb_err);
+	}
+}
 
-		if (co2 < 1000.0) {
-			rgb_led_green();
-		} else if (co2 > 1600.0) {
-			rgb_led_red();
-		} else {
-			rgb_led_orange();
-		}
+/**@brief Publishes the power source and the supply voltage if they changed. */
+static void update_power_source(zb_uint8_t param)
+{
+	struct power_mode_status status;
+
+	ARG_UNUSED(param);
+	zb_diag_fired(update_power_source);
+
+	power_mode_get_status(&status);
+
+	zb_uint8_t power_source = status.usb ? ZB_ZCL_BASIC_POWER_SOURCE_DC_SOURCE :
+					       ZB_ZCL_BASIC_POWER_SOURCE_BATTERY;
+
+	if (power_source != dev_ctx.basic_attr.power_source) {
+		zb_zcl_set_attr_val(AIR_QUALITY_MONITOR_ENDPOINT_NB, ZB_ZCL_CLUSTER_ID_BASIC,
+				    ZB_ZCL_CLUSTER_SERVER_ROLE, ZB_ZCL_ATTR_BASIC_POWER_SOURCE_ID,
+				    &power_source, ZB_FALSE);
+	}
+
+	if (status.samples == 0) {
+		return;
+	}
+
+	zb_uint8_t voltage =
+		MIN(POWER_MODE_MV_TO_100MV(status.supply_mv), SUPPLY_VOLTAGE_UNKNOWN - 1);
+
+	if (voltage != dev_ctx.power_config_attrs.battery_voltage) {
+		zb_zcl_set_attr_val(AIR_QUALITY_MONITOR_ENDPOINT_NB, ZB_ZCL_CLUSTER_ID_POWER_CONFIG,
+				    ZB_ZCL_CLUSTER_SERVER_ROLE,
+				    ZB_ZCL_ATTR_POWER_CONFIG_BATTERY_VOLTAGE_ID, &voltage,
+				    ZB_FALSE);
 	}
+}
+
+/**@brief Hands power mode changes over to the ZBOSS thread, called from the system workqueue. */
+static void power_mode_changed_cb(void)
+{
+	zb_ret_t zb_err = zb_diag_schedule_callback(update_power_source, 0);
 
-	zb_ret_t zb_err = ZB_SCHEDULE_APP_ALARM(
-		check_air_quality, 0,
-		ZB_MILLISECONDS_TO_BEACON_INTERVAL(AIR_QUALITY_CHECK_PERIOD_MSEC));
 	if (zb_err) {
-		LOG_ERR("Failed to schedule app alarm: %d", zb_err);
+		LOG_ERR("Failed to schedule app callback: %d", zb_err);
 	}
 }
 
+/**@brief Starts CO2 calibration against the given reference concentration. */
+static void calibrate(zb_uint16_t reference_ppm)
+{
+	LOG_INF("Calibrating CO2 sensor to %u ppm", reference_ppm);
+
+	int err = calibration_start(reference_ppm);
+
+	if (err) {
+		LOG_WRN("Cannot start calibration: %d", err);
+	}
+}
+
+/**@brief Watches ZCL commands received on the endpoint.
+ *
+ * Any command means the coordinator is configuring or querying the device, so the parent is
+ * polled fast for a while. Remote reads also keep normal sampling.
+ *
+ * @param  bufid  Buffer with the parsed ZCL command.
+ *
+ * @return ZB_FALSE, the command is always processed by the stack.
+ */
+static zb_uint8_t zcl_endpoint_handler(zb_bufid_t bufid)
+{
+	zb_zcl_parsed_hdr_t *cmd_info = ZB_BUF_GET_PARAM(bufid, zb_zcl_parsed_hdr_t);
+
+	poll_manager_request(POLL_REASON_CONFIGURE, CONFIGURE_FAST_POLL_TIMEOUT_MSEC);
+
+	if (cmd_info->is_common_command && cmd_info->cmd_id == ZB_ZCL_CMD_READ_ATTRIB) {
+		sampling_scheduler_reader_active();
+	}
+
+	return ZB_FALSE;
+}
+
 /**@brief Callback for button events.
  *
  * @param[in]   button_state  Bitmask containing buttons state.
@@ -303,9 +684,9 @@ static void button_changed(uint32_t button_state, uint32_t has_changed)
 				/* Button released before Factory Reset */
 				if (ZB_JOINED()) {
 					/* Start identification mode */
-					ZB_SCHEDULE_APP_CALLBACK(start_identifying, 0);
+					zb_diag_schedule_callback(start_identifying, 0);
 				} else {
-					dk_set_led_on(IDENTIFY_LED);
+					status_led_set(IDENTIFY_LED, STATUS_LED_DOUBLE_BLINK);
 					LOG_DBG("Network steering was started");
 					zb_nvram_clear();
 					user_input_indicate();
@@ -322,24 +703,7 @@ static void button_changed(uint32_t button_state, uint32_t has_changed)
 			/* Button changed its state to released */
 			if (k_timer_status_get(&long_press_timer) > 0) {
 				/* Timer expired before button was released, indicates long press */
-				dk_set_led_on(STATUS_LED);
-				zb_ret_t zb_err = ZB_SCHEDULE_APP_ALARM_CANCEL(check_air_quality,
-									       ZB_ALARM_ANY_PARAM);
-				if (zb_err) {
-					LOG_ERR("Failed to cancel scheduled app alarm: %d", zb_err);
-				}
-
-				LOG_INF("Calibrating CO2 sensor");
-				air_quality_monitor_calibrate();
-				dk_set_led_off(STATUS_LED);
-
-				zb_err = ZB_SCHEDULE_APP_ALARM(
-					check_air_quality, 0,
-					ZB_MILLISECONDS_TO_BEACON_INTERVAL(
-						AIR_QUALITY_CHECK_PERIOD_MSEC));
-				if (zb_err) {
-					LOG_ERR("Failed to schedule app alarm: %d", zb_err);
-				}
+				calibrate(dev_ctx.control_attrs.calibration_reference);
 			} else {
 				/* Short button press */
 				k_timer_stop(&long_press_timer);
@@ -362,40 +726,57 @@ static void gpio_init(void)
 		LOG_ERR("Cannot init buttons (err: %d)", err);
 	}
 
-	err = dk_leds_init();
+	err = status_led_init();
 	if (err) {
 		LOG_ERR("Cannot init LEDs (err: %d)", err);
 	}
 }
 
+/**@brief Polls fast through the coordinator interview and starts periodic check-ins.
+ *
+ * @param  bufid  Buffer with the commissioning signal.
+ */
+static void network_joined(zb_bufid_t bufid)
+{
+	if (zb_buf_get_status(bufid) != RET_OK || !ZB_JOINED()) {
+		return;
+	}
+
+	poll_manager_request(POLL_REASON_JOIN, JOIN_FAST_POLL_TIMEOUT_MSEC);
+	zb_zcl_poll_control_start(0, AIR_QUALITY_MONITOR_ENDPOINT_NB);
+}
+
 void zboss_signal_handler(zb_bufid_t bufid)
 {
 	zb_zdo_app_signal_hdr_t *signal_header = NULL;
 	zb_zdo_app_signal_type_t signal = zb_get_app_signal(bufid, &signal_header);
-	zb_ret_t err = RET_OK;
 
 	//zigbee_led_status_update(bufid, STATUS_LED);
 	/* Detect ZBOSS startup */
 	switch (signal) {
 	case ZB_ZDO_SIGNAL_SKIP_STARTUP:
-		/* ZBOSS framework has started - schedule first air quality check */
-		err = ZB_SCHEDULE_APP_ALARM(
-			check_air_quality, 0,
-			ZB_MILLISECONDS_TO_BEACON_INTERVAL(AIR_QUALITY_CHECK_INITIAL_DELAY_MSEC));
-		if (err) {
-			LOG_ERR("Failed to schedule app alarm: %d", err);
-		}
+		/* ZBOSS framework has started - start sampling on the sensor thread */
+		sensor_thread_start(K_MSEC(AIR_QUALITY_CHECK_INITIAL_DELAY_MSEC), sample_ready);
+		break;
+	case ZB_BDB_SIGNAL_DEVICE_FIRST_START:
+		network_joined(bufid);
 		break;
 	case ZB_BDB_SIGNAL_STEERING:
 	case ZB_BDB_SIGNAL_DEVICE_REBOOT:
-		dk_set_led_off(IDENTIFY_LED);
+		status_led_set(IDENTIFY_LED, STATUS_LED_OFF);
+		network_joined(bufid);
 		break;
 	default:
 		break;
 	}
 
-	/* Let default signal handler process the signal*/
-	ZB_ERROR_CHECK(zigbee_default_signal_handler(bufid));
+	/* Network loss and rejoin attempts are handled by the offline manager, the default
+	 * signal handler would start its own rejoin procedure.
+	 */
+	if (!IS_ENABLED(CONFIG_AIR_MONITOR_OFFLINE) || !offline_manager_handle_signal(bufid)) {
+		/* Let default signal handler process the signal*/
+		ZB_ERROR_CHECK(zigbee_default_signal_handler(bufid));
+	}
 
 	/*
 	 * All callbacks should either reuse or free passed buffers.
@@ -408,13 +789,28 @@ void zboss_signal_handler(zb_bufid_t bufid)
 
 void main_usb_init()
 {
-	if (usb_enable(NULL) != 0) {
+	/* VBUS detection and removal switch between the USB and the battery power mode. The
+	 * stack stays enabled, without VBUS the USBD peripheral is off and only VBUS detection
+	 * runs, which brings the console back when USB is attached again.
+	 */
+	usb_dc_status_callback status_cb =
+		IS_ENABLED(CONFIG_AIR_MONITOR_POWER_MODE) ? power_mode_usb_status : NULL;
+
+	if (usb_enable(status_cb) != 0) {
 		LOG_ERR("Failed to enable USB");
 	}
 }
 
 void main(void)
 {
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_POWER_MODE)) {
+		int err = power_mode_init(power_mode_changed_cb);
+
+		if (err) {
+			LOG_ERR("Cannot init power mode (err: %d)", err);
+		}
+	}
+
 #if defined(CONFIG_USB_DEVICE_STACK)
 	main_usb_init();
 #endif
@@ -422,8 +818,25 @@ void main(void)
 	gpio_init();
 	register_factory_reset_button(FACTORY_RESET_BUTTON);
 
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_PROFILING)) {
+		profiler_init();
+	}
+
 	rgb_led_init();
 	air_quality_monitor_init();
+	calibration_init(calibration_progress_cb);
+
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_FLASH_LOG)) {
+		int err = flash_log_init();
+
+		if (err) {
+			LOG_ERR("Cannot init flash log (err: %d)", err);
+		}
+	}
+
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_TRACE_RECORDER)) {
+		trace_recorder_init();
+	}
 
 	/* Register device context (endpoint) */
 	ZB_AF_REGISTER_DEVICE_CTX(&air_quality_monitor_ctx);
@@ -434,15 +847,36 @@ void main(void)
 	/* Init measurements-related attributes */
 	measurements_clusters_attr_init();
 
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_SLEEP_CYCLE)) {
+		retained_attrs_init();
+	}
+
+	/* Calibration can be started remotely by writing the reference concentration */
+	zb_zcl_air_monitor_control_set_calibrate_cb(calibrate);
+
+	/* Remote reads are a hint for the sampling scheduler */
+	ZB_AF_SET_ENDPOINT_HANDLER(AIR_QUALITY_MONITOR_ENDPOINT_NB, zcl_endpoint_handler);
+
 	/* Register callback to identify notifications */
 	ZB_AF_SET_IDENTIFY_NOTIFICATION_HANDLER(AIR_QUALITY_MONITOR_ENDPOINT_NB, identify_cb);
 
 	/* Enable Sleepy End Device behavior */
 	zb_set_rx_on_when_idle(ZB_FALSE);
+	poll_manager_init();
+
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_OFFLINE)) {
+		offline_manager_init(AIR_QUALITY_MONITOR_ENDPOINT_NB, sample_pipeline_rejoined);
+	}
+
 	if (IS_ENABLED(CONFIG_RAM_POWER_DOWN_LIBRARY)) {
 		power_down_unused_ram();
 	}
 
+	/* Last chance to sample the main thread stack, main() returns after enabling Zigbee */
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_MEM_WATERMARK)) {
+		mem_watermark_init();
+	}
+
 	//zb_bdb_set_legacy_device_support(-1);
 
 	/* Start Zigbee stack */
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/sys_heap.h>
+#include <zephyr/sys/util.h>
+
+#include "mem_watermark.h"
+
+#define SAMPLE_INTERVAL K_SECONDS(CONFIG_AIR_MONITOR_MEM_WATERMARK_INTERVAL_SECONDS)
+
+#if CONFIG_HEAP_MEM_POOL_SIZE > 0
+extern struct k_heap _system_heap;
+#endif
+
+static const char *const thread_names[] = {
+	[MEM_WATERMARK_THREAD_MAIN] = "main",
+	[MEM_WATERMARK_THREAD_ZBOSS] = "zboss",
+	[MEM_WATERMARK_THREAD_LOGGING] = "logging",
+	[MEM_WATERMARK_THREAD_USB] = "usbworkq",
+	[MEM_WATERMARK_THREAD_SYSWORKQ] = "sysworkq",
+	[MEM_WATERMARK_THREAD_SENSOR] = "sensor",
+};
+
+BUILD_ASSERT(ARRAY_SIZE(thread_names) == MEM_WATERMARK_THREAD_COUNT);
+
+static void sample_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(sample_work, sample_work_handler);
+
+static struct k_spinlock lock;
+static struct mem_watermark_stats stats;
+
+static void stack_sample(const struct k_thread *thread, void *user_data)
+{
+	struct mem_watermark_stack *stacks = user_data;
+	const char *name = k_thread_name_get((k_tid_t)thread);
+	size_t unused;
+
+	if (!name) {
+		return;
+	}
+
+	for (int i = 0; i < MEM_WATERMARK_THREAD_COUNT; i++) {
+		if (strcmp(name, thread_names[i]) != 0) {
+			continue;
+		}
+
+		/* Counts the bytes still holding the fill pattern from the bottom of the stack */
+		if (k_thread_stack_space_get(thread, &unused) == 0) {
+			stacks[i].size = thread->stack_info.size;
+			stacks[i].used_max = thread->stack_info.size - unused;
+		}
+		break;
+	}
+}
+
+void mem_watermark_sample(void)
+{
+	struct mem_watermark_stack stacks[MEM_WATERMARK_THREAD_COUNT];
+	uint32_t heap_size = 0;
+	uint32_t heap_peak = 0;
+	uint32_t slabs = 0;
+	uint8_t slab_peak_pct = 0;
+
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	/* Exited threads are not found, they keep their last sample */
+	memcpy(stacks, stats.stacks, sizeof(stacks));
+
+	k_spin_unlock(&lock, key);
+
+	/* The stacks are scanned with the thread list unlocked, interrupts stay enabled */
+	k_thread_foreach_unlocked(stack_sample, stacks);
+
+#if CONFIG_HEAP_MEM_POOL_SIZE > 0
+	struct sys_memory_stats heap;
+
+	if (sys_heap_runtime_stats_get(&_system_heap.heap, &heap) == 0) {
+		heap_size = heap.allocated_bytes + heap.free_bytes;
+		heap_peak = heap.max_allocated_bytes;
+	}
+#endif
+
+	STRUCT_SECTION_FOREACH(k_mem_slab, slab) {
+		uint32_t pct = slab->num_blocks ?
+			100 * k_mem_slab_max_used_get(slab) / slab->num_blocks : 0;
+
+		slabs++;
+		slab_peak_pct = MAX(slab_peak_pct, pct);
+	}
+
+	key = k_spin_lock(&lock);
+
+	memcpy(stats.stacks, stacks, sizeof(stacks));
+	stats.heap_size = heap_size;
+	stats.heap_peak = heap_peak;
+	stats.slabs = slabs;
+	stats.slab_peak_pct = slab_peak_pct;
+	stats.samples++;
+
+	k_spin_unlock(&lock, key);
+}
+
+static void sample_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	mem_watermark_sample();
+
+	k_work_reschedule(&sample_work, SAMPLE_INTERVAL);
+}
+
+void mem_watermark_init(void)
+{
+	mem_watermark_sample();
+	k_work_reschedule(&sample_work, SAMPLE_INTERVAL);
+}
+
+void mem_watermark_get_stats(struct mem_watermark_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	*out = stats;
+
+	k_spin_unlock(&lock, key);
+}
+
+uint32_t mem_watermark_headroom_min(const struct mem_watermark_stats *s)
+{
+	uint32_t headroom = UINT32_MAX;
+
+	for (int i = 0; i < MEM_WATERMARK_THREAD_COUNT; i++) {
+		if (s->stacks[i].size) {
+			headroom = MIN(headroom, s->stacks[i].size - s->stacks[i].used_max);
+		}
+	}
+
+	return headroom;
+}
+
+#if defined(CONFIG_SHELL)
+
+static int cmd_mem(const struct shell *sh, size_t argc, char **argv)
+{
+	struct mem_watermark_stats s;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	/* Fresh values instead of the last periodic sample */
+	mem_watermark_sample();
+	mem_watermark_get_stats(&s);
+
+	for (int i = 0; i < MEM_WATERMARK_THREAD_COUNT; i++) {
+		const struct mem_watermark_stack *stack = &s.stacks[i];
+
+		if (!stack->size) {
+			shell_print(sh, "%-8s not found", thread_names[i]);
+			continue;
+		}
+
+		shell_print(sh, "%-8s stack %u / %u bytes used (%u %%), %u unused", thread_names[i],
+			    stack->used_max, stack->size, 100 * stack->used_max / stack->size,
+			    stack->size - stack->used_max);
+	}
+
+	shell_print(sh, "heap peak %u / %u bytes", s.heap_peak, s.heap_size);
+
+	STRUCT_SECTION_FOREACH(k_mem_slab, slab) {
+		shell_print(sh, "slab %p: %u x %u bytes, peak %u used", slab, slab->num_blocks,
+			    (uint32_t)slab->block_size, k_mem_slab_max_used_get(slab));
+	}
+
+	shell_print(sh, "%u samples", s.samples);
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((aqm), mem, NULL, "Stack high-water marks, heap and memory slab peaks", cmd_mem,
+		 1, 0);
+
+#endif /* CONFIG_SHELL */
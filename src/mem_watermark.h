@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef MEM_WATERMARK_H
+#define MEM_WATERMARK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Threads whose stack high-water marks are sampled, in the order of the diagnostics attribute */
+enum mem_watermark_thread {
+	/* "main", sampled before it returns */
+	MEM_WATERMARK_THREAD_MAIN,
+	/* "zboss", Zigbee stack */
+	MEM_WATERMARK_THREAD_ZBOSS,
+	/* "logging", deferred log processing */
+	MEM_WATERMARK_THREAD_LOGGING,
+	/* "usbworkq", USB device stack */
+	MEM_WATERMARK_THREAD_USB,
+	/* "sysworkq", system workqueue */
+	MEM_WATERMARK_THREAD_SYSWORKQ,
+	/* "sensor", sensor workqueue */
+	MEM_WATERMARK_THREAD_SENSOR,
+	MEM_WATERMARK_THREAD_COUNT,
+};
+
+struct mem_watermark_stack {
+	/* Stack size and most bytes ever used, 0 until the thread was found */
+	uint32_t size;
+	uint32_t used_max;
+};
+
+struct mem_watermark_stats {
+	struct mem_watermark_stack stacks[MEM_WATERMARK_THREAD_COUNT];
+	/* System heap (k_malloc) size and peak allocation, 0 without a heap */
+	uint32_t heap_size;
+	uint32_t heap_peak;
+	/* Memory slabs and the highest peak utilisation of any of them in % */
+	uint32_t slabs;
+	uint8_t slab_peak_pct;
+	uint32_t samples;
+};
+
+/**
+ * @brief Takes the first sample and samples every CONFIG_AIR_MONITOR_MEM_WATERMARK_INTERVAL_SECONDS
+ *	  on the system workqueue.
+ *
+ * Must be called from the main thread, its stack is sampled for the last time before main()
+ * returns.
+ */
+void mem_watermark_init(void);
+
+/**
+ * @brief Samples stack high-water marks, heap and memory slab peaks now.
+ *
+ * Threads that exited keep their last sample. Safe to call from any thread.
+ */
+void mem_watermark_sample(void);
+
+/**
+ * @brief Returns the last sample. Safe to call from any thread.
+ */
+void mem_watermark_get_stats(struct mem_watermark_stats *stats);
+
+/**
+ * @brief Returns the smallest unused stack in bytes of the sampled threads.
+ *
+ * @return UINT32_MAX if no thread was sampled yet.
+ */
+uint32_t mem_watermark_headroom_min(const struct mem_watermark_stats *stats);
+
+#endif /* MEM_WATERMARK_H */
@@ -0,0 +1,443 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/random/rand32.h>
+#include <zephyr/shell/shell.h>
+#include <zboss_api.h>
+
+#include "history.h"
+#include "offline_manager.h"
+#include "poll_manager.h"
+#include "zb_diag.h"
+#include "zcl/zb_zcl_air_monitor_history.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
+
+#define BACKOFF_MIN_MSEC (1000 * CONFIG_AIR_MONITOR_REJOIN_BACKOFF_MIN_SECONDS)
+#define BACKOFF_MAX_MSEC (1000 * CONFIG_AIR_MONITOR_REJOIN_BACKOFF_MAX_SECONDS)
+
+/* Radio time refilled per hour for rejoin attempts, an attempt is postponed until the
+ * budget covers the duration of the previous one
+ */
+#define BUDGET_MSEC (1000 * CONFIG_AIR_MONITOR_REJOIN_BUDGET_SECONDS_PER_HOUR)
+#define BUDGET_PERIOD_MSEC (3600 * MSEC_PER_SEC)
+
+/* Backfill starts once the coordinator is done with the rejoined device */
+#define BACKFILL_DELAY_MSEC 10000
+
+/* Retry period when no buffer is available for the next HistoryFrame */
+#define BACKFILL_RETRY_MSEC 1000
+
+static zb_uint8_t history_endpoint;
+static offline_manager_joined_cb_t joined_cb;
+
+/* Owned by the ZBOSS thread */
+static bool attempt_running;
+static int64_t attempt_started;
+static int64_t offline_since;
+static uint32_t attempt_cost_ms;
+static uint32_t budget_ms = BUDGET_MSEC;
+static int64_t budget_updated;
+
+/* Samples from backfill_from up to backfill_end are uploaded after rejoin */
+static bool backfill_pending;
+static uint32_t backfill_from;
+static uint32_t backfill_end;
+static uint32_t backfill_next;
+static uint8_t backfill_count;
+
+static struct k_spinlock status_lock;
+static struct offline_manager_status status;
+
+static void rejoin_attempt(zb_uint8_t param);
+static void backfill_send(zb_uint8_t param);
+
+/* Updates the status fields owned by the ZBOSS thread */
+static void offline_manager_publish(uint32_t next_attempt_ms)
+{
+	k_spinlock_key_t key = k_spin_lock(&status_lock);
+
+	status.budget_ms = budget_ms;
+	status.next_attempt_s = DIV_ROUND_UP(next_attempt_ms, MSEC_PER_SEC);
+
+	if (status.offline) {
+		status.outage_s = (uint32_t)((k_uptime_get() - offline_since) / MSEC_PER_SEC);
+	}
+
+	k_spin_unlock(&status_lock, key);
+}
+
+static void budget_refill(void)
+{
+	int64_t now = k_uptime_get();
+	uint64_t refill = (uint64_t)(now - budget_updated) * BUDGET_MSEC / BUDGET_PERIOD_MSEC;
+
+	budget_updated = now;
+	budget_ms = (uint32_t)MIN(budget_ms + refill, BUDGET_MSEC);
+}
+
+/* Exponential backoff with +-25 % jitter, stretched until the budget covers an attempt */
+static uint32_t rejoin_delay(uint32_t attempts)
+{
+	uint32_t delay = (uint32_t)MIN((uint64_t)BACKOFF_MIN_MSEC << MIN(attempts, 16),
+				       BACKOFF_MAX_MSEC);
+
+	delay = delay - delay / 4 + sys_rand32_get() % (delay / 2 + 1);
+
+	budget_refill();
+
+	if (attempt_cost_ms > budget_ms) {
+		uint32_t wait = (uint32_t)((uint64_t)(attempt_cost_ms - budget_ms) *
+					   BUDGET_PERIOD_MSEC / BUDGET_MSEC);
+
+		delay = MAX(delay, wait);
+	}
+
+	return delay;
+}
+
+static void rejoin_schedule(void)
+{
+	uint32_t attempts;
+	k_spinlock_key_t key = k_spin_lock(&status_lock);
+
+	attempts = status.attempts;
+
+	k_spin_unlock(&status_lock, key);
+
+	uint32_t delay = rejoin_delay(attempts);
+
+	LOG_INF("Rejoin attempt %u in %u s", attempts + 1, delay / MSEC_PER_SEC);
+
+	ZB_SCHEDULE_APP_ALARM_CANCEL(rejoin_attempt, ZB_ALARM_ANY_PARAM);
+	zb_diag_schedule_app_alarm(rejoin_attempt, 0, ZB_MILLISECONDS_TO_BEACON_INTERVAL(delay));
+	offline_manager_publish(delay);
+}
+
+static void backfill_stop(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&status_lock);
+
+	status.backfilling = false;
+
+	k_spin_unlock(&status_lock, key);
+
+	backfill_pending = false;
+	ZB_SCHEDULE_APP_ALARM_CANCEL(backfill_send, ZB_ALARM_ANY_PARAM);
+	poll_manager_release(POLL_REASON_BACKFILL);
+}
+
+static void offline_manager_lost(const char *reason)
+{
+	if (status.offline) {
+		return;
+	}
+
+	uint32_t now_s = k_uptime_get_32() / MSEC_PER_SEC;
+
+	LOG_WRN("Network lost (%s), sampling continues offline", reason);
+
+	/* Reports failed already before the loss was detected, the sample stored before
+	 * is uploaded again. An unfinished backfill is merged into this outage.
+	 */
+	if (!backfill_pending) {
+		backfill_from = now_s - MIN(now_s, CONFIG_AIR_MONITOR_HISTORY_INTERVAL_SECONDS);
+	}
+
+	/* There is no parent to poll, fast polling for the network would only keep the radio on.
+	 * Identify and calibration keep their own reasons and timeouts.
+	 */
+	backfill_stop();
+	poll_manager_release(POLL_REASON_JOIN | POLL_REASON_CONFIGURE | POLL_REASON_BACKFILL);
+
+	offline_since = k_uptime_get();
+	attempt_running = false;
+
+	k_spinlock_key_t key = k_spin_lock(&status_lock);
+
+	status.offline = true;
+	status.outages++;
+	status.attempts = 0;
+	status.backfill_frames = 0;
+	status.backfill_samples = 0;
+
+	k_spin_unlock(&status_lock, key);
+
+	rejoin_schedule();
+}
+
+static void offline_manager_joined(void)
+{
+	if (!status.offline) {
+		return;
+	}
+
+	ZB_SCHEDULE_APP_ALARM_CANCEL(rejoin_attempt, ZB_ALARM_ANY_PARAM);
+	offline_manager_publish(0);
+
+	k_spinlock_key_t key = k_spin_lock(&status_lock);
+
+	status.offline = false;
+	status.backfilling = true;
+
+	k_spin_unlock(&status_lock, key);
+
+	LOG_INF("Network rejoined after %u s and %u attempts", status.outage_s, status.attempts);
+
+	backfill_end = k_uptime_get_32() / MSEC_PER_SEC;
+	backfill_pending = true;
+	zb_diag_schedule_app_alarm(backfill_send, 0,
+				   ZB_MILLISECONDS_TO_BEACON_INTERVAL(BACKFILL_DELAY_MSEC));
+
+	if (joined_cb) {
+		joined_cb();
+	}
+}
+
+/**@brief Starts a rejoin attempt through network steering.
+ *
+ * @param  param  Unused parameter, required by ZBOSS scheduler API.
+ */
+static void rejoin_attempt(zb_uint8_t param)
+{
+	ZVUNUSED(param);
+
+	zb_diag_fired(rejoin_attempt);
+
+	/* The stack may have found the parent again on its own */
+	if (ZB_JOINED()) {
+		offline_manager_joined();
+		return;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&status_lock);
+
+	status.attempts++;
+
+	k_spin_unlock(&status_lock, key);
+
+	attempt_running = true;
+	attempt_started = k_uptime_get();
+	offline_manager_publish(0);
+
+	if (!bdb_start_top_level_commissioning(ZB_BDB_NETWORK_STEERING)) {
+		LOG_WRN("Cannot start rejoin");
+		attempt_running = false;
+		rejoin_schedule();
+	}
+}
+
+/* Charges the radio time of the finished attempt to the budget */
+static void rejoin_attempt_done(void)
+{
+	if (!attempt_running) {
+		return;
+	}
+
+	attempt_running = false;
+	attempt_cost_ms = (uint32_t)(k_uptime_get() - attempt_started);
+
+	budget_refill();
+	budget_ms -= MIN(attempt_cost_ms, budget_ms);
+}
+
+/**@brief Sends the next HistoryFrame of the backfill once the previous one was sent.
+ *
+ * @param  bufid  Buffer with the send status of the previous frame.
+ */
+static void backfill_sent(zb_bufid_t bufid)
+{
+	zb_zcl_command_send_status_t *send_status =
+		ZB_BUF_GET_PARAM(bufid, zb_zcl_command_send_status_t);
+
+	if (!backfill_pending) {
+		/* Network lost again, the backfill restarts after the next rejoin */
+		zb_buf_free(bufid);
+		return;
+	}
+
+	if (send_status->status != RET_OK) {
+		LOG_WRN("Backfill stopped, no bound History client reachable: %d",
+			send_status->status);
+		zb_buf_free(bufid);
+		backfill_stop();
+		return;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&status_lock);
+
+	status.backfill_frames++;
+	status.backfill_samples += backfill_count;
+
+	k_spin_unlock(&status_lock, key);
+
+	backfill_from = backfill_next;
+
+	if (backfill_from == HISTORY_END || backfill_from > backfill_end) {
+		LOG_INF("Backfill done, %u samples in %u frames", status.backfill_samples,
+			status.backfill_frames);
+		zb_buf_free(bufid);
+		backfill_stop();
+		return;
+	}
+
+	zb_buf_reuse(bufid);
+	zb_diag_schedule_app_callback(backfill_send, bufid);
+}
+
+/**@brief Uploads the next HistoryFrame of the outage to the bound History clients.
+ *
+ * @param  bufid  Buffer to reuse, 0 to allocate one.
+ */
+static void backfill_send(zb_bufid_t bufid)
+{
+	struct history_info info;
+
+	zb_diag_fired(backfill_send);
+
+	if (!backfill_pending) {
+		if (bufid) {
+			zb_buf_free(bufid);
+		}
+		return;
+	}
+
+	history_get_info(&info);
+
+	if (!info.count || info.newest_s < backfill_from) {
+		if (bufid) {
+			zb_buf_free(bufid);
+		}
+		backfill_stop();
+		return;
+	}
+
+	if (info.oldest_s > backfill_from) {
+		LOG_WRN("Backfill starts at %u s, older samples were dropped from history",
+			info.oldest_s);
+		backfill_from = info.oldest_s;
+	}
+
+	if (!bufid) {
+		bufid = zb_diag_buf_get_out();
+	}
+
+	if (!bufid) {
+		zb_diag_schedule_app_alarm(backfill_send, 0,
+					   ZB_MILLISECONDS_TO_BEACON_INTERVAL(BACKFILL_RETRY_MSEC));
+		return;
+	}
+
+	/* Parent is polled fast so that the APS acks come back without delay */
+	poll_manager_request(POLL_REASON_BACKFILL, 0);
+
+	backfill_count = zb_zcl_air_monitor_history_send_frame(bufid, history_endpoint,
+							       backfill_from, &backfill_next,
+							       backfill_sent);
+}
+
+void offline_manager_init(zb_uint8_t endpoint, offline_manager_joined_cb_t cb)
+{
+	history_endpoint = endpoint;
+	joined_cb = cb;
+	budget_updated = k_uptime_get();
+}
+
+bool offline_manager_handle_signal(zb_bufid_t bufid)
+{
+	zb_zdo_app_signal_hdr_t *signal_header = NULL;
+	zb_zdo_app_signal_type_t signal = zb_get_app_signal(bufid, &signal_header);
+	zb_ret_t signal_status = zb_buf_get_status(bufid);
+
+	switch (signal) {
+	case ZB_BDB_SIGNAL_DEVICE_REBOOT:
+		/* Commissioned before, the parent was not found after boot */
+		if (signal_status != RET_OK) {
+			offline_manager_lost("parent not found after reboot");
+			return true;
+		}
+
+		offline_manager_joined();
+		return false;
+	case ZB_BDB_SIGNAL_STEERING:
+		if (!status.offline) {
+			return false;
+		}
+
+		rejoin_attempt_done();
+
+		if (signal_status == RET_OK && ZB_JOINED()) {
+			offline_manager_joined();
+			return false;
+		}
+
+		rejoin_schedule();
+		return true;
+	case ZB_NLME_STATUS_INDICATION: {
+		zb_zdo_signal_nlme_status_indication_params_t *nlme_status_ind =
+			ZB_ZDO_SIGNAL_GET_PARAMS(signal_header,
+						 zb_zdo_signal_nlme_status_indication_params_t);
+
+		if (nlme_status_ind->nlme_status.status !=
+		    ZB_NWK_COMMAND_STATUS_PARENT_LINK_FAILURE) {
+			return false;
+		}
+
+		offline_manager_lost("parent link failure");
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+bool offline_manager_is_offline(void)
+{
+	return status.offline;
+}
+
+void offline_manager_get_status(struct offline_manager_status *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&status_lock);
+
+	*out = status;
+
+	k_spin_unlock(&status_lock, key);
+}
+
+#if defined(CONFIG_SHELL)
+
+static int cmd_offline_show(const struct shell *sh, size_t argc, char **argv)
+{
+	struct offline_manager_status offline;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	offline_manager_get_status(&offline);
+
+	shell_print(sh, "%s, %u outages since boot", offline.offline ? "offline" : "online",
+		    offline.outages);
+	shell_print(sh, "last outage %u s, %u rejoin attempts, next in %u s", offline.outage_s,
+		    offline.attempts, offline.next_attempt_s);
+	shell_print(sh, "rejoin budget %u of %u ms", offline.budget_ms, BUDGET_MSEC);
+	shell_print(sh, "backfill%s: %u samples in %u frames",
+		    offline.backfilling ? " running" : "", offline.backfill_samples,
+		    offline.backfill_frames);
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(offline_cmds,
+	SHELL_CMD(show, NULL, "Show outage, rejoin and backfill state", cmd_offline_show),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_SUBCMD_ADD((aqm), offline, &offline_cmds, "Offline buffering and rejoin",
+		 cmd_offline_show, 1, 0);
+
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef OFFLINE_MANAGER_H
+#define OFFLINE_MANAGER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zboss_api.h>
+
+struct offline_manager_status {
+	bool offline;
+	/* Backfill of the last outage is being uploaded */
+	bool backfilling;
+	/* Network losses since boot */
+	uint32_t outages;
+	/* Rejoin attempts in the current or last outage */
+	uint32_t attempts;
+	/* Duration of the current or last outage */
+	uint32_t outage_s;
+	/* Delay before the next rejoin attempt, 0 if none is scheduled */
+	uint32_t next_attempt_s;
+	/* Radio time left in the rejoin budget */
+	uint32_t budget_ms;
+	/* HistoryFrames and samples uploaded after the last rejoin */
+	uint32_t backfill_frames;
+	uint32_t backfill_samples;
+};
+
+/**
+ * @brief Called on the ZBOSS thread when the network is back after a loss.
+ */
+typedef void (*offline_manager_joined_cb_t)(void);
+
+/**
+ * @brief Sets the endpoint whose History cluster uploads the backfill.
+ *
+ * @param endpoint   Endpoint of the History cluster.
+ * @param joined_cb  Callback for the rejoin, from the signal handler or a rejoin attempt.
+ */
+void offline_manager_init(zb_uint8_t endpoint, offline_manager_joined_cb_t joined_cb);
+
+/**
+ * @brief Tracks network loss and rejoin from the ZBOSS signals.
+ *
+ * Parent loss and failed rejoin attempts are consumed, the rejoin is then retried with
+ * an exponential backoff bounded by the radio time budget instead of the default rejoin
+ * procedure. After a rejoin the samples measured while offline are uploaded.
+ *
+ * @param bufid  Buffer with the signal.
+ *
+ * @return true if the signal was consumed and must not be passed to the default handler.
+ *
+ * @note Must be called from the ZBOSS thread.
+ */
+bool offline_manager_handle_signal(zb_bufid_t bufid);
+
+/**
+ * @brief Returns true while the network is lost and reports cannot be delivered.
+ */
+bool offline_manager_is_offline(void);
+
+/**
+ * @brief Returns outage and backfill statistics. Safe to call from any thread.
+ */
+void offline_manager_get_status(struct offline_manager_status *status);
+
+#endif /* OFFLINE_MANAGER_H */
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zboss_api.h>
+
+#include "poll_manager.h"
+#include "sleep_cycle.h"
+#include "zb_diag.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
+
+/* Continuous turbo poll is started with this timeout and refreshed before it runs out,
+ * so a lost release never keeps the radio on for long.
+ */
+#define TURBO_POLL_TIMEOUT_MSEC 30000
+#define TURBO_POLL_REFRESH_MSEC 25000
+
+static uint32_t reasons;
+static int64_t deadlines[POLL_REASON_COUNT];
+
+static void poll_manager_expire(zb_uint8_t param);
+
+static void poll_manager_apply(uint32_t previous)
+{
+	int64_t now = k_uptime_get();
+	int64_t next = now + TURBO_POLL_REFRESH_MSEC;
+
+	if (reasons != previous) {
+		LOG_DBG("Fast poll reasons 0x%02x", reasons);
+	}
+
+	ZB_SCHEDULE_APP_ALARM_CANCEL(poll_manager_expire, ZB_ALARM_ANY_PARAM);
+
+	if (!reasons) {
+		if (previous) {
+			zb_zdo_pim_turbo_poll_continuous_leave(0);
+		}
+		return;
+	}
+
+	/* (Re)started on every change, which also refreshes its timeout */
+	zb_zdo_pim_start_turbo_poll_continuous(TURBO_POLL_TIMEOUT_MSEC);
+
+	for (int i = 0; i < POLL_REASON_COUNT; i++) {
+		if ((reasons & BIT(i)) && deadlines[i]) {
+			next = MIN(next, deadlines[i]);
+		}
+	}
+
+	zb_diag_schedule_app_alarm(poll_manager_expire, 0,
+				   ZB_MILLISECONDS_TO_BEACON_INTERVAL(MAX(next - now, 1)));
+}
+
+static void poll_manager_expire(zb_uint8_t param)
+{
+	uint32_t previous = reasons;
+	int64_t now = k_uptime_get();
+
+	ZVUNUSED(param);
+
+	zb_diag_fired(poll_manager_expire);
+
+	for (int i = 0; i < POLL_REASON_COUNT; i++) {
+		if ((reasons & BIT(i)) && deadlines[i] && deadlines[i] <= now) {
+			reasons &= ~BIT(i);
+		}
+	}
+
+	poll_manager_apply(previous);
+}
+
+#if defined(CONFIG_AIR_MONITOR_SLEEP_CYCLE)
+/* One parent poll per sleep cycle. Frames queued by the parent expire before the next poll,
+ * the coordinator reaches the device through the fast polling started at check-in.
+ */
+#define LONG_POLL_INTERVAL_MSEC SLEEP_CYCLE_PERIOD_MSEC
+
+/* Parent drops children that stay silent for longer */
+BUILD_ASSERT(CONFIG_AIR_MONITOR_SLEEP_CYCLE_PERIOD_SECONDS <= 32 * 60,
+	     "Sleep cycle must be well within the 64 min end device timeout");
+#else
+#define LONG_POLL_INTERVAL_MSEC CONFIG_AIR_MONITOR_LONG_POLL_INTERVAL_MSEC
+#endif
+
+void poll_manager_init(void)
+{
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_SLEEP_CYCLE)) {
+		zb_set_ed_timeout(ED_AGING_TIMEOUT_64MIN);
+		zb_set_keepalive_timeout(
+			ZB_MILLISECONDS_TO_BEACON_INTERVAL(LONG_POLL_INTERVAL_MSEC));
+	}
+
+	zb_zdo_pim_set_long_poll_interval(LONG_POLL_INTERVAL_MSEC);
+}
+
+uint32_t poll_manager_long_poll_interval(void)
+{
+	return LONG_POLL_INTERVAL_MSEC;
+}
+
+void poll_manager_request(uint32_t reason, uint32_t timeout_ms)
+{
+	uint32_t previous = reasons;
+	int i = find_lsb_set(reason) - 1;
+
+	if (i < 0 || i >= POLL_REASON_COUNT) {
+		return;
+	}
+
+	/* Timed request never shortens a running one, untimed one keeps the reason for good */
+	if (!timeout_ms) {
+		deadlines[i] = 0;
+	} else if (!(reasons & reason) || deadlines[i]) {
+		deadlines[i] = MAX(deadlines[i], k_uptime_get() + timeout_ms);
+	}
+
+	reasons |= reason;
+
+	if (reasons != previous || timeout_ms) {
+		poll_manager_apply(previous);
+	}
+}
+
+void poll_manager_release(uint32_t reason)
+{
+	uint32_t previous = reasons;
+
+	reasons &= ~reason;
+
+	if (reasons != previous) {
+		poll_manager_apply(previous);
+	}
+}
+
+uint32_t poll_manager_reasons(void)
+{
+	return reasons;
+}
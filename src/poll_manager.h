@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef POLL_MANAGER_H
+#define POLL_MANAGER_H
+
+#include <stdint.h>
+#include <zephyr/sys/util.h>
+
+/* Reasons for polling the parent fast, the device polls fast while any of them is active */
+#define POLL_REASON_JOIN BIT(0)
+#define POLL_REASON_CONFIGURE BIT(1)
+#define POLL_REASON_IDENTIFY BIT(2)
+#define POLL_REASON_CALIBRATION BIT(3)
+#define POLL_REASON_BACKFILL BIT(4)
+#define POLL_REASON_COUNT 5
+
+/**
+ * @brief Sets the long poll interval used while no reason for fast polling is active.
+ *
+ * With CONFIG_AIR_MONITOR_SLEEP_CYCLE the parent is polled once per sleep cycle.
+ */
+void poll_manager_init(void);
+
+/**
+ * @brief Returns the long poll interval in milliseconds.
+ */
+uint32_t poll_manager_long_poll_interval(void);
+
+/**
+ * @brief Starts fast polling for the given reason, or extends its timeout.
+ *
+ * @param reason      One of POLL_REASON_*.
+ * @param timeout_ms  Reason is released automatically after this time, 0 to keep it
+ *                    until poll_manager_release().
+ *
+ * @note Must be called from the ZBOSS thread.
+ */
+void poll_manager_request(uint32_t reason, uint32_t timeout_ms);
+
+/**
+ * @brief Releases the given reason, long polling resumes once no reason is active.
+ *
+ * @note Must be called from the ZBOSS thread.
+ */
+void poll_manager_release(uint32_t reason);
+
+/**
+ * @brief Returns the bitmask of active reasons.
+ */
+uint32_t poll_manager_reasons(void);
+
+#endif /* POLL_MANAGER_H */
@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <hal/nrf_power.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/adc.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/logging/log_backend.h>
+#include <zephyr/logging/log_ctrl.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+#include "power_mode.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
+
+BUILD_ASSERT(DT_NODE_HAS_PROP(DT_PATH(zephyr_user), io_channels),
+	     "Supply voltage ADC channel must be set as io-channels of zephyr,user");
+
+#define SAMPLE_INTERVAL K_SECONDS(CONFIG_AIR_MONITOR_SUPPLY_SAMPLE_INTERVAL_SECONDS)
+
+static const struct adc_dt_spec supply = ADC_DT_SPEC_GET(DT_PATH(zephyr_user));
+
+static void mode_work_handler(struct k_work *work);
+static void sample_work_handler(struct k_work *work);
+
+static K_WORK_DEFINE(mode_work, mode_work_handler);
+static K_WORK_DELAYABLE_DEFINE(sample_work, sample_work_handler);
+
+/* Set by the USB status callback, applied by mode_work */
+static atomic_t vbus;
+
+/* Owned by the system workqueue */
+static power_mode_changed_cb_t changed_cb;
+static uint32_t disabled_backends;
+static uint16_t notified_mv;
+
+static struct k_spinlock lock;
+static struct power_mode_status status;
+
+/* Without backends every log level is filtered out at runtime, no messages are created and
+ * the log thread is not woken up. Only backends that were active are brought back.
+ */
+static void logging_set(bool on)
+{
+	if (!IS_ENABLED(CONFIG_LOG) || IS_ENABLED(CONFIG_LOG_MODE_MINIMAL)) {
+		return;
+	}
+
+	for (int i = 0; i < MIN(log_backend_count_get(), 32); i++) {
+		const struct log_backend *backend = log_backend_get(i);
+
+		if (on && (disabled_backends & BIT(i))) {
+			log_backend_enable(backend, backend->cb->ctx, CONFIG_LOG_MAX_LEVEL);
+			disabled_backends &= ~BIT(i);
+		} else if (!on && log_backend_is_active(backend)) {
+			log_backend_disable(backend);
+			disabled_backends |= BIT(i);
+		}
+	}
+}
+
+static void mode_work_handler(struct k_work *work)
+{
+	bool usb = atomic_get(&vbus);
+
+	ARG_UNUSED(work);
+
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	bool changed = usb != status.usb;
+
+	if (changed) {
+		status.usb = usb;
+		status.switches++;
+	}
+
+	k_spin_unlock(&lock, key);
+
+	if (!changed) {
+		return;
+	}
+
+	logging_set(usb);
+	LOG_INF("%s power", usb ? "USB" : "Battery");
+
+	/* The supply voltage follows the source, sample it right away */
+	k_work_reschedule(&sample_work, K_NO_WAIT);
+
+	if (changed_cb) {
+		changed_cb();
+	}
+}
+
+static int supply_sample(uint16_t *mv)
+{
+	int16_t raw;
+	struct adc_sequence sequence = {
+		.buffer = &raw,
+		.buffer_size = sizeof(raw),
+	};
+	int err = adc_sequence_init_dt(&supply, &sequence);
+
+	if (err) {
+		return err;
+	}
+
+	/* The SAADC is enabled only for the conversion */
+	err = adc_read(supply.dev, &sequence);
+	if (err) {
+		return err;
+	}
+
+	int32_t val = raw;
+
+	err = adc_raw_to_millivolts_dt(&supply, &val);
+	if (err) {
+		return err;
+	}
+
+	/* Single ended inputs read slightly below zero around ground */
+	*mv = CLAMP(val, 0, UINT16_MAX);
+
+	return 0;
+}
+
+static void sample_work_handler(struct k_work *work)
+{
+	uint16_t mv = 0;
+	int err = supply_sample(&mv);
+
+	ARG_UNUSED(work);
+
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	if (err) {
+		status.sample_errors++;
+	} else {
+		status.supply_mv = mv;
+		status.samples++;
+	}
+
+	k_spin_unlock(&lock, key);
+
+	/* Changes below the reported 100 mV resolution are not passed on */
+	if (err) {
+		LOG_WRN("Cannot sample supply voltage: %d", err);
+	} else if (POWER_MODE_MV_TO_100MV(mv) != POWER_MODE_MV_TO_100MV(notified_mv)) {
+		notified_mv = mv;
+
+		if (changed_cb) {
+			changed_cb();
+		}
+	}
+
+	k_work_reschedule(&sample_work, SAMPLE_INTERVAL);
+}
+
+int power_mode_init(power_mode_changed_cb_t cb)
+{
+	if (!device_is_ready(supply.dev)) {
+		LOG_ERR("Supply voltage ADC is not ready");
+		return -ENODEV;
+	}
+
+	int err = adc_channel_setup_dt(&supply);
+
+	if (err) {
+		LOG_ERR("Cannot set up supply voltage channel: %d", err);
+		return err;
+	}
+
+	changed_cb = cb;
+
+	/* Logging is on at boot, the first mode work switches it off without VBUS */
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	status.usb = true;
+
+	k_spin_unlock(&lock, key);
+
+	atomic_set(&vbus, nrf_power_usbregstatus_vbusdet_get(NRF_POWER));
+	k_work_submit(&mode_work);
+	k_work_reschedule(&sample_work, K_NO_WAIT);
+
+	return 0;
+}
+
+void power_mode_usb_status(enum usb_dc_status_code usb_status, const uint8_t *param)
+{
+	ARG_UNUSED(param);
+
+	/* The nRF USB driver reports VBUS detection and removal as connect and disconnect */
+	switch (usb_status) {
+	case USB_DC_CONNECTED:
+		atomic_set(&vbus, true);
+		break;
+	case USB_DC_DISCONNECTED:
+		atomic_set(&vbus, false);
+		break;
+	default:
+		return;
+	}
+
+	k_work_submit(&mode_work);
+}
+
+void power_mode_get_status(struct power_mode_status *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	*out = status;
+
+	k_spin_unlock(&lock, key);
+}
+
+#if defined(CONFIG_SHELL)
+
+static int cmd_power(const struct shell *sh, size_t argc, char **argv)
+{
+	struct power_mode_status s;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	power_mode_get_status(&s);
+
+	shell_print(sh, "%s power, supply %u mV", s.usb ? "USB" : "Battery", s.supply_mv);
+	shell_print(sh, "%u switches, %u samples, %u sample errors", s.switches, s.samples,
+		    s.sample_errors);
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((aqm), power, NULL, "Power source and supply voltage", cmd_power, 1, 0);
+
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef POWER_MODE_H
+#define POWER_MODE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/usb/usb_device.h>
+
+/* Supply voltage in mV rounded to the 100 mV resolution of the Power Configuration cluster */
+#define POWER_MODE_MV_TO_100MV(mv) (((mv) + 50) / 100)
+
+struct power_mode_status {
+	/* VBUS present, console and logging run */
+	bool usb;
+	/* Last supply voltage sample in mV, 0 before the first one */
+	uint16_t supply_mv;
+	/* Switches between USB and battery since boot */
+	uint32_t switches;
+	uint32_t samples;
+	uint32_t sample_errors;
+};
+
+/**
+ * @brief Called on the system workqueue when the USB state or the supply voltage changed.
+ */
+typedef void (*power_mode_changed_cb_t)(void);
+
+/**
+ * @brief Reads the VBUS state, applies the matching power mode and starts sampling the supply
+ *	  voltage every CONFIG_AIR_MONITOR_SUPPLY_SAMPLE_INTERVAL_SECONDS.
+ *
+ * @param changed_cb  Callback for USB state and supply voltage changes.
+ *
+ * @return 0 if success, error code if the ADC channel could not be set up.
+ */
+int power_mode_init(power_mode_changed_cb_t changed_cb);
+
+/**
+ * @brief USB device status callback, pass it to usb_enable().
+ *
+ * VBUS detection and removal switch the power mode, the switch runs on the system workqueue.
+ */
+void power_mode_usb_status(enum usb_dc_status_code status, const uint8_t *param);
+
+/**
+ * @brief Returns the current power mode and supply voltage. Safe to call from any thread.
+ */
+void power_mode_get_status(struct power_mode_status *status);
+
+#endif /* POWER_MODE_H */
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+
+#include "profiler.h"
+
+static struct k_spinlock lock;
+static struct profiler_stats table[PROFILER_STAGE_COUNT];
+
+static const char *const stage_names[] = {
+	[PROFILER_STAGE_DATA_READY] = "data_ready",
+	[PROFILER_STAGE_FETCH] = "fetch",
+	[PROFILER_STAGE_CHANNEL_GET] = "channel_get",
+	[PROFILER_STAGE_CONVERSION] = "conversion",
+	[PROFILER_STAGE_FILTER] = "filter",
+	[PROFILER_STAGE_SAMPLE_LOG] = "sample_log",
+	[PROFILER_STAGE_SET_ATTR] = "set_attr",
+	[PROFILER_STAGE_LED_UPDATE] = "led_update",
+};
+
+BUILD_ASSERT(ARRAY_SIZE(stage_names) == PROFILER_STAGE_COUNT, "Missing stage name");
+
+void profiler_record(enum profiler_stage stage, uint32_t cycles)
+{
+	/* Number of significant bits, i.e. floor(log2(cycles)) + 1 */
+	uint32_t bin = MIN(cycles ? 32 - __builtin_clz(cycles) : 0, PROFILER_HISTOGRAM_BINS - 1);
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	struct profiler_stats *stats = &table[stage];
+
+	stats->min = stats->count ? MIN(stats->min, cycles) : cycles;
+	stats->max = MAX(stats->max, cycles);
+	stats->total += cycles;
+	stats->count++;
+	stats->histogram[bin]++;
+
+	k_spin_unlock(&lock, key);
+}
+
+void profiler_init(void)
+{
+#if defined(CONFIG_AIR_MONITOR_PROFILING) && defined(CONFIG_CPU_CORTEX_M_HAS_DWT)
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+void profiler_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	memset(table, 0, sizeof(table));
+
+	k_spin_unlock(&lock, key);
+}
+
+void profiler_get(enum profiler_stage stage, struct profiler_stats *stats)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	*stats = table[stage];
+
+	k_spin_unlock(&lock, key);
+}
+
+const char *profiler_stage_name(enum profiler_stage stage)
+{
+	return stage_names[stage];
+}
+
+uint32_t profiler_cycles_per_sec(void)
+{
+#if defined(CONFIG_CPU_CORTEX_M_HAS_DWT)
+	return SystemCoreClock;
+#else
+	return sys_clock_hw_cycles_per_sec();
+#endif
+}
+
+#if defined(CONFIG_SHELL)
+
+static uint32_t cycles_to_us(uint64_t cycles)
+{
+	return (uint32_t)(cycles * USEC_PER_SEC / profiler_cycles_per_sec());
+}
+
+static int cmd_prof_show(const struct shell *sh, size_t argc, char **argv)
+{
+	struct profiler_stats stats;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	shell_print(sh, "%-12s %8s %8s %8s %8s  [us], cycle counter %u Hz", "stage", "count",
+		    "min", "avg", "max", profiler_cycles_per_sec());
+
+	for (int stage = 0; stage < PROFILER_STAGE_COUNT; stage++) {
+		profiler_get(stage, &stats);
+
+		if (!stats.count) {
+			shell_print(sh, "%-12s %8u", profiler_stage_name(stage), 0);
+			continue;
+		}
+
+		shell_print(sh, "%-12s %8u %8u %8u %8u", profiler_stage_name(stage), stats.count,
+			    cycles_to_us(stats.min), cycles_to_us(stats.total / stats.count),
+			    cycles_to_us(stats.max));
+
+		/* Histogram bins as "<upper bound in cycles>:<count>" */
+		for (int bin = 0; bin < PROFILER_HISTOGRAM_BINS - 1; bin++) {
+			if (stats.histogram[bin]) {
+				shell_fprintf(sh, SHELL_NORMAL, " <2^%d:%u", bin,
+					      stats.histogram[bin]);
+			}
+		}
+		if (stats.histogram[PROFILER_HISTOGRAM_BINS - 1]) {
+			shell_fprintf(sh, SHELL_NORMAL, " >=2^%d:%u", PROFILER_HISTOGRAM_BINS - 2,
+				      stats.histogram[PROFILER_HISTOGRAM_BINS - 1]);
+		}
+		shell_fprintf(sh, SHELL_NORMAL, "\n");
+	}
+
+	return 0;
+}
+
+static int cmd_prof_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	profiler_reset();
+	shell_print(sh, "Profiling statistics cleared");
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(prof_cmds,
+	SHELL_CMD(show, NULL, "Show per stage statistics and histograms", cmd_prof_show),
+	SHELL_CMD(reset, NULL, "Clear statistics", cmd_prof_reset),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_SUBCMD_ADD((aqm), prof, &prof_cmds, "Sample pipeline profiling", cmd_prof_show, 1, 0);
+
+#endif /* CONFIG_SHELL */
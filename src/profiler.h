@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+#if defined(CONFIG_AIR_MONITOR_PROFILING) && defined(CONFIG_CPU_CORTEX_M_HAS_DWT)
+#include <zephyr/arch/arm/aarch32/cortex_m/cmsis.h>
+#endif
+
+/* Stages of the sample pipeline, from the sensor thread to the ZBOSS thread */
+enum profiler_stage {
+	PROFILER_STAGE_DATA_READY,
+	PROFILER_STAGE_FETCH,
+	PROFILER_STAGE_CHANNEL_GET,
+	PROFILER_STAGE_CONVERSION,
+	PROFILER_STAGE_FILTER,
+	PROFILER_STAGE_SAMPLE_LOG,
+	PROFILER_STAGE_SET_ATTR,
+	PROFILER_STAGE_LED_UPDATE,
+	PROFILER_STAGE_COUNT,
+};
+
+/* Bin n counts durations of [2^(n-1), 2^n) cycles, the last bin everything longer */
+#define PROFILER_HISTOGRAM_BINS 24
+
+struct profiler_stats {
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t total;
+	uint32_t histogram[PROFILER_HISTOGRAM_BINS];
+};
+
+#if defined(CONFIG_AIR_MONITOR_PROFILING)
+
+/**
+ * @brief Returns the current cycle count.
+ *
+ * DWT counts CPU cycles, time the CPU sleeps inside a stage is not included. Other targets,
+ * like native_sim, fall back to the system clock cycle counter.
+ */
+static inline uint32_t profiler_cycles(void)
+{
+#if defined(CONFIG_CPU_CORTEX_M_HAS_DWT)
+	return DWT->CYCCNT;
+#else
+	return k_cycle_get_32();
+#endif
+}
+
+/**
+ * @brief Records duration of a single pass through the stage. Safe to call from any thread.
+ */
+void profiler_record(enum profiler_stage stage, uint32_t cycles);
+
+#define PROFILER_START(name) uint32_t name = profiler_cycles()
+#define PROFILER_STOP(stage, name) profiler_record(stage, profiler_cycles() - (name))
+
+#else
+
+#define PROFILER_START(name)
+#define PROFILER_STOP(stage, name)
+
+#endif /* CONFIG_AIR_MONITOR_PROFILING */
+
+/**
+ * @brief Enables the cycle counter.
+ */
+void profiler_init(void);
+
+/**
+ * @brief Clears statistics of all stages.
+ */
+void profiler_reset(void);
+
+/**
+ * @brief Copies statistics of the stage.
+ */
+void profiler_get(enum profiler_stage stage, struct profiler_stats *stats);
+
+/**
+ * @brief Returns the stage name.
+ */
+const char *profiler_stage_name(enum profiler_stage stage);
+
+/**
+ * @brief Returns the frequency of the cycle counter.
+ */
+uint32_t profiler_cycles_per_sec(void);
+
+#endif /* PROFILER_H */
@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+
+#include "report_gate.h"
+
+/* Smoothed values are kept in Q8 fixed point */
+#define EWMA_FRAC_BITS 8
+#define EWMA_ONE (1 << EWMA_FRAC_BITS)
+
+/* Larger shifts would stop the EWMA short of the input by a whole attribute unit */
+#define EWMA_SHIFT_MAX EWMA_FRAC_BITS
+
+struct report_gate {
+	struct report_gate_config config;
+	struct report_gate_stats stats;
+	bool primed;
+	bool reported;
+	int32_t ewma;
+	int32_t last_value;
+	int64_t last_timestamp;
+};
+
+#define REPORT_GATE_INIT(_ewma_shift, _band)                                                     \
+	{                                                                                          \
+		.config = {                                                                        \
+			.ewma_shift = (_ewma_shift),                                               \
+			.band = (_band),                                                           \
+			.min_interval_s = CONFIG_AIR_MONITOR_REPORT_GATE_MIN_INTERVAL_SECONDS,     \
+			.max_interval_s = CONFIG_AIR_MONITOR_REPORT_GATE_MAX_INTERVAL_SECONDS,     \
+		},                                                                                 \
+	}
+
+BUILD_ASSERT(CONFIG_AIR_MONITOR_REPORT_GATE_EWMA_SHIFT <= EWMA_SHIFT_MAX,
+	     "EWMA shift too large for the fixed point precision");
+
+/* CO2 readings already went through the CO2 filter, a second smoothing stage would only add
+ * lag, only the hysteresis applies
+ */
+#define CO2_EWMA_SHIFT                                                                             \
+	(IS_ENABLED(CONFIG_AIR_MONITOR_CO2_FILTER) ? 0 : CONFIG_AIR_MONITOR_REPORT_GATE_EWMA_SHIFT)
+
+static struct k_spinlock lock;
+static struct report_gate gates[REPORT_GATE_COUNT] = {
+	[REPORT_GATE_TEMPERATURE] = REPORT_GATE_INIT(CONFIG_AIR_MONITOR_REPORT_GATE_EWMA_SHIFT,
+						     CONFIG_AIR_MONITOR_REPORT_GATE_TEMPERATURE_BAND),
+	[REPORT_GATE_HUMIDITY] = REPORT_GATE_INIT(CONFIG_AIR_MONITOR_REPORT_GATE_EWMA_SHIFT,
+						  CONFIG_AIR_MONITOR_REPORT_GATE_HUMIDITY_BAND),
+	[REPORT_GATE_CO2] = REPORT_GATE_INIT(CO2_EWMA_SHIFT,
+					     CONFIG_AIR_MONITOR_REPORT_GATE_CO2_BAND_PPM),
+};
+
+/* Rounds the Q8 value to the nearest attribute unit, halves away from zero */
+static int32_t ewma_round(int32_t ewma)
+{
+	return (ewma >= 0 ? ewma + EWMA_ONE / 2 : ewma - EWMA_ONE / 2) / EWMA_ONE;
+}
+
+bool report_gate_filter(enum report_gate_channel channel, int32_t value, int64_t timestamp,
+			int32_t *output)
+{
+	struct report_gate *gate = &gates[channel];
+	int32_t target = value * EWMA_ONE;
+	bool pass;
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	if (!gate->primed) {
+		gate->primed = true;
+		gate->ewma = target;
+	} else {
+		gate->ewma += (target - gate->ewma) / (1 << gate->config.ewma_shift);
+	}
+
+	*output = ewma_round(gate->ewma);
+
+	if (!gate->reported) {
+		pass = true;
+	} else if (*output == gate->last_value) {
+		/* Nothing to write, the value is neither sent nor suppressed */
+		pass = false;
+	} else {
+		int64_t elapsed = timestamp - gate->last_timestamp;
+
+		if (elapsed < (int64_t)gate->config.min_interval_s * MSEC_PER_SEC) {
+			pass = false;
+		} else if (abs(*output - gate->last_value) > gate->config.band) {
+			pass = true;
+		} else {
+			/* Slow drift inside the band is written at the maximum interval */
+			pass = elapsed >= (int64_t)gate->config.max_interval_s * MSEC_PER_SEC;
+		}
+
+		if (!pass) {
+			gate->stats.suppressed++;
+		}
+	}
+
+	k_spin_unlock(&lock, key);
+
+	return pass;
+}
+
+void report_gate_sent(enum report_gate_channel channel, int32_t value, int64_t timestamp)
+{
+	struct report_gate *gate = &gates[channel];
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	gate->reported = true;
+	gate->last_value = value;
+	gate->last_timestamp = timestamp;
+	gate->stats.sent++;
+
+	k_spin_unlock(&lock, key);
+}
+
+void report_gate_configure(enum report_gate_channel channel,
+			   const struct report_gate_config *config)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	gates[channel].config = *config;
+	gates[channel].config.ewma_shift = MIN(config->ewma_shift, EWMA_SHIFT_MAX);
+
+	k_spin_unlock(&lock, key);
+}
+
+void report_gate_reset(enum report_gate_channel channel)
+{
+	struct report_gate *gate = &gates[channel];
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	struct report_gate_config config = gate->config;
+
+	memset(gate, 0, sizeof(*gate));
+	gate->config = config;
+
+	k_spin_unlock(&lock, key);
+}
+
+void report_gate_get(enum report_gate_channel channel, struct report_gate_config *config,
+		     struct report_gate_stats *stats)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	*config = gates[channel].config;
+	*stats = gates[channel].stats;
+
+	k_spin_unlock(&lock, key);
+}
+
+#if defined(CONFIG_SHELL)
+
+static const char *const channel_names[] = {
+	[REPORT_GATE_TEMPERATURE] = "temp",
+	[REPORT_GATE_HUMIDITY] = "humidity",
+	[REPORT_GATE_CO2] = "co2",
+};
+
+static int cmd_gate_show(const struct shell *sh, size_t argc, char **argv)
+{
+	struct report_gate_config config;
+	struct report_gate_stats stats;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	for (int channel = 0; channel < REPORT_GATE_COUNT; channel++) {
+		report_gate_get(channel, &config, &stats);
+
+		shell_print(sh, "%-8s shift %u band %u interval %u-%u s: sent %u suppressed %u",
+			    channel_names[channel], config.ewma_shift, config.band,
+			    config.min_interval_s, config.max_interval_s, stats.sent,
+			    stats.suppressed);
+	}
+
+	return 0;
+}
+
+static int cmd_gate_set(const struct shell *sh, size_t argc, char **argv)
+{
+	struct report_gate_config config = {
+		.ewma_shift = (uint8_t)strtoul(argv[2], NULL, 0),
+		.band = (uint16_t)strtoul(argv[3], NULL, 0),
+		.min_interval_s = (uint16_t)strtoul(argv[4], NULL, 0),
+		.max_interval_s = (uint16_t)strtoul(argv[5], NULL, 0),
+	};
+
+	ARG_UNUSED(argc);
+
+	for (int channel = 0; channel < REPORT_GATE_COUNT; channel++) {
+		if (!strcmp(argv[1], channel_names[channel])) {
+			report_gate_configure(channel, &config);
+			return 0;
+		}
+	}
+
+	shell_error(sh, "Unknown channel %s, use temp, humidity or co2", argv[1]);
+
+	return -EINVAL;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(gate_cmds,
+	SHELL_CMD(show, NULL, "Show configuration and sent/suppressed counters", cmd_gate_show),
+	SHELL_CMD_ARG(set, NULL, "<temp|humidity|co2> <ewma shift> <band> <min s> <max s>",
+		      cmd_gate_set, 6, 0),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_SUBCMD_ADD((aqm), gate, &gate_cmds, "Report gate", cmd_gate_show, 1, 0);
+
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef REPORT_GATE_H
+#define REPORT_GATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Measurements gated before they are written to the attribute store */
+enum report_gate_channel {
+	REPORT_GATE_TEMPERATURE,
+	REPORT_GATE_HUMIDITY,
+	REPORT_GATE_CO2,
+	REPORT_GATE_COUNT,
+};
+
+struct report_gate_config {
+	/* EWMA weight of a new value is 1/2^ewma_shift, 0 disables smoothing */
+	uint8_t ewma_shift;
+	/* Smoothed value is written once it moves more than this from the last written one,
+	 * in attribute units (0.01 degree Celsius, 0.01 %, ppm)
+	 */
+	uint16_t band;
+	/* Values are not written more often than this */
+	uint16_t min_interval_s;
+	/* Smoothed value is written after this time even if it stays in the band */
+	uint16_t max_interval_s;
+};
+
+struct report_gate_stats {
+	/* Values written to the attribute store */
+	uint32_t sent;
+	/* Values differing from the last written one that were held back */
+	uint32_t suppressed;
+};
+
+/**
+ * @brief Smooths a new value and decides whether it is written to the attribute store.
+ *
+ * @param channel      Gated measurement.
+ * @param value        New value in attribute units.
+ * @param timestamp    Uptime of the measurement in milliseconds.
+ * @param[out] output  Smoothed value to write.
+ *
+ * @return true if the smoothed value should be written, report_gate_sent() must follow
+ *	   once it was.
+ */
+bool report_gate_filter(enum report_gate_channel channel, int32_t value, int64_t timestamp,
+			int32_t *output);
+
+/**
+ * @brief Records that the value returned by report_gate_filter() was written.
+ */
+void report_gate_sent(enum report_gate_channel channel, int32_t value, int64_t timestamp);
+
+/**
+ * @brief Replaces the configuration of a channel, the smoothed value is kept.
+ */
+void report_gate_configure(enum report_gate_channel channel,
+			   const struct report_gate_config *config);
+
+/**
+ * @brief Drops the smoothed value, the last written value and the statistics of a channel,
+ *	  the configuration is kept.
+ */
+void report_gate_reset(enum report_gate_channel channel);
+
+/**
+ * @brief Returns configuration and statistics of a channel. Safe to call from any thread.
+ */
+void report_gate_get(enum report_gate_channel channel, struct report_gate_config *config,
+		     struct report_gate_stats *stats);
+
+#endif /* REPORT_GATE_H */
@@ -4,13 +4,19 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <stdlib.h>
+#include <string.h>
 #include <zephyr/kernel.h>
-#include <zephyr/drivers/led_strip.h>
 #include <zephyr/device.h>
+#include <zephyr/drivers/led_strip.h>
 #include <zephyr/drivers/spi.h>
+#include <zephyr/dt-bindings/led/led.h>
+#include <zephyr/shell/shell.h>
 #include <zephyr/sys/util.h>
 #include <zephyr/logging/log.h>
 
+#include "bus_pm.h"
+#include "profiler.h"
 #include "rgb_led.h"
 
 LOG_MODULE_REGISTER(rgb_led, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
@@ -18,75 +24,398 @@ LOG_MODULE_REGISTER(rgb_led, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
 #define STRIP_NODE DT_ALIAS(led_strip)
 #define STRIP_NUM_PIXELS DT_PROP(DT_ALIAS(led_strip), chain_length)
 
-#define RGB(_r, _g, _b) { .r = (_r), .g = (_g), .b = (_b) }
+/* CO2 breakpoints of the gradient: green up to GOOD, orange at MODERATE, red from POOR */
+#define CO2_GOOD_PPM CONFIG_AIR_MONITOR_LED_CO2_GOOD_PPM
+#define CO2_MODERATE_PPM CONFIG_AIR_MONITOR_LED_CO2_MODERATE_PPM
+#define CO2_POOR_PPM CONFIG_AIR_MONITOR_LED_CO2_POOR_PPM
+
+BUILD_ASSERT(CO2_GOOD_PPM < CO2_MODERATE_PPM && CO2_MODERATE_PPM < CO2_POOR_PPM,
+	     "LED CO2 breakpoints must be increasing");
+
+/* Breakpoint colours in perceived intensity 0 - 255, before gamma */
+#define GOOD_R 0
+#define GOOD_G 255
+#define GOOD_B 0
+#define MODERATE_R 255
+#define MODERATE_G 180
+#define MODERATE_B 0
+#define POOR_R 255
+#define POOR_G 0
+#define POOR_B 0
+
+#define GRADIENT_SIZE 256
+#define GRADIENT_MAX (GRADIENT_SIZE - 1)
+
+/* Brightness levels of fades and breathing, level 0 is off */
+#define LEVELS CONFIG_AIR_MONITOR_LED_LEVELS
+#define LEVEL_MAX (LEVELS - 1)
+
+/* Breathing swings between full and a third of the brightness */
+#define BREATHE_LEVEL_MIN (LEVELS / 3)
+
+#define FADE_STEP_MSEC MAX(CONFIG_AIR_MONITOR_LED_FADE_MSEC / LEVEL_MAX, 1)
+#define BREATHE_STEP_MSEC \
+	MAX(CONFIG_AIR_MONITOR_LED_BREATHE_PERIOD_MSEC / (2 * (LEVEL_MAX - BREATHE_LEVEL_MIN)), 1)
+
+/* Breathing stops at full brightness after this many periods, 0 breathes for as long as the
+ * air quality stays poor
+ */
+#define BREATHE_CYCLES CONFIG_AIR_MONITOR_LED_BREATHE_CYCLES
+
+BUILD_ASSERT(LEVELS >= 4 && LEVELS <= 64, "Fades and breathing need 4 to 64 brightness levels");
+
+/* Gradient entry i stands for GOOD + i * (POOR - GOOD) / 255 ppm. Colours are interpolated
+ * in perceived intensity, then gamma corrected (square law) and capped at BRIGHTNESS_MAX.
+ */
+#define GRADIENT_PPM(i) (CO2_GOOD_PPM + (i) * (CO2_POOR_PPM - CO2_GOOD_PPM) / GRADIENT_MAX)
+#define LERP(a, b, x, x0, x1) ((a) + ((b) - (a)) * ((x) - (x0)) / ((x1) - (x0)))
+#define GRADIENT_P(i, c)                                                                           \
+	(GRADIENT_PPM(i) <= CO2_MODERATE_PPM                                                       \
+		 ? LERP(GOOD_##c, MODERATE_##c, GRADIENT_PPM(i), CO2_GOOD_PPM,                    \
+			CO2_MODERATE_PPM)                                                          \
+		 : LERP(MODERATE_##c, POOR_##c, GRADIENT_PPM(i), CO2_MODERATE_PPM,                \
+			CO2_POOR_PPM))
+#define GAMMA(p) ((CONFIG_AIR_MONITOR_LED_BRIGHTNESS_MAX * (p) * (p) + 255 * 255 / 2) / (255 * 255))
+#define GRADIENT_ENTRY(i, ...)                                                                     \
+	{                                                                                          \
+		.r = GAMMA(GRADIENT_P(i, R)), .g = GAMMA(GRADIENT_P(i, G)),                        \
+		.b = GAMMA(GRADIENT_P(i, B)),                                                      \
+	}
+
+BUILD_ASSERT(CONFIG_AIR_MONITOR_LED_BRIGHTNESS_MAX <= UINT8_MAX, "Brightness cap is 8 bits");
 
-static const struct led_rgb colors[] = {
-	RGB(0x20, 0x00, 0x00), /* red */
-	RGB(0x00, 0x20, 0x00), /* green */
-	RGB(0x20, 0x10, 0x00), /* orange */
-	RGB(0x00, 0x00, 0x00), /* black=off */
+static const struct led_rgb gradient[GRADIENT_SIZE] = {
+	LISTIFY(GRADIENT_SIZE, GRADIENT_ENTRY, (,))
 };
 
-struct led_rgb pixel;
-size_t current_color = SIZE_MAX;
-static const struct device *const strip = DEVICE_DT_GET(STRIP_NODE);
-bool active = false;
+/* WS2812 bits are sent as SPI bytes, MSB first, in the channel order of color-mapping */
+#define WS_ONE DT_PROP(STRIP_NODE, spi_one_frame)
+#define WS_ZERO DT_PROP(STRIP_NODE, spi_zero_frame)
+#define WS_BITS_PER_BYTE 8
+#define WS_BITS_PER_PIXEL 24
 
-void rgb_led_init(void)
+#define WS_BIT(v, n) ((((v) >> (n)) & 1) ? WS_ONE : WS_ZERO)
+#define WS_BYTE(v, ...)                                                                            \
+	{                                                                                          \
+		WS_BIT(v, 7), WS_BIT(v, 6), WS_BIT(v, 5), WS_BIT(v, 4), WS_BIT(v, 3),              \
+			WS_BIT(v, 2), WS_BIT(v, 1), WS_BIT(v, 0)                                   \
+	}
+#define WS_CHANNEL(idx, rgb)                                                                       \
+	(DT_PROP_BY_IDX(STRIP_NODE, color_mapping, idx) == LED_COLOR_ID_RED     ? (rgb)->r       \
+	 : DT_PROP_BY_IDX(STRIP_NODE, color_mapping, idx) == LED_COLOR_ID_GREEN ? (rgb)->g       \
+										 : (rgb)->b)
+
+BUILD_ASSERT(DT_PROP_LEN(STRIP_NODE, color_mapping) == 3, "Only RGB strips are supported");
+
+/* SPI bitstream of every channel value, encoded by the compiler and kept in flash */
+static const uint8_t encoded[256][WS_BITS_PER_BYTE] = {
+	LISTIFY(256, WS_BYTE, (,))
+};
+
+enum led_animation {
+	LED_ANIMATION_NONE,
+	LED_ANIMATION_FADE_OUT,
+	LED_ANIMATION_FADE_IN,
+	LED_ANIMATION_GLIDE,
+	LED_ANIMATION_BREATHE,
+};
+
+static const struct spi_dt_spec bus =
+	SPI_DT_SPEC_GET(STRIP_NODE, SPI_OP_MODE_MASTER | SPI_TRANSFER_MSB | SPI_WORD_SET(8), 0);
+
+/* EasyDMA reads RAM only, the cached channel bitstreams are copied for every pixel */
+static uint8_t tx_frame[STRIP_NUM_PIXELS * WS_BITS_PER_PIXEL];
+
+static void animation_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(animation_work, animation_work_handler);
+
+/* Requested by any thread under lock */
+static struct k_spinlock lock;
+static bool active;
+static bool indicated;
+static uint16_t indicated_ppm;
+static uint8_t target_index;
+
+/* Owned by the animation work */
+static bool shown_on;
+static uint8_t shown_index;
+static uint8_t shown_level;
+static uint8_t goal_index;
+static enum led_animation animation;
+static int64_t animation_start;
+static uint8_t animation_from;
+static uint8_t glide_from;
+static bool breathed;
+static struct led_rgb sent;
+
+static struct rgb_led_stats stats;
+
+static uint8_t gradient_index(uint16_t co2)
 {
-	if (device_is_ready(strip)) {
-		LOG_DBG("Found LED strip device %s", strip->name);
-	} else {
-		LOG_ERR("LED strip device %s is not ready", strip->name);
-		return;
+	if (co2 <= CO2_GOOD_PPM) {
+		return 0;
 	}
+
+	if (co2 >= CO2_POOR_PPM) {
+		return GRADIENT_MAX;
+	}
+
+	return (uint8_t)((co2 - CO2_GOOD_PPM) * GRADIENT_MAX / (CO2_POOR_PPM - CO2_GOOD_PPM));
 }
 
-void rgb_led_update_color(size_t color)
+/* Sends the gradient colour at the brightness level, unless the strip already shows it */
+static void led_show(uint8_t index, uint8_t level)
 {
-	if (!active) {
+	/* Levels are perceived brightness as well, hence squared */
+	uint32_t scale = level * level;
+	uint32_t scale_max = LEVEL_MAX * LEVEL_MAX;
+	struct led_rgb rgb = {
+		.r = (uint8_t)(gradient[index].r * scale / scale_max),
+		.g = (uint8_t)(gradient[index].g * scale / scale_max),
+		.b = (uint8_t)(gradient[index].b * scale / scale_max),
+	};
+	const struct spi_buf buf = { .buf = tx_frame, .len = sizeof(tx_frame) };
+	const struct spi_buf_set tx = { .buffers = &buf, .count = 1 };
+
+	if (rgb.r == sent.r && rgb.g == sent.g && rgb.b == sent.b) {
+		/* Neighbouring steps often round to the same colour */
+		k_spinlock_key_t key = k_spin_lock(&lock);
+
+		stats.unchanged++;
+
+		k_spin_unlock(&lock, key);
 		return;
 	}
-	current_color = color;
-	memset(&pixel, 0x00, sizeof(pixel));
-	memcpy(&pixel, &colors[current_color], sizeof(struct led_rgb));
-	int rc = led_strip_update_rgb(strip, &pixel, STRIP_NUM_PIXELS);
-	if (rc) {
-		LOG_ERR("couldn't update strip: %d", rc);
+
+	PROFILER_START(led_update);
+
+	for (int i = 0; i < STRIP_NUM_PIXELS; i++) {
+		uint8_t *pixel = &tx_frame[i * WS_BITS_PER_PIXEL];
+
+		memcpy(&pixel[0], encoded[WS_CHANNEL(0, &rgb)], WS_BITS_PER_BYTE);
+		memcpy(&pixel[8], encoded[WS_CHANNEL(1, &rgb)], WS_BITS_PER_BYTE);
+		memcpy(&pixel[16], encoded[WS_CHANNEL(2, &rgb)], WS_BITS_PER_BYTE);
 	}
+
+	int err = bus_pm_get(BUS_PM_LED_SPI);
+	uint32_t bus_on = k_cycle_get_32();
+
+	if (!err) {
+		/* Whole chain in one transfer, the line idles low for the reset afterwards */
+		err = spi_write_dt(&bus, &tx);
+		bus_on = k_cycle_get_32() - bus_on;
+		bus_pm_put(BUS_PM_LED_SPI);
+	}
+
+	PROFILER_STOP(PROFILER_STAGE_LED_UPDATE, led_update);
+
+	if (err) {
+		LOG_ERR("couldn't update strip: %d", err);
+		return;
+	}
+
+	sent = rgb;
+
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	stats.frames++;
+	stats.bus_on_cycles += bus_on;
+
+	k_spin_unlock(&lock, key);
 }
 
-void rgb_led_toggle_state(void)
+/* Picks the animation leading from the shown state to the goal */
+static void animation_plan(bool on, int64_t now)
 {
-	if (active) {
-		current_color = 3;
-		rgb_led_update_color(current_color);
-		active = !active;
+	animation_start = now;
+	animation_from = shown_level;
+
+	if (!on) {
+		animation = shown_level ? LED_ANIMATION_FADE_OUT : LED_ANIMATION_NONE;
+	} else if (shown_level == 0) {
+		shown_index = goal_index;
+		animation = LED_ANIMATION_FADE_IN;
+	} else if (shown_index != goal_index) {
+		glide_from = shown_index;
+		animation = LED_ANIMATION_GLIDE;
+	} else if (goal_index == GRADIENT_MAX && !breathed) {
+		animation = LED_ANIMATION_BREATHE;
+	} else if (shown_level < LEVEL_MAX) {
+		animation = LED_ANIMATION_FADE_IN;
 	} else {
-		active = !active;
-		if (current_color != SIZE_MAX) {
-			rgb_led_update_color(current_color);
+		animation = LED_ANIMATION_NONE;
+	}
+}
+
+/* Advances the animation to now, returns the delay to the next step or -1 when done */
+static int32_t animation_step(int64_t now)
+{
+	int64_t elapsed = now - animation_start;
+	int32_t steps = (int32_t)(elapsed / FADE_STEP_MSEC);
+	int32_t next = FADE_STEP_MSEC - elapsed % FADE_STEP_MSEC;
+
+	switch (animation) {
+	case LED_ANIMATION_FADE_OUT:
+		if (steps < animation_from) {
+			shown_level = animation_from - steps;
+			return next;
+		}
+
+		shown_level = 0;
+		return -1;
+	case LED_ANIMATION_FADE_IN:
+		if (animation_from + steps < LEVEL_MAX) {
+			shown_level = animation_from + steps;
+			return next;
+		}
+
+		shown_level = LEVEL_MAX;
+		return -1;
+	case LED_ANIMATION_GLIDE:
+		/* Along the gradient towards full brightness, in as many steps as a fade */
+		if (steps < LEVEL_MAX) {
+			int32_t index_span = (int32_t)goal_index - glide_from;
+			int32_t level_span = LEVEL_MAX - animation_from;
+
+			shown_index = glide_from + index_span * steps / LEVEL_MAX;
+			shown_level = animation_from + level_span * steps / LEVEL_MAX;
+			return next;
 		}
+
+		shown_index = goal_index;
+		shown_level = LEVEL_MAX;
+		return -1;
+	case LED_ANIMATION_BREATHE: {
+		/* Triangle from full brightness down to BREATHE_LEVEL_MIN and back */
+		int32_t span = LEVEL_MAX - BREATHE_LEVEL_MIN;
+		int64_t breathe_steps = elapsed / BREATHE_STEP_MSEC;
+
+		if (BREATHE_CYCLES && breathe_steps >= (int64_t)BREATHE_CYCLES * 2 * span) {
+			/* Stays red at full brightness, the work is not rescheduled */
+			breathed = true;
+			shown_level = LEVEL_MAX;
+			return -1;
+		}
+
+		steps = (int32_t)(breathe_steps % (2 * span));
+		shown_level = LEVEL_MAX - (steps < span ? steps : 2 * span - steps);
+		return BREATHE_STEP_MSEC - elapsed % BREATHE_STEP_MSEC;
+	}
+	default:
+		return -1;
 	}
 }
 
-void rgb_led_red(void)
+static void animation_work_handler(struct k_work *work)
 {
-	if (current_color != 0) {
-		rgb_led_update_color(0);
+	int64_t now = k_uptime_get();
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	bool on = active && indicated;
+	uint8_t index = target_index;
+
+	stats.wakeups++;
+
+	k_spin_unlock(&lock, key);
+
+	if (on != shown_on || (on && index != goal_index)) {
+		shown_on = on;
+		goal_index = index;
+		/* Switching on or reaching poor air quality again breathes again */
+		breathed = false;
+		animation_plan(on, now);
+	}
+
+	int32_t next = animation_step(now);
+
+	if (next < 0 && on && animation != LED_ANIMATION_NONE) {
+		/* Arrived, at poor air quality breathing follows */
+		animation_plan(on, now);
+		next = animation_step(now);
+	}
+
+	led_show(shown_index, shown_level);
+
+	if (next >= 0) {
+		k_work_reschedule(&animation_work, K_MSEC(next));
 	}
 }
 
-void rgb_led_green(void)
+void rgb_led_init(void)
 {
-	if (current_color != 1) {
-		rgb_led_update_color(1);
+	if (!spi_is_ready_dt(&bus)) {
+		LOG_ERR("LED strip bus %s is not ready", bus.bus->name);
+		return;
 	}
+
+	LOG_DBG("LED strip on %s, %zu bytes of gradient and pre-encoded bits", bus.bus->name,
+		sizeof(gradient) + sizeof(encoded));
+
+	/* Bus stays suspended between frames */
+	bus_pm_init(BUS_PM_LED_SPI, bus.bus);
 }
 
-void rgb_led_orange(void)
+void rgb_led_toggle_state(void)
 {
-	if (current_color != 2) {
-		rgb_led_update_color(2);
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	active = !active;
+
+	k_spin_unlock(&lock, key);
+
+	k_work_reschedule(&animation_work, K_NO_WAIT);
+}
+
+void rgb_led_indicate_co2(uint16_t co2)
+{
+	bool changed = false;
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	/* Hysteresis: noise around the indicated concentration does not move the colour */
+	if (!indicated ||
+	    abs((int32_t)co2 - indicated_ppm) > CONFIG_AIR_MONITOR_LED_HYSTERESIS_PPM) {
+		uint8_t index = gradient_index(co2);
+
+		changed = !indicated || index != target_index;
+		indicated = true;
+		indicated_ppm = co2;
+		target_index = index;
+	}
+
+	k_spin_unlock(&lock, key);
+
+	if (changed) {
+		k_work_reschedule(&animation_work, K_NO_WAIT);
 	}
-}
\ No newline at end of file
+}
+
+void rgb_led_get_stats(struct rgb_led_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	*out = stats;
+
+	k_spin_unlock(&lock, key);
+}
+
+#if defined(CONFIG_SHELL)
+
+static int cmd_led(const struct shell *sh, size_t argc, char **argv)
+{
+	struct rgb_led_stats s;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	rgb_led_get_stats(&s);
+
+	shell_print(sh, "LED: %u frames in %u wakeups, %u unchanged, bus on %u us per frame",
+		    s.frames, s.wakeups, s.unchanged,
+		    s.frames ? (uint32_t)(k_cyc_to_us_floor64(s.bus_on_cycles) / s.frames) : 0);
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((aqm), led, NULL, "LED animation statistics", cmd_led, 1, 0);
+
+#endif /* CONFIG_SHELL */
@@ -7,11 +7,28 @@
 #ifndef RGB_LED_H
 #define RGB_LED_H
 
+#include <stdint.h>
+
+struct rgb_led_stats {
+	/* Frames sent to the strip */
+	uint32_t frames;
+	/* Runs of the animation work, one per brightness step */
+	uint32_t wakeups;
+	/* Steps skipped because they rounded to the colour already shown */
+	uint32_t unchanged;
+	/* Time the SPI bus was powered for the frames, in hardware cycles */
+	uint64_t bus_on_cycles;
+};
+
 void rgb_led_init(void);
 void rgb_led_toggle_state(void);
 
-void rgb_led_green(void);
-void rgb_led_orange(void);
-void rgb_led_red(void);
+/* Shows air quality indication for given CO2 concentration in ppm, as a colour of the
+ * green - orange - red gradient
+ */
+void rgb_led_indicate_co2(uint16_t co2);
+
+/* Returns animation statistics, safe to call from any thread */
+void rgb_led_get_stats(struct rgb_led_stats *stats);
 
 #endif /* RGB_LED_H */
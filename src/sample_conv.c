@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/sys/util.h>
+
+#include "sample_conv.h"
+
+/* sensor_value.val2 is expressed in millionths */
+#define SENSOR_VALUE_VAL2_SCALE 1000000
+
+/* ZCL MeasuredValue for temperature and humidity is 100x the measured value */
+#define ZCL_CENTI_DIVISOR (SENSOR_VALUE_VAL2_SCALE / 100)
+
+/* ZCL 4.13.2.1.1: CO2 MeasuredValue is a fraction of 1, i.e. ppm * 1e-6.
+ * In micro-ppm (val1 * 1e6 + val2) the divisor becomes 1e12.
+ */
+#define ZCL_CO2_FRACTION_DIVISOR 1000000000000ULL
+
+/* ZCL 4.4.2.2.1.1: 0x8000 means invalid, -273.15 is the physical minimum */
+#define ZCL_TEMPERATURE_MIN (-27315)
+#define ZCL_TEMPERATURE_MAX INT16_MAX
+#define ZCL_HUMIDITY_MAX 10000
+
+/* SCD4x datasheet chapter 3.5.2: signal words span 175 degrees from -45 and 100 % RH */
+#define SCD4X_TEMPERATURE_OFFSET_MICRO (45LL * SENSOR_VALUE_VAL2_SCALE)
+#define SCD4X_TEMPERATURE_SPAN_MICRO (175LL * SENSOR_VALUE_VAL2_SCALE)
+#define SCD4X_HUMIDITY_SPAN_MICRO (100LL * SENSOR_VALUE_VAL2_SCALE)
+#define SCD4X_TICKS 65536
+
+#define IEEE754_SINGLE_EXPONENT_BIAS 127
+#define IEEE754_SINGLE_MANTISSA_BITS 23
+
+/* IEEE 754 double: 52 fraction bits */
+#define IEEE754_DOUBLE_MANTISSA_BITS 52
+
+/* The firmware before sample_conv converted with (int16_t)(sensor_value_to_double(val) * 100).
+ * Where the value is a whole number n of centi units the double product may land just below n
+ * and truncate one count toward zero, e.g. 22.29 gave 2228. The double steps are replayed here
+ * with integers so attribute values stay bit-identical to that path.
+ *
+ * Returns 1 if the double path truncates n = 100 * v1 + k to n - 1, for the magnitudes v1 of
+ * val1 and 0 < k < 100 of val2 / 10000.
+ */
+static int32_t centi_double_correction(uint32_t v1, uint32_t k)
+{
+	uint32_t t = 1;
+	int64_t diff;
+	uint32_t scale;
+
+	/* a = k / 100 in double, m * 2^-(52 + t) with 2^52 <= m < 2^53 */
+	while ((k << t) < 100) {
+		t++;
+	}
+
+	uint64_t num = (uint64_t)k << (IEEE754_DOUBLE_MANTISSA_BITS + t - 2);
+	uint64_t m = num / 25;
+
+	/* The divisor is odd, the remainder is never exactly one half */
+	if (2 * (num % 25) > 25) {
+		m++;
+	}
+
+	if (v1 == 0) {
+		/* b = a, the product 100 * b differs from n = k by diff * 2^-scale */
+		scale = IEEE754_DOUBLE_MANTISSA_BITS + t;
+		diff = (int64_t)(100 * m) - (int64_t)((uint64_t)k << scale);
+	} else {
+		uint32_t e = 31 - __builtin_clz(v1);
+		uint32_t shift = t + e;
+		uint64_t q = m >> shift;
+		uint64_t rem = m & BIT64_MASK(shift);
+		uint64_t half = BIT64(shift - 1);
+
+		/* b = v1 + a rounds a to the 2^(e - 52) resolution of b, ties to even */
+		if (rem > half || (rem == half && (q & 1))) {
+			q++;
+		}
+
+		scale = IEEE754_DOUBLE_MANTISSA_BITS - e;
+		diff = (int64_t)(100 * q) - (int64_t)((uint64_t)k << scale);
+	}
+
+	if (diff >= 0) {
+		return 0;
+	}
+
+	/* The product rounds up to n when it is within half the spacing of doubles below n */
+	uint64_t n = 100ULL * v1 + k;
+	uint32_t exponent = 63 - __builtin_clzll(n);
+
+	if (IS_POWER_OF_TWO(n)) {
+		exponent--;
+	}
+
+	return -diff > (int64_t)BIT64(exponent - IEEE754_DOUBLE_MANTISSA_BITS - 1 + scale) ? 1 : 0;
+}
+
+static int32_t sensor_value_to_centi(const struct sensor_value *val)
+{
+	/* val1 and val2 always carry the same sign, division truncates toward zero */
+	int64_t centi = (int64_t)val->val1 * 100 + val->val2 / ZCL_CENTI_DIVISOR;
+
+	if (val->val2 != 0 && val->val2 % ZCL_CENTI_DIVISOR == 0) {
+		int32_t correction = centi_double_correction(abs(val->val1),
+							     abs(val->val2) / ZCL_CENTI_DIVISOR);
+
+		centi += val->val2 < 0 ? correction : -correction;
+	}
+
+	return (int32_t)CLAMP(centi, INT32_MIN, INT32_MAX);
+}
+
+int16_t sample_conv_temperature(const struct sensor_value *val)
+{
+	return (int16_t)CLAMP(sensor_value_to_centi(val), ZCL_TEMPERATURE_MIN, ZCL_TEMPERATURE_MAX);
+}
+
+uint16_t sample_conv_humidity(const struct sensor_value *val)
+{
+	return (uint16_t)CLAMP(sensor_value_to_centi(val), 0, ZCL_HUMIDITY_MAX);
+}
+
+uint16_t sample_conv_co2_ppm(const struct sensor_value *val)
+{
+	return (uint16_t)CLAMP(val->val1, 0, UINT16_MAX);
+}
+
+/* Encodes num / den as IEEE 754 single precision, num and den must be non-zero
+ * and den must stay below 2^52 so that the shifts below cannot overflow.
+ */
+static uint32_t ieee754_single_from_ratio(uint64_t num, uint64_t den)
+{
+	int32_t exponent = 0;
+	uint32_t mantissa = 0;
+
+	/* Normalize so that 1 <= num / den < 2 */
+	while (num >= (den << 1)) {
+		den <<= 1;
+		exponent++;
+	}
+	while (num < den) {
+		num <<= 1;
+		exponent--;
+	}
+
+	/* Long division producing the implicit bit and the 23 fraction bits */
+	for (int i = 0; i <= IEEE754_SINGLE_MANTISSA_BITS; i++) {
+		mantissa <<= 1;
+		if (num >= den) {
+			num -= den;
+			mantissa |= 1;
+		}
+		num <<= 1;
+	}
+
+	/* num now holds twice the remainder: round to nearest, ties to even */
+	if (num > den || (num == den && (mantissa & 1))) {
+		mantissa++;
+		if (mantissa == BIT(IEEE754_SINGLE_MANTISSA_BITS + 1)) {
+			mantissa >>= 1;
+			exponent++;
+		}
+	}
+
+	return ((uint32_t)(exponent + IEEE754_SINGLE_EXPONENT_BIAS)
+		<< IEEE754_SINGLE_MANTISSA_BITS) |
+	       (mantissa & BIT_MASK(IEEE754_SINGLE_MANTISSA_BITS));
+}
+
+uint32_t sample_conv_co2_fraction(const struct sensor_value *val)
+{
+	int64_t micro_ppm = (int64_t)val->val1 * SENSOR_VALUE_VAL2_SCALE + val->val2;
+
+	if (micro_ppm <= 0) {
+		/* Negative concentration is not physical, encode +0.0 */
+		return 0;
+	}
+
+	if (val->val2 == 0 && val->val1 < (int32_t)BIT(FLT_MANT_DIG)) {
+		/* Whole ppm, as the SCD4x reports them: both operands are exact in single
+		 * precision and the FPU division rounds to nearest even like the long division
+		 */
+		float fraction = (float)val->val1 / (float)SENSOR_VALUE_VAL2_SCALE;
+		uint32_t bits;
+
+		memcpy(&bits, &fraction, sizeof(bits));
+
+		return bits;
+	}
+
+	return ieee754_single_from_ratio((uint64_t)micro_ppm, ZCL_CO2_FRACTION_DIVISOR);
+}
+
+/* Rounds micro / span * 2^16 to the nearest tick */
+static uint16_t sensor_value_to_ticks(int64_t micro, int64_t span)
+{
+	int64_t ticks = (micro * SCD4X_TICKS + span / 2) / span;
+
+	return (uint16_t)CLAMP(ticks, 0, UINT16_MAX);
+}
+
+uint16_t sample_conv_temperature_ticks(const struct sensor_value *val)
+{
+	int64_t micro = (int64_t)val->val1 * SENSOR_VALUE_VAL2_SCALE + val->val2;
+
+	return sensor_value_to_ticks(micro + SCD4X_TEMPERATURE_OFFSET_MICRO,
+				     SCD4X_TEMPERATURE_SPAN_MICRO);
+}
+
+uint16_t sample_conv_humidity_ticks(const struct sensor_value *val)
+{
+	int64_t micro = (int64_t)val->val1 * SENSOR_VALUE_VAL2_SCALE + val->val2;
+
+	return sensor_value_to_ticks(micro, SCD4X_HUMIDITY_SPAN_MICRO);
+}
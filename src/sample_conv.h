@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SAMPLE_CONV_H
+#define SAMPLE_CONV_H
+
+#include <stdint.h>
+#include <zephyr/drivers/sensor.h>
+
+/**
+ * @brief Converts temperature to ZCL MeasuredValue (0.01 degree Celsius).
+ *
+ * Integer only, truncates toward zero and saturates to the valid attribute range. Bit-identical
+ * to (int16_t)(sensor_value_to_double(val) * 100) within the range.
+ */
+int16_t sample_conv_temperature(const struct sensor_value *val);
+
+/**
+ * @brief Converts relative humidity to ZCL MeasuredValue (0.01 %).
+ *
+ * Integer only, truncates toward zero and saturates to 0 - 100 %, bit-identical to the double
+ * conversion like sample_conv_temperature().
+ */
+uint16_t sample_conv_humidity(const struct sensor_value *val);
+
+/**
+ * @brief Converts CO2 concentration to whole ppm, truncated and saturated to 16 bits.
+ */
+uint16_t sample_conv_co2_ppm(const struct sensor_value *val);
+
+/**
+ * @brief Converts CO2 concentration to ZCL MeasuredValue (fraction of 1, ppm * 1e-6).
+ *
+ * Rounded to nearest, ties to even. Whole ppm are divided in single precision, fractional
+ * values are encoded with integer long division.
+ *
+ * @return Bit pattern of the single precision value.
+ */
+uint32_t sample_conv_co2_fraction(const struct sensor_value *val);
+
+/**
+ * @brief Converts temperature back to the SCD4x signal word, T = -45 + 175 * ticks / 2^16.
+ *
+ * Rounds to the nearest tick and saturates to 16 bits.
+ */
+uint16_t sample_conv_temperature_ticks(const struct sensor_value *val);
+
+/**
+ * @brief Converts relative humidity back to the SCD4x signal word, RH = 100 * ticks / 2^16.
+ *
+ * Rounds to the nearest tick and saturates to 16 bits.
+ */
+uint16_t sample_conv_humidity_ticks(const struct sensor_value *val);
+
+#endif /* SAMPLE_CONV_H */
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Sample path shared by the Zigbee application and the native_sim run */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "flash_log.h"
+#include "history.h"
+#include "offline_manager.h"
+#include "rgb_led.h"
+#include "sample_pipeline.h"
+#include "sensor_thread.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
+
+/* Newest sample measured while offline, published after rejoin */
+static struct air_quality_sample offline_sample;
+static bool offline_sample_pending;
+
+bool sample_pipeline_next(struct air_quality_sample *sample, int *err)
+{
+	struct history_record record;
+
+	if (!sensor_thread_get_sample(sample)) {
+		return false;
+	}
+
+	*err = 0;
+
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_OFFLINE) && offline_manager_is_offline()) {
+		/* Reports cannot be delivered, the samples go to the history only */
+		offline_sample = *sample;
+		offline_sample_pending = true;
+	} else {
+		*err = air_quality_monitor_commit(sample);
+
+		/* A newer sample replaces the one measured while offline */
+		offline_sample_pending = false;
+
+		if (*err) {
+			LOG_ERR("Failed to update attributes: %d", *err);
+		}
+	}
+
+	if (sample->valid & AIR_QUALITY_SAMPLE_CO2) {
+		rgb_led_indicate_co2(sample->co2_ppm);
+	}
+
+	if (history_add(sample, &record) && IS_ENABLED(CONFIG_AIR_MONITOR_FLASH_LOG)) {
+		flash_log_add(&record);
+	}
+
+	return true;
+}
+
+void sample_pipeline_rejoined(void)
+{
+	if (!offline_sample_pending) {
+		return;
+	}
+
+	offline_sample_pending = false;
+
+	int err = air_quality_monitor_commit(&offline_sample);
+
+	if (err) {
+		LOG_ERR("Failed to update attributes: %d", err);
+	}
+}
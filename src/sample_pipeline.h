@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SAMPLE_PIPELINE_H
+#define SAMPLE_PIPELINE_H
+
+#include <stdbool.h>
+
+#include "air_quality_monitor.h"
+
+/**
+ * @brief Takes the next sample queued by the sensor thread through the pipeline: attribute
+ *	  commit, LED indication, history and flash log.
+ *
+ * While the network is lost the commit is held back, the newest held back sample is
+ * published by sample_pipeline_rejoined().
+ *
+ * @param sample  Filled with the processed sample.
+ * @param err     Set to the error of the attribute commit, 0 if it succeeded or was held back.
+ *
+ * @return true if a sample was processed, false if the queue is empty.
+ */
+bool sample_pipeline_next(struct air_quality_sample *sample, int *err);
+
+/**
+ * @brief Publishes the newest sample measured while offline, if any.
+ *
+ * @note Must be called from the thread calling sample_pipeline_next().
+ */
+void sample_pipeline_rejoined(void);
+
+#endif /* SAMPLE_PIPELINE_H */
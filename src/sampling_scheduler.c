@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+
+#include "sampling_scheduler.h"
+#include "scd4x_cmd.h"
+#include "sensor_thread.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
+
+/* Check periods of the periodic modes, rounded up to whole sensor measurement intervals */
+#define NORMAL_CHECK_PERIOD_MSEC                                                                   \
+	ROUND_UP(1000 * CONFIG_AIR_MONITOR_CHECK_PERIOD_SECONDS,                                   \
+		 SCD4X_PERIODIC_MEASUREMENT_INTERVAL_MSEC)
+#define LOW_POWER_CHECK_PERIOD_MSEC                                                                \
+	ROUND_UP(1000 * CONFIG_AIR_MONITOR_LOW_POWER_CHECK_PERIOD_SECONDS,                         \
+		 SCD4X_LOW_POWER_MEASUREMENT_INTERVAL_MSEC)
+#if defined(CONFIG_AIR_MONITOR_SLEEP_CYCLE)
+/* One single shot per sleep cycle */
+#define SINGLE_SHOT_CHECK_PERIOD_MSEC (1000 * CONFIG_AIR_MONITOR_SLEEP_CYCLE_PERIOD_SECONDS)
+#else
+#define SINGLE_SHOT_CHECK_PERIOD_MSEC (1000 * CONFIG_AIR_MONITOR_SINGLE_SHOT_CHECK_PERIOD_SECONDS)
+#endif
+
+#define STABLE_HOLD_MSEC (1000 * CONFIG_AIR_MONITOR_STABLE_HOLD_SECONDS)
+#define READER_HOLD_MSEC (1000 * CONFIG_AIR_MONITOR_READER_HOLD_SECONDS)
+
+/* SCD4x noise is tens of ppm, the rate is evaluated over at least a minute */
+#define RATE_BASELINE_MSEC 60000
+
+/* Smoothed rate is kept in Q4 fixed point, EWMA weight of a new value is 1/4 */
+#define RATE_FRAC_BITS 4
+#define RATE_EWMA_SHIFT 2
+
+/* Command execution time, SCD4x datasheet chapter 3.5 */
+#define SCD4X_STOP_PERIODIC_MEASUREMENT_DELAY K_MSEC(500)
+
+BUILD_ASSERT(SINGLE_SHOT_CHECK_PERIOD_MSEC > SCD4X_SINGLE_SHOT_DURATION_MSEC,
+	     "Single shot check period must be longer than the measurement");
+
+static void mode_work_handler(struct k_work *work);
+static void wake_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(mode_work, mode_work_handler);
+static K_WORK_DEFINE(wake_work, wake_work_handler);
+
+/* Owned by the sensor thread */
+static enum sampling_mode mode = SAMPLING_MODE_NORMAL;
+static bool shot_in_flight;
+static int64_t stable_since;
+static int64_t accounted_at;
+static uint64_t active_ms;
+static uint64_t residency_ms[SAMPLING_MODE_COUNT];
+
+/* CO2 rate of change estimate */
+static bool anchored;
+static uint16_t anchor_co2;
+static int64_t anchor_timestamp;
+static uint32_t rate;
+
+/* Shared with other threads */
+static atomic_t reader_uptime;
+static atomic_t published_mode = ATOMIC_INIT(SAMPLING_MODE_NORMAL);
+static struct k_spinlock status_lock;
+static struct sampling_scheduler_status status;
+
+static const char *const mode_names[] = {
+	[SAMPLING_MODE_NORMAL] = "normal",
+	[SAMPLING_MODE_LOW_POWER] = "low power",
+	[SAMPLING_MODE_SINGLE_SHOT] = "single shot",
+};
+
+static void sampling_scheduler_account(void)
+{
+	int64_t now = k_uptime_get();
+	uint32_t elapsed = (uint32_t)(now - accounted_at);
+	uint64_t total = 0;
+
+	accounted_at = now;
+	residency_ms[mode] += elapsed;
+
+	/* Single shots are accounted when triggered */
+	if (mode == SAMPLING_MODE_NORMAL) {
+		active_ms += elapsed;
+	} else if (mode == SAMPLING_MODE_LOW_POWER) {
+		active_ms += (uint64_t)elapsed * SCD4X_PERIODIC_MEASUREMENT_INTERVAL_MSEC /
+			     SCD4X_LOW_POWER_MEASUREMENT_INTERVAL_MSEC;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&status_lock);
+
+	for (int i = 0; i < SAMPLING_MODE_COUNT; i++) {
+		status.residency_s[i] = (uint32_t)(residency_ms[i] / MSEC_PER_SEC);
+		total += residency_ms[i];
+	}
+	status.mode = mode;
+	status.duty_cycle = total ? (uint16_t)MIN(active_ms * 10000 / total, 10000) : 10000;
+
+	k_spin_unlock(&status_lock, key);
+}
+
+static void sampling_scheduler_update_rate(const struct air_quality_sample *sample)
+{
+	if (!anchored) {
+		anchored = true;
+		anchor_co2 = sample->co2_ppm;
+		anchor_timestamp = sample->timestamp;
+		return;
+	}
+
+	int64_t elapsed = sample->timestamp - anchor_timestamp;
+
+	if (elapsed < RATE_BASELINE_MSEC) {
+		return;
+	}
+
+	/* ppm per minute */
+	uint32_t current = (uint32_t)(abs((int32_t)sample->co2_ppm - anchor_co2) *
+				      (int64_t)MSEC_PER_SEC * 60 / elapsed);
+
+	rate = rate - (rate >> RATE_EWMA_SHIFT) +
+	       ((current << RATE_FRAC_BITS) >> RATE_EWMA_SHIFT);
+	anchor_co2 = sample->co2_ppm;
+	anchor_timestamp = sample->timestamp;
+}
+
+static bool sampling_scheduler_reader_recent(void)
+{
+	uint32_t since = k_uptime_get_32() - (uint32_t)atomic_get(&reader_uptime);
+
+	return since < READER_HOLD_MSEC;
+}
+
+static enum sampling_mode sampling_scheduler_decide(void)
+{
+	int64_t now = k_uptime_get();
+	uint32_t ppm_per_min = rate >> RATE_FRAC_BITS;
+
+	/* Sleep cycle goes to single shot after the first sample and stays there */
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_SLEEP_CYCLE)) {
+		return SAMPLING_MODE_SINGLE_SHOT;
+	}
+
+	if (!IS_ENABLED(CONFIG_AIR_MONITOR_ADAPTIVE_SAMPLING)) {
+		return SAMPLING_MODE_NORMAL;
+	}
+
+	if (sampling_scheduler_reader_recent() ||
+	    ppm_per_min >= CONFIG_AIR_MONITOR_CO2_RATE_FAST_PPM_PER_MIN) {
+		stable_since = now;
+		return SAMPLING_MODE_NORMAL;
+	}
+
+	/* Between the thresholds the current mode is kept */
+	if (ppm_per_min > CONFIG_AIR_MONITOR_CO2_RATE_STABLE_PPM_PER_MIN) {
+		stable_since = now;
+		return mode;
+	}
+
+	if (now - stable_since < STABLE_HOLD_MSEC) {
+		return mode;
+	}
+
+	/* Stable long enough, step down one level and start holding again */
+	stable_since = now;
+
+	if (mode == SAMPLING_MODE_NORMAL) {
+		return SAMPLING_MODE_LOW_POWER;
+	}
+
+	if (mode == SAMPLING_MODE_LOW_POWER && IS_ENABLED(CONFIG_AIR_MONITOR_SINGLE_SHOT)) {
+		return SAMPLING_MODE_SINGLE_SHOT;
+	}
+
+	return mode;
+}
+
+static void sampling_scheduler_transition(enum sampling_mode next)
+{
+	k_timeout_t delay = K_NO_WAIT;
+
+	LOG_INF("Sampling mode %s -> %s, CO2 rate %u ppm/min", mode_names[mode], mode_names[next],
+		rate >> RATE_FRAC_BITS);
+
+	sampling_scheduler_account();
+
+	if (shot_in_flight) {
+		/* Sensor ignores commands until the single shot finishes */
+		delay = K_MSEC(SCD4X_SINGLE_SHOT_DURATION_MSEC);
+	} else if (mode != SAMPLING_MODE_SINGLE_SHOT) {
+		scd4x_cmd_send(SCD4X_CMD_STOP_PERIODIC_MEASUREMENT);
+		delay = SCD4X_STOP_PERIODIC_MEASUREMENT_DELAY;
+	}
+
+	shot_in_flight = false;
+	mode = next;
+	atomic_set(&published_mode, mode);
+	sampling_scheduler_account();
+
+	/* Next mode is started once the sensor is idle */
+	k_work_reschedule_for_queue(sensor_thread_work_q(), &mode_work, delay);
+}
+
+static void mode_work_handler(struct k_work *work)
+{
+	uint32_t first_measurement_msec;
+	uint16_t cmd;
+
+	switch (mode) {
+	case SAMPLING_MODE_LOW_POWER:
+		cmd = SCD4X_CMD_START_LOW_POWER_PERIODIC_MEASUREMENT;
+		first_measurement_msec = SCD4X_LOW_POWER_MEASUREMENT_INTERVAL_MSEC;
+		break;
+	case SAMPLING_MODE_SINGLE_SHOT:
+		cmd = SCD4X_CMD_MEASURE_SINGLE_SHOT;
+		first_measurement_msec = SCD4X_SINGLE_SHOT_DURATION_MSEC;
+		shot_in_flight = true;
+		active_ms += SCD4X_SINGLE_SHOT_DURATION_MSEC;
+		break;
+	default:
+		cmd = SCD4X_CMD_START_PERIODIC_MEASUREMENT;
+		first_measurement_msec = SCD4X_PERIODIC_MEASUREMENT_INTERVAL_MSEC;
+		break;
+	}
+
+	if (scd4x_cmd_send(cmd)) {
+		/* Sampling goes on, the failed fetch is handled by sampling_scheduler_update() */
+		shot_in_flight = false;
+	}
+
+	/* Data ready polling on the sensor thread locks onto the new measurement schedule */
+	sensor_thread_resume(K_MSEC(first_measurement_msec));
+}
+
+static void wake_work_handler(struct k_work *work)
+{
+	/* Skip if the normal mode is already selected, even if still starting */
+	if (mode == SAMPLING_MODE_NORMAL) {
+		return;
+	}
+
+	sensor_thread_suspend();
+	sampling_scheduler_transition(SAMPLING_MODE_NORMAL);
+}
+
+int32_t sampling_scheduler_update(const struct air_quality_sample *sample)
+{
+	shot_in_flight = false;
+
+	if (sample && (sample->valid & AIR_QUALITY_SAMPLE_CO2)) {
+		sampling_scheduler_update_rate(sample);
+	}
+
+	sampling_scheduler_account();
+
+	enum sampling_mode next = sampling_scheduler_decide();
+
+	if (next != mode) {
+		sampling_scheduler_transition(next);
+		return SYS_FOREVER_MS;
+	}
+
+	switch (mode) {
+	case SAMPLING_MODE_LOW_POWER:
+		return LOW_POWER_CHECK_PERIOD_MSEC;
+	case SAMPLING_MODE_SINGLE_SHOT:
+		/* Trigger the next shot so that it completes at the end of the period */
+		k_work_reschedule_for_queue(
+			sensor_thread_work_q(), &mode_work,
+			K_MSEC(SINGLE_SHOT_CHECK_PERIOD_MSEC - SCD4X_SINGLE_SHOT_DURATION_MSEC));
+		return SYS_FOREVER_MS;
+	default:
+		return NORMAL_CHECK_PERIOD_MSEC;
+	}
+}
+
+void sampling_scheduler_reader_active(void)
+{
+	atomic_set(&reader_uptime, (atomic_val_t)k_uptime_get_32());
+
+	/* Readers of an infrequent reporter get the last published values */
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_SLEEP_CYCLE)) {
+		return;
+	}
+
+	if (atomic_get(&published_mode) != SAMPLING_MODE_NORMAL) {
+		/* Fails harmlessly if the sensor thread is not started yet */
+		k_work_submit_to_queue(sensor_thread_work_q(), &wake_work);
+	}
+}
+
+void sampling_scheduler_reset(void)
+{
+	k_work_cancel_delayable(&mode_work);
+	sampling_scheduler_account();
+
+	shot_in_flight = false;
+	mode = SAMPLING_MODE_NORMAL;
+	atomic_set(&published_mode, mode);
+	stable_since = k_uptime_get();
+	sampling_scheduler_account();
+}
+
+void sampling_scheduler_get_status(struct sampling_scheduler_status *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&status_lock);
+
+	*out = status;
+
+	k_spin_unlock(&status_lock, key);
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SAMPLING_SCHEDULER_H
+#define SAMPLING_SCHEDULER_H
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+#include "air_quality_monitor.h"
+
+/* SCD4x measurement mode, reported through ZCL as enum8 */
+enum sampling_mode {
+	/* Periodic measurement every 5 s */
+	SAMPLING_MODE_NORMAL = 0,
+	/* Low power periodic measurement every 30 s */
+	SAMPLING_MODE_LOW_POWER = 1,
+	/* On demand single shot measurement, sensor idle in between (SCD41 only) */
+	SAMPLING_MODE_SINGLE_SHOT = 2,
+	SAMPLING_MODE_COUNT,
+};
+
+struct sampling_scheduler_status {
+	enum sampling_mode mode;
+	/* Share of time the sensor spent measuring since boot, in 0.01 % */
+	uint16_t duty_cycle;
+	/* Time spent in every mode since boot */
+	uint32_t residency_s[SAMPLING_MODE_COUNT];
+};
+
+/**
+ * @brief Processes a new sample and selects the measurement mode for the following ones.
+ *
+ * Must be called from the sensor thread after every sampling attempt. Mode changes and
+ * single shot triggers are driven by the scheduler itself, sampling is then resumed with
+ * sensor_thread_resume().
+ *
+ * @param sample  New sample, NULL if sampling failed.
+ *
+ * @return Time in milliseconds from this measurement to the one that should be sampled next,
+ *	   always a multiple of the sensor measurement interval. SYS_FOREVER_MS if the
+ *	   scheduler resumes sampling itself.
+ */
+int32_t sampling_scheduler_update(const struct air_quality_sample *sample);
+
+/**
+ * @brief Hints that somebody is reading the measurements, keeps the normal mode for a while.
+ *
+ * Ignored with CONFIG_AIR_MONITOR_SLEEP_CYCLE. Safe to call from any thread.
+ */
+void sampling_scheduler_reader_active(void);
+
+/**
+ * @brief Cancels pending mode changes and assumes the sensor is put to normal periodic mode.
+ *
+ * Must be called from the sensor thread by operations taking over the sensor.
+ */
+void sampling_scheduler_reset(void);
+
+/**
+ * @brief Returns current mode and duty cycle statistics. Safe to call from any thread.
+ */
+void sampling_scheduler_get_status(struct sampling_scheduler_status *status);
+
+#endif /* SAMPLING_SCHEDULER_H */
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+
+#include "bus_pm.h"
+#include "scd4x_cmd.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
+
+/* Command execution time, SCD4x datasheet chapter 3.5 */
+#define SCD4X_DATA_READY_DELAY_MSEC 1
+
+/* Longest response handled is a measurement: 3 words */
+#define SCD4X_CMD_MAX_WORDS 3
+
+static const struct i2c_dt_spec bus = I2C_DT_SPEC_GET(DT_COMPAT_GET_ANY_STATUS_OKAY(sensirion_scd4x));
+
+static uint8_t scd4x_cmd_crc(const uint8_t *word)
+{
+	return crc8(word, 2, SCD4X_CRC8_POLYNOMIAL, SCD4X_CRC8_INIT, false);
+}
+
+int scd4x_cmd_send(uint16_t cmd)
+{
+	uint8_t buf[2];
+
+	sys_put_be16(cmd, buf);
+
+	int err = bus_pm_get(BUS_PM_SENSOR_I2C);
+
+	if (!err) {
+		err = i2c_write_dt(&bus, buf, sizeof(buf));
+		bus_pm_put(BUS_PM_SENSOR_I2C);
+	}
+
+	if (err) {
+		LOG_ERR("Failed to send SCD4X command 0x%04x: %d", cmd, err);
+	}
+
+	return err;
+}
+
+int scd4x_cmd_send_arg(uint16_t cmd, uint16_t arg)
+{
+	uint8_t buf[2 + SCD4X_WORD_SIZE];
+
+	sys_put_be16(cmd, buf);
+	sys_put_be16(arg, &buf[2]);
+	buf[4] = scd4x_cmd_crc(&buf[2]);
+
+	int err = bus_pm_get(BUS_PM_SENSOR_I2C);
+
+	if (!err) {
+		err = i2c_write_dt(&bus, buf, sizeof(buf));
+		bus_pm_put(BUS_PM_SENSOR_I2C);
+	}
+
+	if (err) {
+		LOG_ERR("Failed to send SCD4X command 0x%04x: %d", cmd, err);
+	}
+
+	return err;
+}
+
+int scd4x_cmd_read(uint16_t *words, size_t count)
+{
+	uint8_t buf[SCD4X_CMD_MAX_WORDS * SCD4X_WORD_SIZE];
+
+	if (count > SCD4X_CMD_MAX_WORDS) {
+		return -EINVAL;
+	}
+
+	int err = bus_pm_get(BUS_PM_SENSOR_I2C);
+
+	if (!err) {
+		err = i2c_read_dt(&bus, buf, count * SCD4X_WORD_SIZE);
+		bus_pm_put(BUS_PM_SENSOR_I2C);
+	}
+
+	if (err) {
+		LOG_ERR("Failed to read SCD4X response: %d", err);
+		return err;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		const uint8_t *word = &buf[i * SCD4X_WORD_SIZE];
+
+		if (scd4x_cmd_crc(word) != word[2]) {
+			LOG_ERR("SCD4X response CRC mismatch");
+			return -EIO;
+		}
+		words[i] = sys_get_be16(word);
+	}
+
+	return 0;
+}
+
+int scd4x_cmd_data_ready(bool *ready)
+{
+	uint16_t status;
+	int err = bus_pm_get(BUS_PM_SENSOR_I2C);
+
+	if (err) {
+		return err;
+	}
+
+	/* Bus stays resumed between the command and its response */
+	err = scd4x_cmd_send(SCD4X_CMD_GET_DATA_READY_STATUS);
+	if (!err) {
+		k_msleep(SCD4X_DATA_READY_DELAY_MSEC);
+		err = scd4x_cmd_read(&status, 1);
+	}
+
+	bus_pm_put(BUS_PM_SENSOR_I2C);
+
+	if (err) {
+		return err;
+	}
+
+	*ready = (status & SCD4X_DATA_READY_MASK) != 0;
+
+	return 0;
+}
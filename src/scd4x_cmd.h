@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SCD4X_CMD_H
+#define SCD4X_CMD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "scd4x_commands.h"
+
+/* Raw access to SCD4x commands not exposed by the sensor driver.
+ *
+ * Commands only transmit, they never wait for the execution time. Callers schedule
+ * the response read or the next command themselves, so the sensor thread is never
+ * blocked by command delays. The only exception is the data ready check taking 1 ms.
+ * All functions must be called from the sensor thread.
+ */
+
+/**
+ * @brief Sends a command without arguments.
+ *
+ * @return 0 if success, error code if failure.
+ */
+int scd4x_cmd_send(uint16_t cmd);
+
+/**
+ * @brief Sends a command with a single argument word.
+ *
+ * @return 0 if success, error code if failure.
+ */
+int scd4x_cmd_send_arg(uint16_t cmd, uint16_t arg);
+
+/**
+ * @brief Reads response words of the previously sent command and checks their CRC.
+ *
+ * @return 0 if success, error code if failure.
+ */
+int scd4x_cmd_read(uint16_t *words, size_t count);
+
+/**
+ * @brief Checks whether a new measurement can be read.
+ *
+ * @param ready  Set to true if a measurement is available.
+ *
+ * @return 0 if success, error code if failure.
+ */
+int scd4x_cmd_data_ready(bool *ready);
+
+#endif /* SCD4X_CMD_H */
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "profiler.h"
+#include "sampling_scheduler.h"
+#include "scd4x_cmd.h"
+#include "sensor_thread.h"
+#include "spsc_queue.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
+
+/* Data ready is first checked this long before the expected measurement, then every poll
+ * interval until it shows up. The measurement is fetched at most one poll interval late.
+ */
+#define DATA_READY_LEAD_MSEC 100
+#define DATA_READY_POLL_INTERVAL_MSEC 50
+#define DATA_READY_MAX_POLLS 48
+
+/* When the first check already finds data the schedule is moved earlier by this step,
+ * doubled on every consecutive late fetch up to the polling window of 2 s.
+ */
+#define DATA_READY_LATE_STEP_MSEC 250
+#define DATA_READY_LATE_STEP_MAX_SHIFT 3
+
+/* Smoothed lag is kept in Q4 fixed point, EWMA weight of a new value is 1/8 */
+#define LAG_FRAC_BITS 4
+#define LAG_EWMA_SHIFT 3
+
+K_THREAD_STACK_DEFINE(sensor_stack, CONFIG_AIR_MONITOR_SENSOR_THREAD_STACK_SIZE);
+static struct k_work_q sensor_work_q;
+
+SPSC_QUEUE_DEFINE(sample_queue, struct air_quality_sample, CONFIG_AIR_MONITOR_SAMPLE_QUEUE_SIZE);
+
+static void sample_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(sample_work, sample_work_handler);
+static sensor_thread_notify_cb_t notify_cb;
+
+/* Data ready polling state, owned by the sensor thread */
+static uint32_t polls;
+static uint32_t late_streak;
+static int64_t last_not_ready;
+static uint32_t lag_avg;
+
+static struct k_spinlock stats_lock;
+static struct sensor_thread_stats stats;
+
+static void sensor_thread_update_stats(int64_t ready_at, bool late, bool queued)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	stats.fetches++;
+	stats.not_ready += polls;
+
+	if (!queued) {
+		stats.dropped++;
+	}
+
+	if (late) {
+		/* Measurement was available for an unknown time, lag is not sampled */
+		stats.late++;
+	} else {
+		uint32_t lag = (uint32_t)(ready_at - last_not_ready);
+
+		lag_avg = lag_avg - (lag_avg >> LAG_EWMA_SHIFT) +
+			  ((lag << LAG_FRAC_BITS) >> LAG_EWMA_SHIFT);
+		stats.lag_ms = (uint16_t)MIN(lag, UINT16_MAX);
+		stats.lag_avg_ms = (uint16_t)MIN(lag_avg >> LAG_FRAC_BITS, UINT16_MAX);
+		stats.lag_max_ms = MAX(stats.lag_max_ms, stats.lag_ms);
+	}
+
+	k_spin_unlock(&stats_lock, key);
+}
+
+static void sample_work_handler(struct k_work *work)
+{
+	struct air_quality_sample sample;
+	bool ready = false;
+	bool queued = true;
+
+	PROFILER_START(data_ready);
+	int err = scd4x_cmd_data_ready(&ready);
+
+	PROFILER_STOP(PROFILER_STAGE_DATA_READY, data_ready);
+
+	int64_t ready_at = k_uptime_get();
+
+	if (!err && !ready) {
+		if (++polls < DATA_READY_MAX_POLLS) {
+			last_not_ready = ready_at;
+			k_work_reschedule_for_queue(&sensor_work_q, &sample_work,
+						    K_MSEC(DATA_READY_POLL_INTERVAL_MSEC));
+			return;
+		}
+
+		err = -ETIMEDOUT;
+	}
+
+	/* The first check finding data means the schedule runs behind the sensor */
+	bool late = polls == 0;
+
+	if (!err) {
+		err = air_quality_monitor_sample(&sample);
+	}
+
+	if (err) {
+		LOG_ERR("Failed to check air quality: %d", err);
+	} else {
+		queued = spsc_queue_put(&sample_queue, &sample);
+		if (!queued) {
+			/* Consumer is not keeping up, newest sample is lost */
+			LOG_WRN("Sample queue full, sample dropped");
+		} else if (notify_cb) {
+			notify_cb();
+		}
+
+		sensor_thread_update_stats(ready_at, late, queued);
+	}
+
+	polls = 0;
+
+	int32_t period = sampling_scheduler_update(err ? NULL : &sample);
+
+	if (period == SYS_FOREVER_MS) {
+		return;
+	}
+
+	/* Aim the first check of the next cycle just before the expected measurement */
+	int64_t next_check = ready_at + period - DATA_READY_LEAD_MSEC;
+
+	if (late && !err) {
+		next_check -= DATA_READY_LATE_STEP_MSEC
+			      << MIN(late_streak, DATA_READY_LATE_STEP_MAX_SHIFT);
+		late_streak++;
+	} else {
+		late_streak = 0;
+	}
+
+	k_work_reschedule_for_queue(&sensor_work_q, &sample_work,
+				    K_MSEC(MAX(next_check - k_uptime_get(), 0)));
+}
+
+void sensor_thread_start(k_timeout_t first_delay, sensor_thread_notify_cb_t notify)
+{
+	notify_cb = notify;
+
+	k_work_queue_start(&sensor_work_q, sensor_stack, K_THREAD_STACK_SIZEOF(sensor_stack),
+			   CONFIG_AIR_MONITOR_SENSOR_THREAD_PRIORITY, NULL);
+	k_thread_name_set(&sensor_work_q.thread, "sensor");
+
+	k_work_reschedule_for_queue(&sensor_work_q, &sample_work, first_delay);
+}
+
+bool sensor_thread_get_sample(struct air_quality_sample *sample)
+{
+	return spsc_queue_get(&sample_queue, sample);
+}
+
+void sensor_thread_suspend(void)
+{
+	k_work_cancel_delayable(&sample_work);
+}
+
+void sensor_thread_resume(k_timeout_t delay)
+{
+	polls = 0;
+	k_work_reschedule_for_queue(&sensor_work_q, &sample_work, delay);
+}
+
+void sensor_thread_get_stats(struct sensor_thread_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	*out = stats;
+
+	k_spin_unlock(&stats_lock, key);
+}
+
+struct k_work_q *sensor_thread_work_q(void)
+{
+	return &sensor_work_q;
+}
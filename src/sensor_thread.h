@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SENSOR_THREAD_H
+#define SENSOR_THREAD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+#include "air_quality_monitor.h"
+
+/**
+ * @brief Callback invoked from the sensor thread after a sample was queued.
+ *
+ * @note It runs in the sensor thread, it must only hand over to the consumer context.
+ */
+typedef void (*sensor_thread_notify_cb_t)(void);
+
+struct sensor_thread_stats {
+	/* Measurements fetched */
+	uint32_t fetches;
+	/* Data ready checks that found no new measurement */
+	uint32_t not_ready;
+	/* Fetches whose first data ready check already found the measurement */
+	uint32_t late;
+	/* Fetched samples lost because the queue was full */
+	uint32_t dropped;
+	/* Delay from the measurement becoming available to its fetch, upper bound.
+	 * Sampled only when the measurement was caught by polling, i.e. not late.
+	 */
+	uint16_t lag_ms;
+	uint16_t lag_avg_ms;
+	uint16_t lag_max_ms;
+};
+
+/**
+ * @brief Starts the sensor work queue and periodic sampling.
+ *
+ * Every measurement is fetched once, as soon as the sensor reports it through its data
+ * ready status, and the polling phase of the following ones locks onto the sensor schedule.
+ *
+ * @param first_delay  Delay before the first sample.
+ * @param notify       Called after every queued sample.
+ */
+void sensor_thread_start(k_timeout_t first_delay, sensor_thread_notify_cb_t notify);
+
+/**
+ * @brief Takes the oldest queued sample.
+ *
+ * @note Must be called from a single consumer context only.
+ *
+ * @return true if a sample was returned, false if the queue is empty.
+ */
+bool sensor_thread_get_sample(struct air_quality_sample *sample);
+
+/**
+ * @brief Stops periodic sampling.
+ *
+ * @note Must be called from the sensor thread, e.g. by operations that need
+ *	 exclusive access to the sensor for longer than a single work item.
+ */
+void sensor_thread_suspend(void);
+
+/**
+ * @brief Resumes periodic sampling.
+ *
+ * @param delay  Expected time of the next measurement, polling for it starts then.
+ */
+void sensor_thread_resume(k_timeout_t delay);
+
+/**
+ * @brief Returns fetch statistics. Safe to call from any thread.
+ */
+void sensor_thread_get_stats(struct sensor_thread_stats *stats);
+
+/**
+ * @brief Returns the work queue owning the sensor.
+ */
+struct k_work_q *sensor_thread_work_q(void);
+
+#endif /* SENSOR_THREAD_H */
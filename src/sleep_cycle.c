@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/linker/section_tags.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/crc.h>
+
+#include "co2_filter.h"
+#include "sleep_cycle.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
+
+#if defined(CONFIG_AIR_MONITOR_CO2_FILTER)
+BUILD_ASSERT(CONFIG_AIR_MONITOR_SLEEP_CYCLE_PERIOD_SECONDS <=
+		     CONFIG_AIR_MONITOR_CO2_FILTER_MAX_GAP_SECONDS,
+	     "CO2 filter would be reset by every sleep cycle");
+#endif
+
+/* Changed whenever the layout of struct retained_state changes */
+#define RETAINED_MAGIC 0x41514D01
+
+/* Not cleared by the startup code, survives soft, watchdog and fault resets.
+ *
+ * Cycles do not reset the SoC, so the scheduler and the offline manager keep their state in
+ * ordinary RAM. Neither is worth retaining for the rare reset: the scheduler is back in
+ * single shot after the first sample, stopping whatever measurement the sensor still ran,
+ * their timers count uptime, which restarts, and ZBOSS restores the network from flash.
+ * Samples of an outage that spans a reset are in the flash log, not in RAM history.
+ */
+struct retained_state {
+	uint32_t magic;
+	uint32_t boots;
+	uint32_t stores;
+	int16_t temperature;
+	uint16_t humidity;
+	uint16_t co2_ppm;
+	uint32_t co2_attr;
+	uint8_t valid;
+	/* Over all fields above */
+	uint32_t crc;
+};
+
+static __noinit struct retained_state retained;
+
+static struct k_spinlock lock;
+static bool restored;
+
+static uint32_t retained_crc(void)
+{
+	return crc32_ieee((const uint8_t *)&retained, offsetof(struct retained_state, crc));
+}
+
+bool sleep_cycle_init(struct air_quality_sample *sample)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	restored = retained.magic == RETAINED_MAGIC && retained.crc == retained_crc();
+
+	if (!restored) {
+		memset(&retained, 0, sizeof(retained));
+		retained.magic = RETAINED_MAGIC;
+	}
+
+	uint32_t boots = ++retained.boots;
+
+	retained.crc = retained_crc();
+
+	*sample = (struct air_quality_sample){
+		.temperature = retained.temperature,
+		.humidity = retained.humidity,
+		.co2_ppm = retained.co2_ppm,
+		.co2_attr = retained.co2_attr,
+		.valid = retained.valid,
+	};
+
+	k_spin_unlock(&lock, key);
+
+	if (!restored) {
+		return false;
+	}
+
+	LOG_INF("Retained state restored, boot %u, CO2 %u ppm", boots, sample->co2_ppm);
+
+	/* The first reading continues the filtered level instead of starting over */
+	if (IS_ENABLED(CONFIG_AIR_MONITOR_CO2_FILTER) && (sample->valid & AIR_QUALITY_SAMPLE_CO2)) {
+		co2_filter_seed(sample->co2_ppm, k_uptime_get());
+	}
+
+	return sample->valid != 0;
+}
+
+void sleep_cycle_store(const struct air_quality_sample *sample)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	retained.stores++;
+	retained.temperature = sample->temperature;
+	retained.humidity = sample->humidity;
+	retained.co2_ppm = sample->co2_ppm;
+	retained.co2_attr = sample->co2_attr;
+	retained.valid = sample->valid;
+	retained.crc = retained_crc();
+
+	k_spin_unlock(&lock, key);
+}
+
+void sleep_cycle_get_stats(struct sleep_cycle_stats *stats)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	stats->boots = retained.boots;
+	stats->stores = retained.stores;
+	stats->restored = restored;
+
+	k_spin_unlock(&lock, key);
+}
+
+#if defined(CONFIG_SHELL)
+
+static int cmd_sleep(const struct shell *sh, size_t argc, char **argv)
+{
+	struct sleep_cycle_stats s;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	sleep_cycle_get_stats(&s);
+
+	shell_print(sh, "Sleep cycle %u s, boot %u, %u samples retained, %s",
+		    CONFIG_AIR_MONITOR_SLEEP_CYCLE_PERIOD_SECONDS, s.boots, s.stores,
+		    s.restored ? "restored" : "cold start");
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((aqm), sleep, NULL, "Sleep cycle and retained state", cmd_sleep, 1, 0);
+
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SLEEP_CYCLE_H
+#define SLEEP_CYCLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "air_quality_monitor.h"
+
+#define SLEEP_CYCLE_PERIOD_MSEC (1000 * CONFIG_AIR_MONITOR_SLEEP_CYCLE_PERIOD_SECONDS)
+
+struct sleep_cycle_stats {
+	/* Boots since the retained state was created, 1 after power on */
+	uint32_t boots;
+	/* Published samples stored since then */
+	uint32_t stores;
+	/* State of the previous boot was found valid and restored */
+	bool restored;
+};
+
+/**
+ * @brief Validates the state retained in RAM across resets and restores it.
+ *
+ * The CO2 filter is seeded with the last published concentration. Must be called before
+ * the sensor thread is started.
+ *
+ * @param[out] sample  Last published values, timestamp 0, see air_quality_sample.valid.
+ *
+ * @return true if the state was restored, false after power on or if it was corrupted.
+ */
+bool sleep_cycle_init(struct air_quality_sample *sample);
+
+/**
+ * @brief Stores the published values in retained RAM.
+ *
+ * @note Must be called from the thread committing the samples only.
+ */
+void sleep_cycle_store(const struct air_quality_sample *sample);
+
+/**
+ * @brief Returns retained state statistics. Safe to call from any thread.
+ */
+void sleep_cycle_get_stats(struct sleep_cycle_stats *stats);
+
+#endif /* SLEEP_CYCLE_H */
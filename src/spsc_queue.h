@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stdbool.h>
+#include <string.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/toolchain.h>
+
+/* Lock-free queue of fixed size elements for exactly one producer and one consumer.
+ *
+ * Head is written only by the producer and tail only by the consumer. Both are free running
+ * counters, the slot index is the counter masked by the power of two capacity.
+ */
+struct spsc_queue {
+	atomic_t head;
+	atomic_t tail;
+	void *buf;
+	size_t elem_size;
+	atomic_val_t mask;
+};
+
+#define SPSC_QUEUE_DEFINE(name, type, len)                                                        \
+	BUILD_ASSERT(IS_POWER_OF_TWO(len), "SPSC queue length must be a power of two");           \
+	static type name##_buf[len];                                                               \
+	static struct spsc_queue name = {                                                          \
+		.buf = name##_buf,                                                                 \
+		.elem_size = sizeof(type),                                                         \
+		.mask = (len) - 1,                                                                 \
+	}
+
+static inline void *spsc_queue_slot(struct spsc_queue *q, atomic_val_t index)
+{
+	return (uint8_t *)q->buf + (size_t)(index & q->mask) * q->elem_size;
+}
+
+/**
+ * @brief Appends a copy of the element, producer side only.
+ *
+ * @return true if stored, false if the queue is full.
+ */
+static inline bool spsc_queue_put(struct spsc_queue *q, const void *elem)
+{
+	atomic_val_t head = atomic_get(&q->head);
+
+	if (head - atomic_get(&q->tail) > q->mask) {
+		return false;
+	}
+
+	memcpy(spsc_queue_slot(q, head), elem, q->elem_size);
+	/* atomic_set() is a full barrier: the element is visible before the new head */
+	atomic_set(&q->head, head + 1);
+
+	return true;
+}
+
+/**
+ * @brief Removes the oldest element, consumer side only.
+ *
+ * @return true if an element was copied to elem, false if the queue is empty.
+ */
+static inline bool spsc_queue_get(struct spsc_queue *q, void *elem)
+{
+	atomic_val_t tail = atomic_get(&q->tail);
+
+	if (tail == atomic_get(&q->head)) {
+		return false;
+	}
+
+	memcpy(elem, spsc_queue_slot(q, tail), q->elem_size);
+	/* Slot may be reused by the producer only after it has been copied out */
+	atomic_set(&q->tail, tail + 1);
+
+	return true;
+}
+
+#endif /* SPSC_QUEUE_H */
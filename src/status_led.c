@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <nrfx_pwm.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/pinctrl.h>
+#include <zephyr/dt-bindings/pwm/pwm.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+
+#include "bus_pm.h"
+#include "status_led.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
+
+#define PAIRING_LED_NODE DT_NODELABEL(pwm_led0)
+#define STATUS_LED_NODE DT_NODELABEL(pwm_led1)
+#define PWM_NODE DT_PWMS_CTLR(PAIRING_LED_NODE)
+
+BUILD_ASSERT(DT_SAME_NODE(PWM_NODE, DT_NODELABEL(pwm0)) &&
+		     DT_SAME_NODE(DT_PWMS_CTLR(STATUS_LED_NODE), PWM_NODE),
+	     "Status LEDs must share pwm0, their patterns are one sequence");
+BUILD_ASSERT(DT_PWMS_PERIOD(PAIRING_LED_NODE) == DT_PWMS_PERIOD(STATUS_LED_NODE),
+	     "Status LEDs must have the same PWM period");
+
+/* 125 kHz base clock, 8 us per count */
+#define PWM_COUNT_NSEC 8000
+#define PWM_PERIOD_NSEC DT_PWMS_PERIOD(PAIRING_LED_NODE)
+#define PWM_TOP (PWM_PERIOD_NSEC / PWM_COUNT_NSEC)
+
+/* Every sequence value is held for STEP_MSEC, the PWM repeats it for as many periods */
+#define STEP_MSEC 50
+#define STEP_PERIODS (STEP_MSEC * NSEC_PER_MSEC / PWM_PERIOD_NSEC)
+#define STEPS (STATUS_LED_CYCLE_MSEC / STEP_MSEC)
+
+BUILD_ASSERT(PWM_TOP >= 3 && PWM_TOP <= 0x7FFF, "PWM period out of range of the 125 kHz clock");
+BUILD_ASSERT(STEP_PERIODS * PWM_PERIOD_NSEC == STEP_MSEC * NSEC_PER_MSEC,
+	     "Pattern step must be a multiple of the PWM period");
+BUILD_ASSERT(STATUS_LED_CYCLE_MSEC % 1000 == 0, "Patterns repeat every second");
+
+/* Active high outputs have the first edge of the period rising */
+#define PWM_POLARITY_MASK BIT(15)
+
+PINCTRL_DT_DEFINE(PWM_NODE);
+
+static const nrfx_pwm_t pwm = NRFX_PWM_INSTANCE(0);
+
+static const uint8_t channels[STATUS_LED_ID_COUNT] = {
+	[STATUS_LED_ID_PAIRING] = DT_PWMS_CHANNEL(PAIRING_LED_NODE),
+	[STATUS_LED_ID_STATUS] = DT_PWMS_CHANNEL(STATUS_LED_NODE),
+};
+
+static const bool inverted[STATUS_LED_ID_COUNT] = {
+	[STATUS_LED_ID_PAIRING] = DT_PWMS_FLAGS(PAIRING_LED_NODE) & PWM_POLARITY_INVERTED,
+	[STATUS_LED_ID_STATUS] = DT_PWMS_FLAGS(STATUS_LED_NODE) & PWM_POLARITY_INVERTED,
+};
+
+static K_MUTEX_DEFINE(led_mutex);
+
+/* Owned by led_mutex. Read by EasyDMA, must stay in RAM */
+static uint16_t sequence[STEPS][NRF_PWM_CHANNEL_COUNT];
+static enum status_led_pattern patterns[STATUS_LED_ID_COUNT];
+static bool ready;
+static bool playing;
+static struct status_led_stats stats;
+
+/* Duty cycle of the pattern STEP_MSEC * step into the cycle */
+static uint16_t pattern_duty(enum status_led_pattern pattern, int step)
+{
+	int msec = step * STEP_MSEC;
+	int half = STEPS / 2;
+	int x;
+
+	switch (pattern) {
+	case STATUS_LED_ON:
+		return PWM_TOP;
+	case STATUS_LED_BLINK:
+		return (msec / 100) % 2 ? 0 : PWM_TOP;
+	case STATUS_LED_DOUBLE_BLINK:
+		msec %= 1000;
+		return (msec < 100 || (msec >= 200 && msec < 300)) ? PWM_TOP : 0;
+	case STATUS_LED_BREATHE:
+		/* Triangle of perceived brightness, hence squared */
+		x = step < half ? step : STEPS - step;
+		return (uint16_t)(PWM_TOP * x * x / (half * half));
+	default:
+		return 0;
+	}
+}
+
+static const nrfx_pwm_config_t pwm_config = {
+	.output_pins = {
+		NRFX_PWM_PIN_NOT_USED,
+		NRFX_PWM_PIN_NOT_USED,
+		NRFX_PWM_PIN_NOT_USED,
+		NRFX_PWM_PIN_NOT_USED,
+	},
+	.irq_priority = NRFX_PWM_DEFAULT_CONFIG_IRQ_PRIORITY,
+	.base_clock = NRF_PWM_CLK_125kHz,
+	.count_mode = NRF_PWM_MODE_UP,
+	.top_value = PWM_TOP,
+	.load_mode = NRF_PWM_LOAD_INDIVIDUAL,
+	.step_mode = NRF_PWM_STEP_AUTO,
+	/* Pins are routed by pinctrl */
+	.skip_gpio_cfg = true,
+	.skip_psel_cfg = true,
+};
+
+/* The peripheral is enabled only while a pattern plays */
+static int pwm_resume(void)
+{
+	int err = bus_pm_get(BUS_PM_STATUS_PWM);
+
+	if (err) {
+		return err;
+	}
+
+	err = pinctrl_apply_state(PINCTRL_DT_DEV_CONFIG_GET(PWM_NODE), PINCTRL_STATE_DEFAULT);
+	if (err) {
+		bus_pm_put(BUS_PM_STATUS_PWM);
+		return err;
+	}
+
+	/* No handler, playback runs without interrupts */
+	if (nrfx_pwm_init(&pwm, &pwm_config, NULL, NULL) != NRFX_SUCCESS) {
+		bus_pm_put(BUS_PM_STATUS_PWM);
+		return -EBUSY;
+	}
+
+	return 0;
+}
+
+static void pwm_suspend(void)
+{
+	/* Disabling stops the playback, the pins are disconnected by the sleep state */
+	nrfx_pwm_uninit(&pwm);
+	pinctrl_apply_state(PINCTRL_DT_DEV_CONFIG_GET(PWM_NODE), PINCTRL_STATE_SLEEP);
+	bus_pm_put(BUS_PM_STATUS_PWM);
+}
+
+static void sequence_play(void)
+{
+	bool any = false;
+
+	for (int led = 0; led < STATUS_LED_ID_COUNT; led++) {
+		any |= patterns[led] != STATUS_LED_OFF;
+	}
+
+	if (!any) {
+		if (playing) {
+			pwm_suspend();
+			playing = false;
+			stats.stops++;
+		}
+
+		return;
+	}
+
+	if (playing) {
+		/* EasyDMA reads the sequence while it plays, it is rewritten only after the
+		 * playback stopped, at the end of the current PWM period
+		 */
+		nrfx_pwm_stop(&pwm, true);
+	} else {
+		int err = pwm_resume();
+
+		if (err) {
+			LOG_ERR("Cannot start status LED PWM: %d", err);
+			return;
+		}
+	}
+
+	for (int step = 0; step < STEPS; step++) {
+		for (int ch = 0; ch < NRF_PWM_CHANNEL_COUNT; ch++) {
+			sequence[step][ch] = PWM_POLARITY_MASK;
+		}
+
+		for (int led = 0; led < STATUS_LED_ID_COUNT; led++) {
+			uint16_t duty = pattern_duty(patterns[led], step);
+
+			sequence[step][channels[led]] =
+				duty | (inverted[led] ? 0 : PWM_POLARITY_MASK);
+		}
+	}
+
+	const nrf_pwm_sequence_t seq = {
+		.values.p_individual = (const nrf_pwm_values_individual_t *)sequence,
+		.length = NRF_PWM_VALUES_LENGTH(sequence),
+		.repeats = STEP_PERIODS - 1,
+		.end_delay = 0,
+	};
+
+	/* Looped by the LOOPSDONE - SEQSTART shortcut, no interrupts */
+	nrfx_pwm_simple_playback(&pwm, &seq, 1, NRFX_PWM_FLAG_LOOP);
+	playing = true;
+	stats.playbacks++;
+}
+
+int status_led_init(void)
+{
+	int err;
+
+	/* LEDs are off, the pins stay in the sleep state until a pattern plays */
+	err = pinctrl_apply_state(PINCTRL_DT_DEV_CONFIG_GET(PWM_NODE), PINCTRL_STATE_SLEEP);
+	if (err) {
+		LOG_ERR("Cannot configure status LED pins: %d", err);
+		return err;
+	}
+
+	bus_pm_init(BUS_PM_STATUS_PWM, NULL);
+
+	k_mutex_lock(&led_mutex, K_FOREVER);
+	ready = true;
+	sequence_play();
+	k_mutex_unlock(&led_mutex);
+
+	return 0;
+}
+
+void status_led_set(enum status_led_id led, enum status_led_pattern pattern)
+{
+	if (led >= STATUS_LED_ID_COUNT || pattern >= STATUS_LED_PATTERN_COUNT) {
+		return;
+	}
+
+	k_mutex_lock(&led_mutex, K_FOREVER);
+
+	if (patterns[led] != pattern) {
+		patterns[led] = pattern;
+
+		if (ready) {
+			sequence_play();
+		}
+	}
+
+	k_mutex_unlock(&led_mutex);
+}
+
+void status_led_get_stats(struct status_led_stats *out)
+{
+	k_mutex_lock(&led_mutex, K_FOREVER);
+	*out = stats;
+	k_mutex_unlock(&led_mutex);
+}
+
+#if defined(CONFIG_SHELL)
+
+static const char *const pattern_names[STATUS_LED_PATTERN_COUNT] = {
+	[STATUS_LED_OFF] = "off",
+	[STATUS_LED_ON] = "on",
+	[STATUS_LED_BLINK] = "blink",
+	[STATUS_LED_DOUBLE_BLINK] = "double-blink",
+	[STATUS_LED_BREATHE] = "breathe",
+};
+
+static int cmd_status_led(const struct shell *sh, size_t argc, char **argv)
+{
+	struct status_led_stats s;
+	enum status_led_pattern shown[STATUS_LED_ID_COUNT];
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	k_mutex_lock(&led_mutex, K_FOREVER);
+	memcpy(shown, patterns, sizeof(shown));
+	k_mutex_unlock(&led_mutex);
+
+	status_led_get_stats(&s);
+
+	shell_print(sh, "Pairing LED: %s, status LED: %s",
+		    pattern_names[shown[STATUS_LED_ID_PAIRING]],
+		    pattern_names[shown[STATUS_LED_ID_STATUS]]);
+	shell_print(sh, "%u sequence playbacks, %u stops", s.playbacks, s.stops);
+
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((aqm), statusled, NULL, "Status LED patterns", cmd_status_led, 1, 0);
+
+#endif /* CONFIG_SHELL */
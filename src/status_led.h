@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef STATUS_LED_H
+#define STATUS_LED_H
+
+#include <stdint.h>
+
+/* Single colour LEDs on the pwm0 channels of the pwm-leds node */
+enum status_led_id {
+	/* pwm_led0, identify and network steering */
+	STATUS_LED_ID_PAIRING,
+	/* pwm_led1, calibration */
+	STATUS_LED_ID_STATUS,
+	STATUS_LED_ID_COUNT,
+};
+
+enum status_led_pattern {
+	STATUS_LED_OFF,
+	STATUS_LED_ON,
+	/* 100 ms on, 100 ms off */
+	STATUS_LED_BLINK,
+	/* Two 100 ms flashes a second */
+	STATUS_LED_DOUBLE_BLINK,
+	/* Perceptually linear fade in and out over STATUS_LED_CYCLE_MSEC */
+	STATUS_LED_BREATHE,
+	STATUS_LED_PATTERN_COUNT,
+};
+
+/* Length of the sequence played in a loop by the PWM peripheral */
+#define STATUS_LED_CYCLE_MSEC 2000
+
+struct status_led_stats {
+	/* Sequence (re)starts, the only times the CPU touches the PWM */
+	uint32_t playbacks;
+	/* Sequence stops with all LEDs off */
+	uint32_t stops;
+};
+
+/**
+ * @brief Configures the LED pins, all LEDs are off.
+ *
+ * The PWM peripheral is enabled only while at least one LED shows a pattern.
+ *
+ * @return 0 if success, error code if failure.
+ */
+int status_led_init(void);
+
+/**
+ * @brief Shows the pattern on the LED.
+ *
+ * The patterns of all LEDs are written into one sequence that the PWM peripheral plays in
+ * a loop, the CPU is not woken up until the next change. Safe to call from any thread.
+ */
+void status_led_set(enum status_led_id led, enum status_led_pattern pattern);
+
+/**
+ * @brief Returns playback statistics. Safe to call from any thread.
+ */
+void status_led_get_stats(struct status_led_stats *stats);
+
+#endif /* STATUS_LED_H */
@@ -0,0 +1,385 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <zephyr/device.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+
+#if defined(CONFIG_AIR_MONITOR_TRACE_SINK_UART)
+#include <zephyr/drivers/uart.h>
+#else
+#include <zephyr/storage/flash_map.h>
+#endif
+
+#include "trace_recorder.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
+
+#if defined(CONFIG_AIR_MONITOR_TRACE_SINK_UART)
+
+BUILD_ASSERT(DT_HAS_CHOSEN(aqm_trace_uart),
+	     "Trace UART sink needs the aqm,trace-uart chosen node, see trace_recorder.overlay");
+
+static const struct device *const uart = DEVICE_DT_GET(DT_CHOSEN(aqm_trace_uart));
+
+#else
+
+#if defined(FIXED_PARTITION_ID)
+#define TRACE_AREA_ID FIXED_PARTITION_ID(storage_partition)
+#else
+#define TRACE_AREA_ID FLASH_AREA_ID(storage)
+#endif
+
+/* Owned by trace_mutex */
+static const struct flash_area *fa;
+static size_t offset;
+
+#endif /* CONFIG_AIR_MONITOR_TRACE_SINK_UART */
+
+static K_MUTEX_DEFINE(trace_mutex);
+
+/* Owned by trace_mutex */
+static bool ready;
+static bool recording;
+static bool synced;
+static int64_t last_timestamp;
+static struct trace_recorder_stats stats;
+
+#if defined(CONFIG_AIR_MONITOR_TRACE_SINK_UART)
+
+static int sink_write(const uint8_t *buf, size_t len)
+{
+	/* Dedicated port, a disconnected host only makes the bytes disappear */
+	for (size_t i = 0; i < len; i++) {
+		uart_poll_out(uart, buf[i]);
+	}
+
+	return 0;
+}
+
+static int sink_start(void)
+{
+	uint8_t header[SENSOR_TRACE_HEADER_SIZE];
+
+	/* Every recording on the stream starts a new trace */
+	sensor_trace_put_header(header);
+
+	return sink_write(header, sizeof(header));
+}
+
+static int sink_open(void)
+{
+	if (!device_is_ready(uart)) {
+		return -ENODEV;
+	}
+
+	stats.capacity = 0;
+
+	return 0;
+}
+
+#else
+
+static int sink_write(const uint8_t *buf, size_t len)
+{
+	if (offset + len > fa->fa_size) {
+		return -ENOSPC;
+	}
+
+	int err = flash_area_write(fa, offset, buf, len);
+
+	if (!err) {
+		offset += len;
+		stats.used = offset;
+	}
+
+	return err;
+}
+
+static int sink_start(void)
+{
+	/* Recording continues the trace in flash, the sync record marks the restart */
+	return 0;
+}
+
+static int sink_erase(void)
+{
+	uint8_t header[SENSOR_TRACE_HEADER_SIZE];
+	int err = flash_area_erase(fa, 0, fa->fa_size);
+
+	if (err) {
+		return err;
+	}
+
+	offset = 0;
+	synced = false;
+	sensor_trace_put_header(header);
+
+	return sink_write(header, sizeof(header));
+}
+
+static int sink_open(void)
+{
+	uint8_t header[SENSOR_TRACE_HEADER_SIZE];
+	size_t lo = 0;
+	size_t hi;
+	int err;
+
+	err = flash_area_open(TRACE_AREA_ID, &fa);
+	if (err) {
+		return err;
+	}
+
+	stats.capacity = fa->fa_size;
+
+	err = flash_area_read(fa, 0, header, sizeof(header));
+	if (err) {
+		return err;
+	}
+
+	if (!sensor_trace_check_header(header)) {
+		LOG_WRN("No sensor trace in the storage partition, erasing it");
+		return sink_erase();
+	}
+
+	/* Records are written back to back, binary search for the first erased one */
+	hi = (fa->fa_size - SENSOR_TRACE_HEADER_SIZE) / SENSOR_TRACE_RECORD_SIZE;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		uint8_t tag[2];
+
+		err = flash_area_read(fa, SENSOR_TRACE_HEADER_SIZE + mid * SENSOR_TRACE_RECORD_SIZE,
+				      tag, sizeof(tag));
+		if (err) {
+			return err;
+		}
+
+		if (sys_get_le16(tag) == SENSOR_TRACE_TAG_END) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+
+	offset = SENSOR_TRACE_HEADER_SIZE + lo * SENSOR_TRACE_RECORD_SIZE;
+	stats.used = offset;
+
+	return 0;
+}
+
+#endif /* CONFIG_AIR_MONITOR_TRACE_SINK_UART */
+
+static int trace_recorder_start(void)
+{
+	int err = sink_start();
+
+	if (!err) {
+		recording = true;
+		synced = false;
+	}
+
+	return err;
+}
+
+int trace_recorder_init(void)
+{
+	k_mutex_lock(&trace_mutex, K_FOREVER);
+
+	int err = sink_open();
+
+	if (!err) {
+		ready = true;
+		err = trace_recorder_start();
+	}
+
+	k_mutex_unlock(&trace_mutex);
+
+	if (err) {
+		LOG_ERR("Cannot start the sensor trace recorder: %d", err);
+	}
+
+	return err;
+}
+
+void trace_recorder_add(int64_t timestamp, const struct sensor_trace_frame *frame)
+{
+	uint8_t buf[2 * SENSOR_TRACE_RECORD_SIZE];
+	size_t len = 0;
+
+	k_mutex_lock(&trace_mutex, K_FOREVER);
+
+	if (!recording) {
+		k_mutex_unlock(&trace_mutex);
+		return;
+	}
+
+	int64_t delta = (timestamp - last_timestamp) / SENSOR_TRACE_TICK_MSEC;
+
+	if (!synced || delta < 0 || delta > SENSOR_TRACE_DELTA_MAX) {
+		sensor_trace_put_sync(buf, (uint32_t)timestamp);
+		len += SENSOR_TRACE_RECORD_SIZE;
+		last_timestamp = timestamp;
+		delta = 0;
+		synced = true;
+	} else {
+		/* Deltas are truncated to ticks, the error must not accumulate */
+		last_timestamp += delta * SENSOR_TRACE_TICK_MSEC;
+	}
+
+	sensor_trace_put_frame(&buf[len], (uint16_t)delta, frame);
+	len += SENSOR_TRACE_RECORD_SIZE;
+
+	int err = sink_write(buf, len);
+
+	if (err) {
+		stats.dropped++;
+		synced = false;
+
+		if (err == -ENOSPC) {
+			LOG_WRN("Sensor trace full, recording stopped");
+			recording = false;
+		}
+	} else {
+		stats.frames++;
+	}
+
+	k_mutex_unlock(&trace_mutex);
+}
+
+void trace_recorder_get_stats(struct trace_recorder_stats *out)
+{
+	k_mutex_lock(&trace_mutex, K_FOREVER);
+
+	*out = stats;
+	out->recording = recording;
+
+	k_mutex_unlock(&trace_mutex);
+}
+
+#if defined(CONFIG_SHELL)
+
+static int cmd_trace_show(const struct shell *sh, size_t argc, char **argv)
+{
+	struct trace_recorder_stats s;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	trace_recorder_get_stats(&s);
+
+	shell_print(sh, "Sensor trace: %s, %u frames, %u dropped",
+		    s.recording ? "recording" : "stopped", s.frames, s.dropped);
+
+	if (s.capacity) {
+		shell_print(sh, "Flash: %u of %u bytes used", s.used, s.capacity);
+	}
+
+	return 0;
+}
+
+static int cmd_trace_start(const struct shell *sh, size_t argc, char **argv)
+{
+	int err = -ENODEV;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	k_mutex_lock(&trace_mutex, K_FOREVER);
+
+	if (ready) {
+		err = trace_recorder_start();
+	}
+
+	k_mutex_unlock(&trace_mutex);
+
+	if (err) {
+		shell_error(sh, "Cannot start recording: %d", err);
+	}
+
+	return err;
+}
+
+static int cmd_trace_stop(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(sh);
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	k_mutex_lock(&trace_mutex, K_FOREVER);
+	recording = false;
+	k_mutex_unlock(&trace_mutex);
+
+	return 0;
+}
+
+#if defined(CONFIG_AIR_MONITOR_TRACE_SINK_FLASH)
+
+static int cmd_trace_erase(const struct shell *sh, size_t argc, char **argv)
+{
+	int err = -ENODEV;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	k_mutex_lock(&trace_mutex, K_FOREVER);
+
+	if (ready) {
+		err = sink_erase();
+	}
+
+	k_mutex_unlock(&trace_mutex);
+
+	if (err) {
+		shell_error(sh, "Cannot erase the trace: %d", err);
+	}
+
+	return err;
+}
+
+/* Hex dump of the whole trace, scripts/aqm_trace.py decodes it */
+static int cmd_trace_dump(const struct shell *sh, size_t argc, char **argv)
+{
+	uint8_t buf[64];
+	int err = 0;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	k_mutex_lock(&trace_mutex, K_FOREVER);
+
+	for (size_t pos = 0; ready && pos < offset && !err; pos += sizeof(buf)) {
+		size_t len = MIN(sizeof(buf), offset - pos);
+
+		err = flash_area_read(fa, pos, buf, len);
+		if (!err) {
+			shell_hexdump(sh, buf, len);
+		}
+	}
+
+	k_mutex_unlock(&trace_mutex);
+
+	return err;
+}
+
+#endif /* CONFIG_AIR_MONITOR_TRACE_SINK_FLASH */
+
+SHELL_STATIC_SUBCMD_SET_CREATE(trace_cmds,
+	SHELL_CMD(show, NULL, "Show recorder state", cmd_trace_show),
+	SHELL_CMD(start, NULL, "Start recording", cmd_trace_start),
+	SHELL_CMD(stop, NULL, "Stop recording", cmd_trace_stop),
+#if defined(CONFIG_AIR_MONITOR_TRACE_SINK_FLASH)
+	SHELL_CMD(erase, NULL, "Erase the trace in flash", cmd_trace_erase),
+	SHELL_CMD(dump, NULL, "Hex dump of the trace in flash", cmd_trace_dump),
+#endif
+	SHELL_SUBCMD_SET_END);
+
+SHELL_SUBCMD_ADD((aqm), trace, &trace_cmds, "Sensor trace recorder", cmd_trace_show, 1, 0);
+
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sensor_trace.h"
+
+struct trace_recorder_stats {
+	bool recording;
+	/* Measurements recorded since boot */
+	uint32_t frames;
+	/* Measurements lost because the sink failed or was full */
+	uint32_t dropped;
+	/* Trace bytes in flash, 0 for the UART sink */
+	uint32_t used;
+	uint32_t capacity;
+};
+
+/**
+ * @brief Opens the trace sink and starts recording.
+ *
+ * The UART sink starts a new trace with its header. The flash sink appends to the trace
+ * left in the storage partition by previous boots.
+ *
+ * @return 0 if success, error code if failure.
+ */
+int trace_recorder_init(void);
+
+/**
+ * @brief Records a measurement. Called from the sensor thread for every fetched sample.
+ *
+ * @param timestamp  Uptime of the measurement in milliseconds.
+ * @param frame      Raw signal words of the measurement.
+ */
+void trace_recorder_add(int64_t timestamp, const struct sensor_trace_frame *frame);
+
+/**
+ * @brief Returns recorder statistics. Safe to call from any thread.
+ */
+void trace_recorder_get_stats(struct trace_recorder_stats *stats);
+
+#endif /* TRACE_RECORDER_H */
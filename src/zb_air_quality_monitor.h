@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef ZB_AIR_QUALITY_MONITOR_H
+#define ZB_AIR_QUALITY_MONITOR_H 1
+
+#include <zcl/zb_zcl_temp_measurement_addons.h>
+#include <zcl/zb_zcl_basic_addons.h>
+#include <zcl/zb_zcl_power_config.h>
+
+#include "zcl/zb_zcl_concentration_measurement.h"
+#include "zcl/zb_zcl_air_monitor_control.h"
+#include "zcl/zb_zcl_air_monitor_diagnostics.h"
+#include "zcl/zb_zcl_air_monitor_history.h"
+
+/* Temperature sensor device version */
+#define ZB_HA_DEVICE_VER_TEMPERATURE_SENSOR 0
+/* Basic, power configuration, identify, temperature, humidity, measurement, poll control,
+ * air monitor control, diagnostics and history
+ */
+#define ZB_HA_AIR_QUALITY_MONITOR_IN_CLUSTER_NUM 10
+/* Identify */
+#define ZB_HA_AIR_QUALITY_MONITOR_OUT_CLUSTER_NUM 1
+
+/* Temperature, humidity, co2, ???linkquality???, calibration state and correction,
+ * sampling mode, duty cycle and supply voltage
+ */
+#define ZB_HA_AIR_QUALITY_MONITOR_REPORT_ATTR_COUNT 9
+
+#define ZB_HA_DECLARE_AIR_QUALITY_MONITOR_CLUSTER_LIST(                              \
+	cluster_list_name,                                                               \
+	basic_attr_list,                                                                 \
+	power_config_attr_list,                                                          \
+	identify_client_attr_list,                                                       \
+	identify_server_attr_list,                                                       \
+	temperature_measurement_attr_list,                                               \
+	humidity_measurement_attr_list,                                                  \
+	concentration_measurement_attr_list,                                             \
+	poll_control_attr_list,                                                          \
+	air_monitor_control_attr_list,                                                   \
+	air_monitor_diagnostics_attr_list,                                               \
+	air_monitor_history_attr_list)                                                   \
+	zb_zcl_cluster_desc_t cluster_list_name[] =                                      \
+		{                                                                            \
+			ZB_ZCL_CLUSTER_DESC(                                                     \
+				ZB_ZCL_CLUSTER_ID_BASIC,                                             \
+				ZB_ZCL_ARRAY_SIZE(basic_attr_list, zb_zcl_attr_t),                   \
+				(basic_attr_list),                                                   \
+				ZB_ZCL_CLUSTER_SERVER_ROLE,                                          \
+				ZB_ZCL_MANUF_CODE_INVALID),                                          \
+			ZB_ZCL_CLUSTER_DESC(                                                     \
+				ZB_ZCL_CLUSTER_ID_POWER_CONFIG,                                      \
+				ZB_ZCL_ARRAY_SIZE(power_config_attr_list, zb_zcl_attr_t),            \
+				(power_config_attr_list),                                            \
+				ZB_ZCL_CLUSTER_SERVER_ROLE,                                          \
+				ZB_ZCL_MANUF_CODE_INVALID),                                          \
+			ZB_ZCL_CLUSTER_DESC(                                                     \
+				ZB_ZCL_CLUSTER_ID_IDENTIFY,                                          \
+				ZB_ZCL_ARRAY_SIZE(identify_server_attr_list, zb_zcl_attr_t),         \
+				(identify_server_attr_list),                                         \
+				ZB_ZCL_CLUSTER_SERVER_ROLE,                                          \
+				ZB_ZCL_MANUF_CODE_INVALID),                                          \
+			ZB_ZCL_CLUSTER_DESC(                                                     \
+				ZB_ZCL_CLUSTER_ID_TEMP_MEASUREMENT,                                  \
+				ZB_ZCL_ARRAY_SIZE(temperature_measurement_attr_list, zb_zcl_attr_t), \
+				(temperature_measurement_attr_list),                                 \
+				ZB_ZCL_CLUSTER_SERVER_ROLE,                                          \
+				ZB_ZCL_MANUF_CODE_INVALID),                                          \
+			ZB_ZCL_CLUSTER_DESC(                                                     \
+				ZB_ZCL_CLUSTER_ID_REL_HUMIDITY_MEASUREMENT,                          \
+				ZB_ZCL_ARRAY_SIZE(humidity_measurement_attr_list, zb_zcl_attr_t),    \
+				(humidity_measurement_attr_list),                                    \
+				ZB_ZCL_CLUSTER_SERVER_ROLE,                                          \
+				ZB_ZCL_MANUF_CODE_INVALID),                                          \
+			ZB_ZCL_CLUSTER_DESC(                                                     \
+				ZB_ZCL_CLUSTER_ID_CONCENTRATION_MEASUREMENT,                          \
+				ZB_ZCL_ARRAY_SIZE(concentration_measurement_attr_list, zb_zcl_attr_t),    \
+				(concentration_measurement_attr_list),                                    \
+				ZB_ZCL_CLUSTER_SERVER_ROLE,                                          \
+				ZB_ZCL_MANUF_CODE_INVALID),                                          \
+			ZB_ZCL_CLUSTER_DESC(                                                     \
+				ZB_ZCL_CLUSTER_ID_POLL_CONTROL,                                      \
+				ZB_ZCL_ARRAY_SIZE(poll_control_attr_list, zb_zcl_attr_t),            \
+				(poll_control_attr_list),                                            \
+				ZB_ZCL_CLUSTER_SERVER_ROLE,                                          \
+				ZB_ZCL_MANUF_CODE_INVALID),                                          \
+			ZB_ZCL_CLUSTER_DESC(                                                     \
+				ZB_ZCL_CLUSTER_ID_AIR_MONITOR_CONTROL,                               \
+				ZB_ZCL_ARRAY_SIZE(air_monitor_control_attr_list, zb_zcl_attr_t),     \
+				(air_monitor_control_attr_list),                                     \
+				ZB_ZCL_CLUSTER_SERVER_ROLE,                                          \
+				ZB_ZCL_MANUF_CODE_INVALID),                                          \
+			ZB_ZCL_CLUSTER_DESC(                                                     \
+				ZB_ZCL_CLUSTER_ID_AIR_MONITOR_DIAGNOSTICS,                           \
+				ZB_ZCL_ARRAY_SIZE(air_monitor_diagnostics_attr_list, zb_zcl_attr_t), \
+				(air_monitor_diagnostics_attr_list),                                 \
+				ZB_ZCL_CLUSTER_SERVER_ROLE,                                          \
+				ZB_ZCL_MANUF_CODE_INVALID),                                          \
+			ZB_ZCL_CLUSTER_DESC(                                                     \
+				ZB_ZCL_CLUSTER_ID_AIR_MONITOR_HISTORY,                               \
+				ZB_ZCL_ARRAY_SIZE(air_monitor_history_attr_list, zb_zcl_attr_t),     \
+				(air_monitor_history_attr_list),                                     \
+				ZB_ZCL_CLUSTER_SERVER_ROLE,                                          \
+				ZB_ZCL_MANUF_CODE_INVALID),                                          \
+			ZB_ZCL_CLUSTER_DESC(                                                     \
+				ZB_ZCL_CLUSTER_ID_IDENTIFY,                                          \
+				ZB_ZCL_ARRAY_SIZE(identify_client_attr_list, zb_zcl_attr_t),         \
+				(identify_client_attr_list),                                         \
+				ZB_ZCL_CLUSTER_CLIENT_ROLE,                                          \
+				ZB_ZCL_MANUF_CODE_INVALID),                                          \
+	}
+
+#define ZB_ZCL_DECLARE_AIR_QUALITY_MONITOR_DESC(            \
+	ep_name,                                                \
+	ep_id,                                                  \
+	in_clust_num,                                           \
+	out_clust_num)                                          \
+	ZB_DECLARE_SIMPLE_DESC(in_clust_num, out_clust_num);    \
+	ZB_AF_SIMPLE_DESC_TYPE(in_clust_num, out_clust_num)     \
+	simple_desc_##ep_name =                                 \
+		{                                                   \
+			ep_id,                                          \
+			ZB_AF_HA_PROFILE_ID,                            \
+			ZB_HA_TEMPERATURE_SENSOR_DEVICE_ID,             \
+			ZB_HA_DEVICE_VER_TEMPERATURE_SENSOR,            \
+			0,                                              \
+			in_clust_num,                                   \
+			out_clust_num,                                  \
+			{                                               \
+				ZB_ZCL_CLUSTER_ID_BASIC,                    \
+				ZB_ZCL_CLUSTER_ID_POWER_CONFIG,             \
+				ZB_ZCL_CLUSTER_ID_IDENTIFY,                 \
+				ZB_ZCL_CLUSTER_ID_TEMP_MEASUREMENT,         \
+				ZB_ZCL_CLUSTER_ID_REL_HUMIDITY_MEASUREMENT, \
+				ZB_ZCL_CLUSTER_ID_CONCENTRATION_MEASUREMENT,\
+				ZB_ZCL_CLUSTER_ID_POLL_CONTROL,             \
+				ZB_ZCL_CLUSTER_ID_AIR_MONITOR_CONTROL,      \
+				ZB_ZCL_CLUSTER_ID_AIR_MONITOR_DIAGNOSTICS,  \
+				ZB_ZCL_CLUSTER_ID_AIR_MONITOR_HISTORY,      \
+				ZB_ZCL_CLUSTER_ID_IDENTIFY,                 \
+			}}
+
+#define ZB_HA_DECLARE_AIR_QUALITY_MONITOR_EP(ep_name, ep_id, cluster_list) \
+	ZB_ZCL_DECLARE_AIR_QUALITY_MONITOR_DESC(                               \
+		ep_name,                                                           \
+		ep_id,                                                             \
+		ZB_HA_AIR_QUALITY_MONITOR_IN_CLUSTER_NUM,                          \
+		ZB_HA_AIR_QUALITY_MONITOR_OUT_CLUSTER_NUM);                        \
+	ZBOSS_DEVICE_DECLARE_REPORTING_CTX(                                    \
+		reporting_info##ep_name,                                           \
+		ZB_HA_AIR_QUALITY_MONITOR_REPORT_ATTR_COUNT);                      \
+	ZB_AF_DECLARE_ENDPOINT_DESC(                                           \
+		ep_name,                                                           \
+		ep_id,                                                             \
+		ZB_AF_HA_PROFILE_ID,                                               \
+		0,                                                                 \
+		NULL,                                                              \
+		ZB_ZCL_ARRAY_SIZE(cluster_list, zb_zcl_cluster_desc_t),            \
+		cluster_list,                                                      \
+		(zb_af_simple_desc_1_1_t *)&simple_desc_##ep_name,                 \
+		ZB_HA_AIR_QUALITY_MONITOR_REPORT_ATTR_COUNT, reporting_info##ep_name, 0, NULL)
+
+/* Voltages are in 100 mV, the supply voltage is reported as the battery voltage */
+struct zb_zcl_power_config_attrs_t
+{
+	zb_uint8_t battery_voltage;
+	zb_uint8_t battery_size;
+	zb_uint8_t battery_quantity;
+	zb_uint8_t battery_rated_voltage;
+	zb_uint8_t battery_alarm_mask;
+	zb_uint8_t battery_voltage_min_threshold;
+};
+
+struct zb_zcl_humidity_measurement_attrs_t
+{
+	zb_int16_t measure_value;
+	zb_int16_t min_measure_value;
+	zb_int16_t max_measure_value;
+	zb_uint16_t tolerance;
+};
+
+/* All concentration measurement attributes are ZB_ZCL_ATTR_TYPE_SINGLE */
+struct zb_zcl_concentration_measurement_attrs_t
+{
+	float measure_value;
+	float min_measure_value;
+	float max_measure_value;
+	float tolerance;
+};
+
+/* Poll control intervals are in quarter seconds, timeouts too */
+struct zb_zcl_poll_control_server_attrs_t
+{
+	zb_uint32_t checkin_interval;
+	zb_uint32_t long_poll_interval;
+	zb_uint16_t short_poll_interval;
+	zb_uint16_t fast_poll_timeout;
+	zb_uint32_t checkin_interval_min;
+	zb_uint32_t long_poll_interval_min;
+	zb_uint16_t fast_poll_timeout_max;
+};
+
+struct zb_zcl_air_monitor_control_attrs_t
+{
+	zb_uint8_t calibration_state;
+	zb_int16_t calibration_correction;
+	zb_uint16_t calibration_reference;
+	zb_uint8_t sampling_mode;
+	zb_uint16_t duty_cycle;
+	zb_uint16_t fetch_lag;
+};
+
+struct zb_zcl_air_monitor_diagnostics_attrs_t
+{
+	zb_uint16_t alarm_delay_max;
+	zb_uint16_t alarm_delay_avg;
+	zb_uint16_t callback_delay_max;
+	zb_uint16_t callback_delay_avg;
+	zb_uint32_t buf_get_failures;
+	zb_uint32_t schedule_failures;
+	zb_uint32_t memory_low;
+	zb_uint32_t memory_low_run_max;
+	zb_uint32_t oom;
+	zb_uint8_t alarm_histogram[ZB_ZCL_AIR_MONITOR_DIAGNOSTICS_HISTOGRAM_SIZE];
+	zb_uint8_t callback_histogram[ZB_ZCL_AIR_MONITOR_DIAGNOSTICS_HISTOGRAM_SIZE];
+	zb_uint32_t reports_sent;
+	zb_uint32_t reports_suppressed;
+	zb_uint8_t stack_watermarks[ZB_ZCL_AIR_MONITOR_DIAGNOSTICS_STACK_WATERMARKS_SIZE];
+	zb_uint16_t stack_headroom_min;
+	zb_uint32_t heap_peak;
+	zb_uint8_t mem_slab_peak;
+};
+
+struct zb_zcl_air_monitor_history_attrs_t
+{
+	zb_uint32_t oldest_time;
+	zb_uint32_t newest_time;
+	zb_uint16_t sample_count;
+	zb_uint16_t interval;
+	zb_uint32_t current_time;
+	zb_uint16_t log_boot;
+};
+
+struct zb_device_ctx
+{
+	zb_zcl_basic_attrs_ext_t basic_attr;
+	struct zb_zcl_power_config_attrs_t power_config_attrs;
+	zb_zcl_identify_attrs_t identify_attr;
+	zb_zcl_temp_measurement_attrs_t temp_attrs;
+	struct zb_zcl_humidity_measurement_attrs_t humidity_attrs;
+	struct zb_zcl_concentration_measurement_attrs_t concentration_attrs;
+	struct zb_zcl_poll_control_server_attrs_t poll_control_attrs;
+	struct zb_zcl_air_monitor_control_attrs_t control_attrs;
+	struct zb_zcl_air_monitor_diagnostics_attrs_t diagnostics_attrs;
+	struct zb_zcl_air_monitor_history_attrs_t history_attrs;
+};
+
+#endif /* ZB_AIR_QUALITY_MONITOR_H */
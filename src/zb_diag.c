@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+
+#include "zb_diag.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_ZIGBEE_AIR_QUALITY_MONITOR_LOG_LEVEL);
+
+/* Callbacks tracked at the same time, one entry per callback function */
+#define ZB_DIAG_TRACKED_CALLBACKS 8
+
+struct tracked_callback {
+	zb_callback_t func;
+	int64_t due;
+	enum zb_diag_latency_type type;
+};
+
+static struct k_spinlock lock;
+static struct tracked_callback tracked[ZB_DIAG_TRACKED_CALLBACKS];
+static struct zb_diag_latency latencies[ZB_DIAG_LATENCY_COUNT];
+static struct zb_diag_counters counters;
+static uint32_t memory_low_streak;
+
+static void zb_diag_sample_pool(void)
+{
+	bool memory_low = zb_buf_memory_low();
+	bool oom = zb_buf_is_oom_state();
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	counters.pool_samples++;
+
+	if (oom) {
+		counters.oom++;
+	}
+
+	if (memory_low) {
+		counters.memory_low++;
+		memory_low_streak++;
+		counters.memory_low_streak_max = MAX(counters.memory_low_streak_max,
+						     memory_low_streak);
+	} else {
+		memory_low_streak = 0;
+	}
+
+	k_spin_unlock(&lock, key);
+}
+
+void zb_diag_scheduled(zb_callback_t func, uint32_t delay_ms)
+{
+	struct tracked_callback *free_entry = NULL;
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	for (int i = 0; i < ZB_DIAG_TRACKED_CALLBACKS; i++) {
+		if (tracked[i].func == func) {
+			free_entry = &tracked[i];
+			break;
+		}
+		if (!tracked[i].func && !free_entry) {
+			free_entry = &tracked[i];
+		}
+	}
+
+	/* Untracked if the table is full, the callback still runs */
+	if (free_entry) {
+		free_entry->func = func;
+		free_entry->due = k_uptime_get() + delay_ms;
+		free_entry->type = delay_ms ? ZB_DIAG_LATENCY_ALARM : ZB_DIAG_LATENCY_CALLBACK;
+	}
+
+	k_spin_unlock(&lock, key);
+}
+
+void zb_diag_fired(zb_callback_t func)
+{
+	int64_t now = k_uptime_get();
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	for (int i = 0; i < ZB_DIAG_TRACKED_CALLBACKS; i++) {
+		if (tracked[i].func != func) {
+			continue;
+		}
+
+		struct zb_diag_latency *latency = &latencies[tracked[i].type];
+		uint32_t delay = (uint32_t)MAX(now - tracked[i].due, 0);
+		uint32_t bin = MIN(delay ? 32 - __builtin_clz(delay) : 0, ZB_DIAG_HISTOGRAM_BINS - 1);
+
+		latency->count++;
+		latency->max_ms = MAX(latency->max_ms, delay);
+		latency->total_ms += delay;
+		latency->histogram[bin]++;
+		tracked[i].func = NULL;
+		break;
+	}
+
+	k_spin_unlock(&lock, key);
+
+	zb_diag_sample_pool();
+}
+
+void zb_diag_schedule_failed(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	counters.schedule_failures++;
+
+	k_spin_unlock(&lock, key);
+
+	LOG_WRN("ZBOSS scheduler queue full");
+}
+
+zb_bufid_t zb_diag_buf_get_out(void)
+{
+	zb_bufid_t bufid = zb_buf_get_out();
+
+	if (!bufid) {
+		k_spinlock_key_t key = k_spin_lock(&lock);
+
+		counters.buf_get_failures++;
+
+		k_spin_unlock(&lock, key);
+	}
+
+	zb_diag_sample_pool();
+
+	return bufid;
+}
+
+void zb_diag_get_latency(enum zb_diag_latency_type type, struct zb_diag_latency *latency)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	*latency = latencies[type];
+
+	k_spin_unlock(&lock, key);
+}
+
+void zb_diag_get_counters(struct zb_diag_counters *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	*out = counters;
+
+	k_spin_unlock(&lock, key);
+}
+
+void zb_diag_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	memset(latencies, 0, sizeof(latencies));
+	memset(&counters, 0, sizeof(counters));
+	memory_low_streak = 0;
+
+	k_spin_unlock(&lock, key);
+}
+
+#if defined(CONFIG_SHELL)
+
+static const char *const latency_names[] = {
+	[ZB_DIAG_LATENCY_ALARM] = "alarm",
+	[ZB_DIAG_LATENCY_CALLBACK] = "callback",
+};
+
+static int cmd_zbdiag_show(const struct shell *sh, size_t argc, char **argv)
+{
+	struct zb_diag_latency latency;
+	struct zb_diag_counters diag;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	for (int type = 0; type < ZB_DIAG_LATENCY_COUNT; type++) {
+		zb_diag_get_latency(type, &latency);
+
+		shell_print(sh, "%-8s delay [ms]: count %u avg %u max %u", latency_names[type],
+			    latency.count,
+			    latency.count ? (uint32_t)(latency.total_ms / latency.count) : 0,
+			    latency.max_ms);
+
+		/* Histogram bins as "<upper bound in ms>:<count>" */
+		for (int bin = 0; bin < ZB_DIAG_HISTOGRAM_BINS - 1; bin++) {
+			if (latency.histogram[bin]) {
+				shell_fprintf(sh, SHELL_NORMAL, " <%u:%u", BIT(bin),
+					      latency.histogram[bin]);
+			}
+		}
+		if (latency.histogram[ZB_DIAG_HISTOGRAM_BINS - 1]) {
+			shell_fprintf(sh, SHELL_NORMAL, " >=%u:%u", BIT(ZB_DIAG_HISTOGRAM_BINS - 2),
+				      latency.histogram[ZB_DIAG_HISTOGRAM_BINS - 1]);
+		}
+		shell_fprintf(sh, SHELL_NORMAL, "\n");
+	}
+
+	zb_diag_get_counters(&diag);
+
+	shell_print(sh, "buf get failures %u, schedule failures %u", diag.buf_get_failures,
+		    diag.schedule_failures);
+	shell_print(sh, "pool samples %u: memory low %u (longest run %u), oom %u",
+		    diag.pool_samples, diag.memory_low, diag.memory_low_streak_max, diag.oom);
+
+	return 0;
+}
+
+static int cmd_zbdiag_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	zb_diag_reset();
+	shell_print(sh, "ZBOSS diagnostics cleared");
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(zbdiag_cmds,
+	SHELL_CMD(show, NULL, "Show scheduling delays and buffer pool statistics", cmd_zbdiag_show),
+	SHELL_CMD(reset, NULL, "Clear statistics", cmd_zbdiag_reset),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_SUBCMD_ADD((aqm), zbdiag, &zbdiag_cmds, "ZBOSS scheduler and buffer diagnostics",
+		 cmd_zbdiag_show, 1, 0);
+
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ZB_DIAG_H
+#define ZB_DIAG_H
+
+#include <stdint.h>
+#include <zboss_api.h>
+#include <zb_nrf_platform.h>
+
+/* Delay between the time a callback was due and the time it ran */
+enum zb_diag_latency_type {
+	/* ZB_SCHEDULE_APP_ALARM, lateness after the requested delay */
+	ZB_DIAG_LATENCY_ALARM,
+	/* ZB_SCHEDULE_APP_CALLBACK and zigbee_schedule_callback(), queueing delay */
+	ZB_DIAG_LATENCY_CALLBACK,
+	ZB_DIAG_LATENCY_COUNT,
+};
+
+/* Bin 0 counts delays below 1 ms, bin n of [2^(n-1), 2^n) ms, the last bin everything longer */
+#define ZB_DIAG_HISTOGRAM_BINS 16
+
+struct zb_diag_latency {
+	uint32_t count;
+	uint32_t max_ms;
+	uint64_t total_ms;
+	uint32_t histogram[ZB_DIAG_HISTOGRAM_BINS];
+};
+
+struct zb_diag_counters {
+	/* zb_buf_get_out() calls that returned no buffer */
+	uint32_t buf_get_failures;
+	/* Callbacks and alarms rejected because the ZBOSS scheduler queue was full */
+	uint32_t schedule_failures;
+	/* Buffer pool state, sampled whenever a tracked callback runs */
+	uint32_t pool_samples;
+	uint32_t memory_low;
+	uint32_t oom;
+	/* Longest run of consecutive memory low samples, high-water mark of pool pressure */
+	uint32_t memory_low_streak_max;
+};
+
+/**
+ * @brief Records that the callback was scheduled to run after the delay.
+ *
+ * Safe to call from any thread.
+ */
+void zb_diag_scheduled(zb_callback_t func, uint32_t delay_ms);
+
+/**
+ * @brief Records that the callback runs now, must be called first thing in tracked callbacks.
+ */
+void zb_diag_fired(zb_callback_t func);
+
+/**
+ * @brief Counts a callback rejected by the ZBOSS scheduler.
+ */
+void zb_diag_schedule_failed(void);
+
+/**
+ * @brief Allocates an OUT buffer and counts allocation failures.
+ *
+ * @return Buffer ID, 0 if no buffer is available.
+ */
+zb_bufid_t zb_diag_buf_get_out(void);
+
+/**
+ * @brief Copies latency statistics of the given type.
+ */
+void zb_diag_get_latency(enum zb_diag_latency_type type, struct zb_diag_latency *latency);
+
+/**
+ * @brief Copies counters.
+ */
+void zb_diag_get_counters(struct zb_diag_counters *counters);
+
+/**
+ * @brief Clears all statistics.
+ */
+void zb_diag_reset(void);
+
+/**@brief ZB_SCHEDULE_APP_ALARM with scheduling delay tracking. */
+static inline zb_ret_t zb_diag_schedule_app_alarm(zb_callback_t func, zb_uint8_t param,
+						  zb_time_t delay)
+{
+	zb_diag_scheduled(func, ZB_TIME_BEACON_INTERVAL_TO_MSEC(delay));
+
+	zb_ret_t ret = ZB_SCHEDULE_APP_ALARM(func, param, delay);
+
+	if (ret != RET_OK) {
+		zb_diag_schedule_failed();
+	}
+
+	return ret;
+}
+
+/**@brief ZB_SCHEDULE_APP_CALLBACK with queueing delay tracking. */
+static inline zb_ret_t zb_diag_schedule_app_callback(zb_callback_t func, zb_uint8_t param)
+{
+	zb_diag_scheduled(func, 0);
+
+	zb_ret_t ret = ZB_SCHEDULE_APP_CALLBACK(func, param);
+
+	if (ret != RET_OK) {
+		zb_diag_schedule_failed();
+	}
+
+	return ret;
+}
+
+/**@brief zigbee_schedule_callback() with queueing delay tracking, callable from any thread. */
+static inline zb_ret_t zb_diag_schedule_callback(zb_callback_t func, zb_uint8_t param)
+{
+	zb_diag_scheduled(func, 0);
+
+	zb_ret_t ret = zigbee_schedule_callback(func, param);
+
+	if (ret != RET_OK) {
+		zb_diag_schedule_failed();
+	}
+
+	return ret;
+}
+
+#endif /* ZB_DIAG_H */
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+/* PURPOSE: Manufacturer specific Air Monitor Control cluster
+*/
+
+#include <zephyr/sys/byteorder.h>
+
+#include "zb_zcl_air_monitor_control.h"
+
+#define START_CALIBRATION_PAYLOAD_SIZE sizeof(zb_uint16_t)
+
+static zb_zcl_air_monitor_control_calibrate_cb_t calibrate_cb;
+
+static zb_bool_t reference_is_valid(zb_uint16_t reference)
+{
+	return reference >= ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_CALIBRATION_REFERENCE_MIN_VALUE &&
+	       reference <= ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_CALIBRATION_REFERENCE_MAX_VALUE;
+}
+
+static zb_ret_t check_value_air_monitor_control_server(zb_uint16_t attr_id, zb_uint8_t endpoint,
+						       zb_uint8_t *value)
+{
+	ZVUNUSED(endpoint);
+
+	if (attr_id == ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_CALIBRATION_REFERENCE_ID) {
+		zb_uint16_t reference = ZB_ZCL_ATTR_GET16(value);
+
+		return reference_is_valid(reference) ? RET_OK : RET_ERROR;
+	}
+
+	return RET_OK;
+}
+
+static zb_uint8_t start_calibration(zb_uint16_t reference)
+{
+	if (!reference_is_valid(reference)) {
+		return ZB_ZCL_STATUS_INVALID_VALUE;
+	}
+
+	if (calibrate_cb) {
+		calibrate_cb(reference);
+	}
+
+	return ZB_ZCL_STATUS_SUCCESS;
+}
+
+static zb_bool_t air_monitor_control_handler(zb_uint8_t param)
+{
+	zb_zcl_parsed_hdr_t cmd_info;
+	zb_uint8_t status = ZB_ZCL_STATUS_MALFORMED_CMD;
+
+	ZB_ZCL_COPY_PARSED_HEADER(param, &cmd_info);
+
+	if (cmd_info.is_common_command ||
+	    cmd_info.cmd_direction != ZB_ZCL_FRAME_DIRECTION_TO_SRV) {
+		return ZB_FALSE;
+	}
+
+	switch (cmd_info.cmd_id) {
+	case ZB_ZCL_CMD_AIR_MONITOR_CONTROL_START_CALIBRATION_ID:
+		if (zb_buf_len(param) >= START_CALIBRATION_PAYLOAD_SIZE) {
+			status = start_calibration(sys_get_le16(zb_buf_begin(param)));
+		}
+		break;
+	default:
+		return ZB_FALSE;
+	}
+
+	ZB_ZCL_PROCESS_COMMAND_FINISH(param, &cmd_info, status);
+
+	return ZB_TRUE;
+}
+
+void zb_zcl_air_monitor_control_set_calibrate_cb(zb_zcl_air_monitor_control_calibrate_cb_t cb)
+{
+	calibrate_cb = cb;
+}
+
+void zb_zcl_air_monitor_control_init_server(void)
+{
+	zb_zcl_add_cluster_handlers(ZB_ZCL_CLUSTER_ID_AIR_MONITOR_CONTROL,
+				    ZB_ZCL_CLUSTER_SERVER_ROLE,
+				    check_value_air_monitor_control_server,
+				    (zb_zcl_cluster_write_attr_hook_t)NULL,
+				    air_monitor_control_handler);
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+/* PURPOSE: Manufacturer specific Air Monitor Control cluster definitions
+*/
+
+#ifndef ZB_ZCL_AIR_MONITOR_CONTROL_H
+#define ZB_ZCL_AIR_MONITOR_CONTROL_H 1
+
+#include <zboss_api.h>
+#include <zboss_api_addons.h>
+
+/** @brief Air Monitor Control cluster ID, manufacturer specific range */
+#define ZB_ZCL_CLUSTER_ID_AIR_MONITOR_CONTROL 0xFC00
+
+/** @brief Default value for Air Monitor Control cluster revision global attribute */
+#define ZB_ZCL_AIR_MONITOR_CONTROL_CLUSTER_REVISION_DEFAULT ((zb_uint16_t)0x0001u)
+
+/*! @brief Air Monitor Control cluster attribute identifiers */
+enum zb_zcl_air_monitor_control_attr_e
+{
+  /** @brief Progress of the forced CO2 recalibration, see enum calibration_state */
+  ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_CALIBRATION_STATE_ID      = 0x0000,
+  /** @brief Correction in ppm applied by the last successful forced recalibration */
+  ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_CALIBRATION_CORRECTION_ID = 0x0001,
+  /** @brief Reference CO2 concentration in ppm used by the button triggered recalibration */
+  ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_CALIBRATION_REFERENCE_ID  = 0x0002,
+  /** @brief Current SCD4x measurement mode, see enum sampling_mode */
+  ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_SAMPLING_MODE_ID          = 0x0003,
+  /** @brief Share of time the sensor spent measuring since boot, in 0.01 % */
+  ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_DUTY_CYCLE_ID             = 0x0004,
+  /** @brief Average delay in ms from a measurement becoming available to its fetch */
+  ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_FETCH_LAG_ID              = 0x0005,
+};
+
+/*! @brief Air Monitor Control cluster command identifiers */
+enum zb_zcl_air_monitor_control_cmd_e
+{
+  /** @brief StartCalibration: Reference u16 (ppm), starts forced recalibration */
+  ZB_ZCL_CMD_AIR_MONITOR_CONTROL_START_CALIBRATION_ID = 0x00,
+};
+
+/** @brief CalibrationReference attribute minimum value (ppm) */
+#define ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_CALIBRATION_REFERENCE_MIN_VALUE 350
+
+/** @brief CalibrationReference attribute maximum value (ppm) */
+#define ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_CALIBRATION_REFERENCE_MAX_VALUE 2000
+
+/** @cond internals_doc */
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_CALIBRATION_STATE_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_CALIBRATION_STATE_ID,         \
+  ZB_ZCL_ATTR_TYPE_8BIT_ENUM,                                   \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY | ZB_ZCL_ATTR_ACCESS_REPORTING,  \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_CALIBRATION_CORRECTION_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_CALIBRATION_CORRECTION_ID,    \
+  ZB_ZCL_ATTR_TYPE_S16,                                         \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY | ZB_ZCL_ATTR_ACCESS_REPORTING,  \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_CALIBRATION_REFERENCE_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_CALIBRATION_REFERENCE_ID,     \
+  ZB_ZCL_ATTR_TYPE_U16,                                         \
+  ZB_ZCL_ATTR_ACCESS_READ_WRITE,                                \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_SAMPLING_MODE_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_SAMPLING_MODE_ID,             \
+  ZB_ZCL_ATTR_TYPE_8BIT_ENUM,                                   \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY | ZB_ZCL_ATTR_ACCESS_REPORTING,  \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_DUTY_CYCLE_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_DUTY_CYCLE_ID,                \
+  ZB_ZCL_ATTR_TYPE_U16,                                         \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY | ZB_ZCL_ATTR_ACCESS_REPORTING,  \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_FETCH_LAG_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_FETCH_LAG_ID,                 \
+  ZB_ZCL_ATTR_TYPE_U16,                                         \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+/** @endcond */ /* internals_doc */
+
+/** @brief Declare attribute list for Air Monitor Control cluster - server side
+    @param attr_list - attribute list name
+    @param calibration_state - pointer to variable to store CalibrationState attribute
+    @param calibration_correction - pointer to variable to store CalibrationCorrection attribute
+    @param calibration_reference - pointer to variable to store CalibrationReference attribute
+    @param sampling_mode - pointer to variable to store SamplingMode attribute
+    @param duty_cycle - pointer to variable to store DutyCycle attribute
+    @param fetch_lag - pointer to variable to store FetchLag attribute
+*/
+#define ZB_ZCL_DECLARE_AIR_MONITOR_CONTROL_ATTRIB_LIST(attr_list,                              \
+    calibration_state, calibration_correction, calibration_reference,                          \
+    sampling_mode, duty_cycle, fetch_lag)                                                      \
+  ZB_ZCL_START_DECLARE_ATTRIB_LIST_CLUSTER_REVISION(attr_list, ZB_ZCL_AIR_MONITOR_CONTROL)     \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_CALIBRATION_STATE_ID, (calibration_state))           \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_CALIBRATION_CORRECTION_ID, (calibration_correction)) \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_CALIBRATION_REFERENCE_ID, (calibration_reference))   \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_SAMPLING_MODE_ID, (sampling_mode))                   \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_DUTY_CYCLE_ID, (duty_cycle))                         \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_CONTROL_FETCH_LAG_ID, (fetch_lag))                           \
+  ZB_ZCL_FINISH_DECLARE_ATTRIB_LIST
+
+/** @brief Callback invoked from the ZBOSS thread when StartCalibration was received
+    @param reference_ppm - reference CO2 concentration carried by the command
+*/
+typedef void (*zb_zcl_air_monitor_control_calibrate_cb_t)(zb_uint16_t reference_ppm);
+
+/** @brief Registers the callback starting forced recalibration */
+void zb_zcl_air_monitor_control_set_calibrate_cb(zb_zcl_air_monitor_control_calibrate_cb_t cb);
+
+void zb_zcl_air_monitor_control_init_server(void);
+#define ZB_ZCL_CLUSTER_ID_AIR_MONITOR_CONTROL_SERVER_ROLE_INIT zb_zcl_air_monitor_control_init_server
+#define ZB_ZCL_CLUSTER_ID_AIR_MONITOR_CONTROL_CLIENT_ROLE_INIT ((zb_zcl_cluster_init_t)NULL)
+
+#endif /* ZB_ZCL_AIR_MONITOR_CONTROL_H */
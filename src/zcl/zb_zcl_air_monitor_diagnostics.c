@@ -0,0 +1,18 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+/* PURPOSE: Manufacturer specific Air Monitor Diagnostics cluster
+*/
+
+#include "zb_zcl_air_monitor_diagnostics.h"
+
+void zb_zcl_air_monitor_diagnostics_init_server(void)
+{
+	/* All attributes are read only, no checks or hooks needed */
+	zb_zcl_add_cluster_handlers(ZB_ZCL_CLUSTER_ID_AIR_MONITOR_DIAGNOSTICS,
+				    ZB_ZCL_CLUSTER_SERVER_ROLE, (zb_zcl_cluster_check_value_t)NULL,
+				    (zb_zcl_cluster_write_attr_hook_t)NULL,
+				    (zb_zcl_cluster_handler_t)NULL);
+}
@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+/* PURPOSE: Manufacturer specific Air Monitor Diagnostics cluster definitions
+*/
+
+#ifndef ZB_ZCL_AIR_MONITOR_DIAGNOSTICS_H
+#define ZB_ZCL_AIR_MONITOR_DIAGNOSTICS_H 1
+
+#include <zboss_api.h>
+#include <zboss_api_addons.h>
+
+/** @brief Air Monitor Diagnostics cluster ID, manufacturer specific range */
+#define ZB_ZCL_CLUSTER_ID_AIR_MONITOR_DIAGNOSTICS 0xFC01
+
+/** @brief Default value for Air Monitor Diagnostics cluster revision global attribute */
+#define ZB_ZCL_AIR_MONITOR_DIAGNOSTICS_CLUSTER_REVISION_DEFAULT ((zb_uint16_t)0x0001u)
+
+/** @brief Number of bins in the delay histogram attributes, bin n counts delays
+ *  of [2^(n-1), 2^n) ms, bin 0 delays below 1 ms and the last bin all longer delays
+ */
+#define ZB_ZCL_AIR_MONITOR_DIAGNOSTICS_HISTOGRAM_BINS 16
+
+/** @brief Size of the delay histogram attributes, length byte and a u16 per bin */
+#define ZB_ZCL_AIR_MONITOR_DIAGNOSTICS_HISTOGRAM_SIZE \
+  (1 + 2 * ZB_ZCL_AIR_MONITOR_DIAGNOSTICS_HISTOGRAM_BINS)
+
+/** @brief Number of threads in the stack watermark attribute: main, ZBOSS, logging, USB,
+ *  system workqueue and sensor workqueue
+ */
+#define ZB_ZCL_AIR_MONITOR_DIAGNOSTICS_STACK_THREADS 6
+
+/** @brief Size of the stack watermark attribute, length byte, used and size u16 per thread */
+#define ZB_ZCL_AIR_MONITOR_DIAGNOSTICS_STACK_WATERMARKS_SIZE \
+  (1 + 4 * ZB_ZCL_AIR_MONITOR_DIAGNOSTICS_STACK_THREADS)
+
+/*! @brief Air Monitor Diagnostics cluster attribute identifiers */
+enum zb_zcl_air_monitor_diagnostics_attr_e
+{
+  /** @brief Longest delay in ms of an app alarm after its due time */
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_ALARM_DELAY_MAX_ID       = 0x0000,
+  /** @brief Average delay in ms of an app alarm after its due time */
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_ALARM_DELAY_AVG_ID       = 0x0001,
+  /** @brief Longest time in ms an app callback waited in the ZBOSS scheduler queue */
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_CALLBACK_DELAY_MAX_ID    = 0x0002,
+  /** @brief Average time in ms an app callback waited in the ZBOSS scheduler queue */
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_CALLBACK_DELAY_AVG_ID    = 0x0003,
+  /** @brief Number of failed buffer allocations */
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_BUF_GET_FAILURES_ID      = 0x0004,
+  /** @brief Number of callbacks rejected by the full ZBOSS scheduler queue */
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_SCHEDULE_FAILURES_ID     = 0x0005,
+  /** @brief Number of buffer pool samples in memory low state */
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_MEMORY_LOW_ID            = 0x0006,
+  /** @brief Longest run of consecutive memory low samples */
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_MEMORY_LOW_RUN_MAX_ID    = 0x0007,
+  /** @brief Number of buffer pool samples in out of memory state */
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_OOM_ID                   = 0x0008,
+  /** @brief App alarm delay histogram, little endian u16 bin counts, saturated */
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_ALARM_HISTOGRAM_ID       = 0x0009,
+  /** @brief App callback delay histogram, little endian u16 bin counts, saturated */
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_CALLBACK_HISTOGRAM_ID    = 0x000A,
+  /** @brief Number of measurement values written to the attribute store by the report gate */
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_REPORTS_SENT_ID          = 0x000B,
+  /** @brief Number of changed measurement values held back by the report gate */
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_REPORTS_SUPPRESSED_ID    = 0x000C,
+  /** @brief Stack high-water marks, little endian u16 bytes used and u16 stack size per thread,
+   *  both 0 for threads not found
+   */
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_STACK_WATERMARKS_ID      = 0x000D,
+  /** @brief Smallest unused stack in bytes of the threads above, 0xFFFF if unknown */
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_STACK_HEADROOM_MIN_ID    = 0x000E,
+  /** @brief Peak allocation of the system heap in bytes */
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_HEAP_PEAK_ID             = 0x000F,
+  /** @brief Highest peak utilisation of any memory slab in % */
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_MEM_SLAB_PEAK_ID         = 0x0010,
+};
+
+/** @cond internals_doc */
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_ALARM_DELAY_MAX_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_ALARM_DELAY_MAX_ID,       \
+  ZB_ZCL_ATTR_TYPE_U16,                                         \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_ALARM_DELAY_AVG_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_ALARM_DELAY_AVG_ID,       \
+  ZB_ZCL_ATTR_TYPE_U16,                                         \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_CALLBACK_DELAY_MAX_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_CALLBACK_DELAY_MAX_ID,    \
+  ZB_ZCL_ATTR_TYPE_U16,                                         \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_CALLBACK_DELAY_AVG_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_CALLBACK_DELAY_AVG_ID,    \
+  ZB_ZCL_ATTR_TYPE_U16,                                         \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_BUF_GET_FAILURES_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_BUF_GET_FAILURES_ID,      \
+  ZB_ZCL_ATTR_TYPE_U32,                                         \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_SCHEDULE_FAILURES_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_SCHEDULE_FAILURES_ID,     \
+  ZB_ZCL_ATTR_TYPE_U32,                                         \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_MEMORY_LOW_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_MEMORY_LOW_ID,            \
+  ZB_ZCL_ATTR_TYPE_U32,                                         \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_MEMORY_LOW_RUN_MAX_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_MEMORY_LOW_RUN_MAX_ID,    \
+  ZB_ZCL_ATTR_TYPE_U32,                                         \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_OOM_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_OOM_ID,                   \
+  ZB_ZCL_ATTR_TYPE_U32,                                         \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_ALARM_HISTOGRAM_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_ALARM_HISTOGRAM_ID,       \
+  ZB_ZCL_ATTR_TYPE_OCTET_STRING,                                \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_CALLBACK_HISTOGRAM_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_CALLBACK_HISTOGRAM_ID,    \
+  ZB_ZCL_ATTR_TYPE_OCTET_STRING,                                \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_REPORTS_SENT_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_REPORTS_SENT_ID,          \
+  ZB_ZCL_ATTR_TYPE_U32,                                         \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_REPORTS_SUPPRESSED_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_REPORTS_SUPPRESSED_ID,    \
+  ZB_ZCL_ATTR_TYPE_U32,                                         \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_STACK_WATERMARKS_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_STACK_WATERMARKS_ID,      \
+  ZB_ZCL_ATTR_TYPE_OCTET_STRING,                                \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_STACK_HEADROOM_MIN_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_STACK_HEADROOM_MIN_ID,    \
+  ZB_ZCL_ATTR_TYPE_U16,                                         \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_HEAP_PEAK_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_HEAP_PEAK_ID,             \
+  ZB_ZCL_ATTR_TYPE_U32,                                         \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_MEM_SLAB_PEAK_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_MEM_SLAB_PEAK_ID,         \
+  ZB_ZCL_ATTR_TYPE_U8,                                          \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+/** @endcond */ /* internals_doc */
+
+/** @brief Declare attribute list for Air Monitor Diagnostics cluster - server side
+    @param attr_list - attribute list name
+    @param alarm_delay_max - pointer to variable to store AlarmDelayMax attribute
+    @param alarm_delay_avg - pointer to variable to store AlarmDelayAvg attribute
+    @param callback_delay_max - pointer to variable to store CallbackDelayMax attribute
+    @param callback_delay_avg - pointer to variable to store CallbackDelayAvg attribute
+    @param buf_get_failures - pointer to variable to store BufGetFailures attribute
+    @param schedule_failures - pointer to variable to store ScheduleFailures attribute
+    @param memory_low - pointer to variable to store MemoryLow attribute
+    @param memory_low_run_max - pointer to variable to store MemoryLowRunMax attribute
+    @param oom - pointer to variable to store Oom attribute
+    @param alarm_histogram - pointer to octet string to store AlarmHistogram attribute
+    @param callback_histogram - pointer to octet string to store CallbackHistogram attribute
+    @param reports_sent - pointer to variable to store ReportsSent attribute
+    @param reports_suppressed - pointer to variable to store ReportsSuppressed attribute
+    @param stack_watermarks - pointer to octet string to store StackWatermarks attribute
+    @param stack_headroom_min - pointer to variable to store StackHeadroomMin attribute
+    @param heap_peak - pointer to variable to store HeapPeak attribute
+    @param mem_slab_peak - pointer to variable to store MemSlabPeak attribute
+*/
+#define ZB_ZCL_DECLARE_AIR_MONITOR_DIAGNOSTICS_ATTRIB_LIST(attr_list,                           \
+    alarm_delay_max, alarm_delay_avg, callback_delay_max, callback_delay_avg,                   \
+    buf_get_failures, schedule_failures, memory_low, memory_low_run_max, oom,                   \
+    alarm_histogram, callback_histogram, reports_sent, reports_suppressed,                      \
+    stack_watermarks, stack_headroom_min, heap_peak, mem_slab_peak)                             \
+  ZB_ZCL_START_DECLARE_ATTRIB_LIST_CLUSTER_REVISION(attr_list, ZB_ZCL_AIR_MONITOR_DIAGNOSTICS)  \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_ALARM_DELAY_MAX_ID, (alarm_delay_max))         \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_ALARM_DELAY_AVG_ID, (alarm_delay_avg))         \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_CALLBACK_DELAY_MAX_ID, (callback_delay_max))   \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_CALLBACK_DELAY_AVG_ID, (callback_delay_avg))   \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_BUF_GET_FAILURES_ID, (buf_get_failures))       \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_SCHEDULE_FAILURES_ID, (schedule_failures))     \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_MEMORY_LOW_ID, (memory_low))                   \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_MEMORY_LOW_RUN_MAX_ID, (memory_low_run_max))   \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_OOM_ID, (oom))                                 \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_ALARM_HISTOGRAM_ID, (alarm_histogram))         \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_CALLBACK_HISTOGRAM_ID, (callback_histogram))   \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_REPORTS_SENT_ID, (reports_sent))               \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_REPORTS_SUPPRESSED_ID, (reports_suppressed))   \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_STACK_WATERMARKS_ID, (stack_watermarks))       \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_STACK_HEADROOM_MIN_ID, (stack_headroom_min))   \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_HEAP_PEAK_ID, (heap_peak))                     \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_DIAGNOSTICS_MEM_SLAB_PEAK_ID, (mem_slab_peak))             \
+  ZB_ZCL_FINISH_DECLARE_ATTRIB_LIST
+
+void zb_zcl_air_monitor_diagnostics_init_server(void);
+#define ZB_ZCL_CLUSTER_ID_AIR_MONITOR_DIAGNOSTICS_SERVER_ROLE_INIT zb_zcl_air_monitor_diagnostics_init_server
+#define ZB_ZCL_CLUSTER_ID_AIR_MONITOR_DIAGNOSTICS_CLIENT_ROLE_INIT ((zb_zcl_cluster_init_t)NULL)
+
+#endif /* ZB_ZCL_AIR_MONITOR_DIAGNOSTICS_H */
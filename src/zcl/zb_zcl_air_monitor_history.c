@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+/* PURPOSE: Manufacturer specific Air Monitor History cluster
+*/
+
+#include <zephyr/sys/byteorder.h>
+
+#include "zb_zcl_air_monitor_history.h"
+#include "flash_log.h"
+#include "history.h"
+
+/* GetHistory payload: StartTime */
+#define GET_HISTORY_PAYLOAD_SIZE 4
+
+/* GetLog payload: Boot, StartTime */
+#define GET_LOG_PAYLOAD_SIZE 6
+
+BUILD_ASSERT(ZB_ZCL_AIR_MONITOR_HISTORY_END == HISTORY_END,
+	     "HistoryFrame end marker must match the history module");
+BUILD_ASSERT(ZB_ZCL_AIR_MONITOR_HISTORY_LOG_END == FLASH_LOG_END,
+	     "LogFrame end marker must match the flash log");
+
+/* Puts HistoryFrame fields after the command header */
+static zb_uint8_t *put_history_frame(zb_uint8_t *ptr, zb_uint32_t start_time,
+				     zb_uint32_t *next_time, zb_uint8_t *count)
+{
+	zb_uint8_t samples[ZB_ZCL_AIR_MONITOR_HISTORY_FRAME_DATA_MAX];
+	size_t len;
+
+	*count = (zb_uint8_t)history_read(start_time, samples, sizeof(samples), &len, next_time);
+
+	ZB_ZCL_PACKET_PUT_DATA32_VAL(ptr, *next_time);
+	ZB_ZCL_PACKET_PUT_DATA8(ptr, *count);
+	ZB_ZCL_PACKET_PUT_DATA_N(ptr, samples, len);
+
+	return ptr;
+}
+
+static void send_history_frame(zb_bufid_t bufid, const zb_zcl_parsed_hdr_t *cmd_info,
+			       zb_uint32_t start_time)
+{
+	zb_uint32_t next_time;
+	zb_uint8_t count;
+	zb_uint8_t *ptr = ZB_ZCL_START_PACKET(bufid);
+
+	ZB_ZCL_CONSTRUCT_SPECIFIC_COMMAND_RES_FRAME_CONTROL(ptr);
+	ZB_ZCL_CONSTRUCT_COMMAND_HEADER(ptr, cmd_info->seq_number,
+					ZB_ZCL_CMD_AIR_MONITOR_HISTORY_FRAME_ID);
+	ptr = put_history_frame(ptr, start_time, &next_time, &count);
+	ZB_ZCL_FINISH_PACKET(bufid, ptr)
+	ZB_ZCL_SEND_COMMAND_SHORT(bufid, ZB_ZCL_PARSED_HDR_SHORT_DATA(cmd_info).source.u.short_addr,
+				  ZB_APS_ADDR_MODE_16_ENDP_PRESENT,
+				  ZB_ZCL_PARSED_HDR_SHORT_DATA(cmd_info).src_endpoint,
+				  ZB_ZCL_PARSED_HDR_SHORT_DATA(cmd_info).dst_endpoint,
+				  cmd_info->profile_id, ZB_ZCL_CLUSTER_ID_AIR_MONITOR_HISTORY, NULL);
+}
+
+#if defined(CONFIG_AIR_MONITOR_FLASH_LOG)
+static void send_log_frame(zb_bufid_t bufid, const zb_zcl_parsed_hdr_t *cmd_info,
+			   struct flash_log_pos pos)
+{
+	zb_uint8_t samples[ZB_ZCL_AIR_MONITOR_HISTORY_FRAME_DATA_MAX];
+	zb_uint16_t boot;
+	size_t len;
+	/* The ZBOSS thread must not wait for a page erase, the client retries later */
+	int count = flash_log_read(&pos, samples, sizeof(samples), &len, &boot, K_NO_WAIT);
+	zb_uint8_t *ptr;
+
+	if (count < 0) {
+		ZB_ZCL_PROCESS_COMMAND_FINISH(bufid, cmd_info, ZB_ZCL_STATUS_WAIT_FOR_DATA);
+		return;
+	}
+
+	ptr = ZB_ZCL_START_PACKET(bufid);
+
+	ZB_ZCL_CONSTRUCT_SPECIFIC_COMMAND_RES_FRAME_CONTROL(ptr);
+	ZB_ZCL_CONSTRUCT_COMMAND_HEADER(ptr, cmd_info->seq_number,
+					ZB_ZCL_CMD_AIR_MONITOR_HISTORY_LOG_FRAME_ID);
+	ZB_ZCL_PACKET_PUT_DATA16_VAL(ptr, boot);
+	ZB_ZCL_PACKET_PUT_DATA16_VAL(ptr, pos.boot);
+	ZB_ZCL_PACKET_PUT_DATA32_VAL(ptr, pos.time_s);
+	ZB_ZCL_PACKET_PUT_DATA8(ptr, (zb_uint8_t)count);
+	ZB_ZCL_PACKET_PUT_DATA_N(ptr, samples, len);
+	ZB_ZCL_FINISH_PACKET(bufid, ptr)
+	ZB_ZCL_SEND_COMMAND_SHORT(bufid, ZB_ZCL_PARSED_HDR_SHORT_DATA(cmd_info).source.u.short_addr,
+				  ZB_APS_ADDR_MODE_16_ENDP_PRESENT,
+				  ZB_ZCL_PARSED_HDR_SHORT_DATA(cmd_info).src_endpoint,
+				  ZB_ZCL_PARSED_HDR_SHORT_DATA(cmd_info).dst_endpoint,
+				  cmd_info->profile_id, ZB_ZCL_CLUSTER_ID_AIR_MONITOR_HISTORY, NULL);
+}
+#endif /* CONFIG_AIR_MONITOR_FLASH_LOG */
+
+static zb_bool_t air_monitor_history_handler(zb_uint8_t param)
+{
+	zb_zcl_parsed_hdr_t cmd_info;
+	const zb_uint8_t *payload = zb_buf_begin(param);
+
+	ZB_ZCL_COPY_PARSED_HEADER(param, &cmd_info);
+
+	if (cmd_info.is_common_command ||
+	    cmd_info.cmd_direction != ZB_ZCL_FRAME_DIRECTION_TO_SRV) {
+		return ZB_FALSE;
+	}
+
+	/* The request buffer is reused for the response */
+	switch (cmd_info.cmd_id) {
+	case ZB_ZCL_CMD_AIR_MONITOR_HISTORY_GET_HISTORY_ID:
+		if (zb_buf_len(param) < GET_HISTORY_PAYLOAD_SIZE) {
+			break;
+		}
+
+		send_history_frame(param, &cmd_info, sys_get_le32(payload));
+		return ZB_TRUE;
+#if defined(CONFIG_AIR_MONITOR_FLASH_LOG)
+	case ZB_ZCL_CMD_AIR_MONITOR_HISTORY_GET_LOG_ID:
+		if (zb_buf_len(param) < GET_LOG_PAYLOAD_SIZE) {
+			break;
+		}
+
+		send_log_frame(param, &cmd_info,
+			       (struct flash_log_pos){
+				       .boot = sys_get_le16(payload),
+				       .time_s = sys_get_le32(&payload[2]),
+			       });
+		return ZB_TRUE;
+#endif /* CONFIG_AIR_MONITOR_FLASH_LOG */
+	default:
+		return ZB_FALSE;
+	}
+
+	ZB_ZCL_PROCESS_COMMAND_FINISH(param, &cmd_info, ZB_ZCL_STATUS_MALFORMED_CMD);
+
+	return ZB_TRUE;
+}
+
+zb_uint8_t zb_zcl_air_monitor_history_send_frame(zb_bufid_t bufid, zb_uint8_t endpoint,
+						 zb_uint32_t start_time, zb_uint32_t *next_time,
+						 zb_callback_t cb)
+{
+	zb_uint8_t count;
+	zb_uint8_t *ptr = ZB_ZCL_START_PACKET(bufid);
+
+	/* Same frame as the GetHistory response, the first record carries absolute values */
+	ZB_ZCL_CONSTRUCT_SPECIFIC_COMMAND_RES_FRAME_CONTROL(ptr);
+	ZB_ZCL_CONSTRUCT_COMMAND_HEADER(ptr, ZB_ZCL_GET_SEQ_NUM(),
+					ZB_ZCL_CMD_AIR_MONITOR_HISTORY_FRAME_ID);
+	ptr = put_history_frame(ptr, start_time, next_time, &count);
+	ZB_ZCL_FINISH_PACKET(bufid, ptr)
+	ZB_ZCL_SEND_COMMAND_SHORT(bufid, 0, ZB_APS_ADDR_MODE_DST_ADDR_ENDP_NOT_PRESENT, 0, endpoint,
+				  ZB_AF_HA_PROFILE_ID, ZB_ZCL_CLUSTER_ID_AIR_MONITOR_HISTORY, cb);
+
+	return count;
+}
+
+void zb_zcl_air_monitor_history_init_server(void)
+{
+	zb_zcl_add_cluster_handlers(ZB_ZCL_CLUSTER_ID_AIR_MONITOR_HISTORY,
+				    ZB_ZCL_CLUSTER_SERVER_ROLE, (zb_zcl_cluster_check_value_t)NULL,
+				    (zb_zcl_cluster_write_attr_hook_t)NULL,
+				    air_monitor_history_handler);
+}
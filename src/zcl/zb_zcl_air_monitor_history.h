@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2024 Jan Gnip
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+/* PURPOSE: Manufacturer specific Air Monitor History cluster definitions
+*/
+
+#ifndef ZB_ZCL_AIR_MONITOR_HISTORY_H
+#define ZB_ZCL_AIR_MONITOR_HISTORY_H 1
+
+#include <zboss_api.h>
+#include <zboss_api_addons.h>
+
+/** @brief Air Monitor History cluster ID, manufacturer specific range */
+#define ZB_ZCL_CLUSTER_ID_AIR_MONITOR_HISTORY 0xFC02
+
+/** @brief Default value for Air Monitor History cluster revision global attribute */
+#define ZB_ZCL_AIR_MONITOR_HISTORY_CLUSTER_REVISION_DEFAULT ((zb_uint16_t)0x0001u)
+
+/** @brief Maximum size of packed samples in a HistoryFrame, keeps the frame unfragmented */
+#define ZB_ZCL_AIR_MONITOR_HISTORY_FRAME_DATA_MAX 64
+
+/** @brief HistoryFrame NextTime value when the frame reaches the newest sample */
+#define ZB_ZCL_AIR_MONITOR_HISTORY_END 0xFFFFFFFFu
+
+/*! @brief Air Monitor History cluster attribute identifiers
+    All times are device uptime in seconds.
+*/
+enum zb_zcl_air_monitor_history_attr_e
+{
+  /** @brief Time of the oldest sample in history */
+  ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_OLDEST_TIME_ID  = 0x0000,
+  /** @brief Time of the newest sample in history */
+  ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_NEWEST_TIME_ID  = 0x0001,
+  /** @brief Number of samples in history */
+  ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_SAMPLE_COUNT_ID = 0x0002,
+  /** @brief Seconds between history samples */
+  ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_INTERVAL_ID     = 0x0003,
+  /** @brief Device uptime when the newest sample was measured, maps uptime to wall time */
+  ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_CURRENT_TIME_ID = 0x0004,
+  /** @brief Boot number of the persistent log records written since this boot */
+  ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_LOG_BOOT_ID     = 0x0005,
+};
+
+/*! @brief Air Monitor History cluster commands received by the server */
+enum zb_zcl_air_monitor_history_cmd_e
+{
+  /** @brief GetHistory: StartTime u32, the device answers with a HistoryFrame */
+  ZB_ZCL_CMD_AIR_MONITOR_HISTORY_GET_HISTORY_ID = 0x00,
+  /** @brief GetLog: Boot u16, StartTime u32, the device answers with a LogFrame */
+  ZB_ZCL_CMD_AIR_MONITOR_HISTORY_GET_LOG_ID     = 0x01,
+};
+
+/*! @brief Air Monitor History cluster commands generated by the server */
+enum zb_zcl_air_monitor_history_cmd_resp_e
+{
+  /** @brief HistoryFrame: NextTime u32, SampleCount u8, packed samples, see history.h */
+  ZB_ZCL_CMD_AIR_MONITOR_HISTORY_FRAME_ID = 0x00,
+  /** @brief LogFrame: Boot u16, NextBoot u16, NextTime u32, SampleCount u8, packed samples */
+  ZB_ZCL_CMD_AIR_MONITOR_HISTORY_LOG_FRAME_ID = 0x01,
+};
+
+/** @brief LogFrame NextBoot value when the frame reaches the newest logged sample */
+#define ZB_ZCL_AIR_MONITOR_HISTORY_LOG_END 0xFFFFu
+
+/** @cond internals_doc */
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_OLDEST_TIME_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_OLDEST_TIME_ID,               \
+  ZB_ZCL_ATTR_TYPE_U32,                                         \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_NEWEST_TIME_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_NEWEST_TIME_ID,               \
+  ZB_ZCL_ATTR_TYPE_U32,                                         \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_SAMPLE_COUNT_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_SAMPLE_COUNT_ID,              \
+  ZB_ZCL_ATTR_TYPE_U16,                                         \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_INTERVAL_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_INTERVAL_ID,                  \
+  ZB_ZCL_ATTR_TYPE_U16,                                         \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_CURRENT_TIME_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_CURRENT_TIME_ID,              \
+  ZB_ZCL_ATTR_TYPE_U32,                                         \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_LOG_BOOT_ID(data_ptr) \
+{                                                               \
+  ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_LOG_BOOT_ID,                  \
+  ZB_ZCL_ATTR_TYPE_U16,                                         \
+  ZB_ZCL_ATTR_ACCESS_READ_ONLY,                                 \
+  (void*) data_ptr                                              \
+}
+
+/** @endcond */ /* internals_doc */
+
+/** @brief Declare attribute list for Air Monitor History cluster - server side
+    @param attr_list - attribute list name
+    @param oldest_time - pointer to variable to store OldestTime attribute
+    @param newest_time - pointer to variable to store NewestTime attribute
+    @param sample_count - pointer to variable to store SampleCount attribute
+    @param interval - pointer to variable to store Interval attribute
+    @param current_time - pointer to variable to store CurrentTime attribute
+    @param log_boot - pointer to variable to store LogBoot attribute
+*/
+#define ZB_ZCL_DECLARE_AIR_MONITOR_HISTORY_ATTRIB_LIST(attr_list,                              \
+    oldest_time, newest_time, sample_count, interval, current_time, log_boot)                  \
+  ZB_ZCL_START_DECLARE_ATTRIB_LIST_CLUSTER_REVISION(attr_list, ZB_ZCL_AIR_MONITOR_HISTORY)     \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_OLDEST_TIME_ID, (oldest_time))          \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_NEWEST_TIME_ID, (newest_time))          \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_SAMPLE_COUNT_ID, (sample_count))        \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_INTERVAL_ID, (interval))                \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_CURRENT_TIME_ID, (current_time))        \
+  ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_AIR_MONITOR_HISTORY_LOG_BOOT_ID, (log_boot))                \
+  ZB_ZCL_FINISH_DECLARE_ATTRIB_LIST
+
+/** @brief Sends an unsolicited HistoryFrame to the devices bound to the History cluster
+    @param bufid - buffer for the frame, passed to the callback when the frame is sent or failed
+    @param endpoint - source endpoint
+    @param start_time - time of the first sample to include
+    @param next_time - NextTime of the frame
+    @param cb - callback called with the buffer
+    @return number of samples in the frame
+*/
+zb_uint8_t zb_zcl_air_monitor_history_send_frame(zb_bufid_t bufid, zb_uint8_t endpoint,
+                                                 zb_uint32_t start_time, zb_uint32_t *next_time,
+                                                 zb_callback_t cb);
+
+void zb_zcl_air_monitor_history_init_server(void);
+#define ZB_ZCL_CLUSTER_ID_AIR_MONITOR_HISTORY_SERVER_ROLE_INIT zb_zcl_air_monitor_history_init_server
+#define ZB_ZCL_CLUSTER_ID_AIR_MONITOR_HISTORY_CLIENT_ROLE_INIT ((zb_zcl_cluster_init_t)NULL)
+
+#endif /* ZB_ZCL_AIR_MONITOR_HISTORY_H */
@@ -2,27 +2,160 @@ const fz = require("zigbee-herdsman-converters/converters/fromZigbee");
 const tz = require("zigbee-herdsman-converters/converters/toZigbee");
 const exposes = require("zigbee-herdsman-converters/lib/exposes");
 const reporting = require("zigbee-herdsman-converters/lib/reporting");
-const extend = require("zigbee-herdsman-converters/lib/extend");
+const {deviceAddCustomCluster} = require("zigbee-herdsman-converters/lib/modernExtend");
+const {Zcl} = require("zigbee-herdsman");
 const constants = require("zigbee-herdsman-converters/lib/constants");
 const e = exposes.presets;
 const ea = exposes.access;
 
+// Manufacturer specific Air Monitor Control cluster (src/zcl/zb_zcl_air_monitor_control.h)
+const airMonitorControl = {
+    ID: 0xFC00,
+    attributes: {
+        calibrationState: {ID: 0x0000, type: Zcl.DataType.ENUM8},
+        calibrationCorrection: {ID: 0x0001, type: Zcl.DataType.INT16},
+        calibrationReference: {ID: 0x0002, type: Zcl.DataType.UINT16},
+        samplingMode: {ID: 0x0003, type: Zcl.DataType.ENUM8},
+        dutyCycle: {ID: 0x0004, type: Zcl.DataType.UINT16},
+    },
+    commands: {
+        startCalibration: {ID: 0x00, parameters: [{name: "reference", type: Zcl.DataType.UINT16}]},
+    },
+    commandsResponse: {},
+};
+// Manufacturer specific Air Monitor History cluster (src/zcl/zb_zcl_air_monitor_history.h),
+// left undeclared so its frames reach the converter raw
+const airMonitorHistory = {
+    cluster: 0xFC02,
+    historyFrame: 0x00,
+    end: 0xFFFFFFFF,
+};
+const calibrationStates = ["idle", "stopping", "recalibrating", "restarting", "done", "failed"];
+const samplingModes = ["normal", "low_power", "single_shot"];
+
+// LEB128 varint at the offset, returns [value, next offset], fields are up to 35 bits wide
+const readVarint = (buffer, offset) => {
+    let value = 0;
+    for (let shift = 0; offset < buffer.length; shift += 7) {
+        const byte = buffer[offset++];
+        value += (byte & 0x7F) * 2 ** shift;
+        if (!(byte & 0x80)) {
+            return [value, offset];
+        }
+    }
+    throw new Error("Truncated history record");
+};
+
+const zigzagDecode = (value) => (value % 2 ? -(value + 1) / 2 : value / 2);
+
+// Packed samples of a HistoryFrame, see src/history.h
+const decodeHistory = (buffer, offset, count) => {
+    const state = {time: 0, values: [0, 0, 0]};
+    const samples = [];
+    for (let i = 0; i < count; i++) {
+        let field;
+        [field, offset] = readVarint(buffer, offset);
+        state.time += Math.floor(field / 8);
+        const valid = field % 8;
+        for (let channel = 0; channel < 3; channel++) {
+            if (valid & (1 << channel)) {
+                let delta;
+                [delta, offset] = readVarint(buffer, offset);
+                state.values[channel] += zigzagDecode(delta);
+            }
+        }
+        const sample = {uptime: state.time};
+        if (valid & 1) sample.temperature = state.values[0] / 100;
+        if (valid & 2) sample.humidity = state.values[1] / 100;
+        if (valid & 4) sample.co2 = state.values[2];
+        samples.push(sample);
+    }
+    return samples;
+};
+
+const fzLocal = {
+    history_frame: {
+        cluster: airMonitorHistory.cluster,
+        type: ["raw"],
+        convert: (model, msg, publish, options, meta) => {
+            // ZCL header: frame control, manufacturer code if flagged, sequence number, command
+            const data = msg.data;
+            const offset = data[0] & 0x04 ? 5 : 3;
+            if (data[offset - 1] !== airMonitorHistory.historyFrame || data.length < offset + 5) {
+                return;
+            }
+            const nextTime = data.readUInt32LE(offset);
+            const count = data[offset + 4];
+            return {
+                history: decodeHistory(data, offset + 5, count),
+                history_next_time: nextTime === airMonitorHistory.end ? null : nextTime,
+            };
+        },
+    },
+    co2_calibration: {
+        cluster: "airMonitorControl",
+        type: ["attributeReport", "readResponse"],
+        convert: (model, msg, publish, options, meta) => {
+            const result = {};
+            if (msg.data.hasOwnProperty("calibrationState")) {
+                result.co2_calibration_state = calibrationStates[msg.data.calibrationState];
+            }
+            if (msg.data.hasOwnProperty("calibrationCorrection")) {
+                result.co2_calibration_correction = msg.data.calibrationCorrection;
+            }
+            if (msg.data.hasOwnProperty("samplingMode")) {
+                result.sampling_mode = samplingModes[msg.data.samplingMode];
+            }
+            if (msg.data.hasOwnProperty("dutyCycle")) {
+                result.sensor_duty_cycle = msg.data.dutyCycle / 100;
+            }
+            return result;
+        },
+    },
+};
+
+const tzLocal = {
+    co2_calibration: {
+        key: ["co2_calibration"],
+        convertSet: async (entity, key, value, meta) => {
+            // CalibrationReference only stores the button reference, the command starts recalibration
+            await entity.command("airMonitorControl", "startCalibration", {reference: value},
+                {disableDefaultResponse: false});
+        },
+    },
+};
+
 const definition = {
     zigbeeModel: ["AirQualityMonitor_v1.0"],
     model: "AirQualityMonitor_v1.0",
     vendor: "DIY",
     description: "Air quality monitor (https://github.com/nobodyguy/zigbee_air_quality_monitor_firmware)",
-    fromZigbee: [fz.temperature, fz.humidity, fz.co2],
-    toZigbee: [], // Should be empty, unless device can be controlled (e.g. lights, switches).
-    exposes: [e.identify(), e.temperature(), e.humidity(), e.co2()],
+    extend: [deviceAddCustomCluster("airMonitorControl", airMonitorControl)],
+    fromZigbee: [fz.temperature, fz.humidity, fz.co2, fz.battery, fzLocal.co2_calibration,
+        fzLocal.history_frame],
+    toZigbee: [tzLocal.co2_calibration],
+    exposes: [e.identify(), e.temperature(), e.humidity(), e.co2(), e.voltage(),
+        exposes.numeric("co2_calibration", ea.SET).withUnit("ppm").withValueMin(350).withValueMax(2000)
+            .withDescription("Forces CO2 recalibration against the given reference concentration"),
+        exposes.enum("co2_calibration_state", ea.STATE, calibrationStates)
+            .withDescription("Progress of the forced CO2 recalibration"),
+        exposes.numeric("co2_calibration_correction", ea.STATE).withUnit("ppm")
+            .withDescription("Correction applied by the last forced CO2 recalibration"),
+        exposes.enum("sampling_mode", ea.STATE, samplingModes)
+            .withDescription("Current CO2 sensor measurement mode"),
+        exposes.numeric("sensor_duty_cycle", ea.STATE).withUnit("%")
+            .withDescription("Share of time the CO2 sensor spent measuring since boot")],
     configure: async (device, coordinatorEndpoint, logger) => {
         const endpointID = 1;
         const endpoint = device.getEndpoint(endpointID);
-        const clusters = ["msTemperatureMeasurement", "msRelativeHumidity", "msCO2"];
+        // The History cluster carries the samples measured while the network was lost
+        const clusters = ["msTemperatureMeasurement", "msRelativeHumidity", "msCO2", "genPowerCfg",
+            airMonitorHistory.cluster];
         await reporting.bind(endpoint, coordinatorEndpoint, clusters);
         await reporting.temperature(endpoint, {min: 1, max: constants.repInterval.MINUTES_5, change: 10}); // 0.1 degree change
         await reporting.humidity(endpoint, {min: 1, max: constants.repInterval.MINUTES_5, change: 10}); // 0.1 % change
         await reporting.co2(endpoint, {min: 5, max: constants.repInterval.MINUTES_5, change: 0.00005}); // 50 ppm change
+        await reporting.batteryVoltage(endpoint); // supply voltage, sampled every 10 minutes
     },
 };
 